@@ -0,0 +1,180 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargobenchhistory.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QSaveFile>
+
+#include <cmath>
+
+QJsonObject CargoBenchResult::toJson() const
+{
+    return QJsonObject{
+        { QStringLiteral("mean"), mean },
+        { QStringLiteral("error"), error },
+        { QStringLiteral("commit"), commit },
+        { QStringLiteral("time"), time.toString(Qt::ISODate) }
+    };
+}
+
+CargoBenchResult CargoBenchResult::fromJson(const QString& name, const QJsonObject& object)
+{
+    CargoBenchResult result;
+    result.name = name;
+    result.mean = object.value(QStringLiteral("mean")).toDouble();
+    result.error = object.value(QStringLiteral("error")).toDouble();
+    result.commit = object.value(QStringLiteral("commit")).toString();
+    result.time = QDateTime::fromString(object.value(QStringLiteral("time")).toString(), Qt::ISODate);
+    return result;
+}
+
+CargoBenchResult CargoBenchResult::fromLibtestLine(const QString& line)
+{
+    static const QRegularExpression benchLine(QStringLiteral("^test (.+) \\.\\.\\. bench:\\s+([\\d,.]+) ns/iter \\(\\+/- ([\\d,.]+)\\)"));
+
+    CargoBenchResult result;
+    const QRegularExpressionMatch match = benchLine.match(line);
+    if (match.hasMatch())
+    {
+        result.name = match.captured(1);
+        result.mean = match.captured(2).remove(QLatin1Char(',')).toDouble();
+        result.error = libtestStandardError(match.captured(3).remove(QLatin1Char(',')).toDouble());
+    }
+    return result;
+}
+
+CargoBenchResult CargoBenchResult::fromCriterionEstimates(const QString& name, const QByteArray& json)
+{
+    const QJsonObject mean = QJsonDocument::fromJson(json).object().value(QStringLiteral("mean")).toObject();
+
+    CargoBenchResult result;
+    result.name = name;
+    result.mean = mean.value(QStringLiteral("point_estimate")).toDouble();
+    result.error = mean.value(QStringLiteral("standard_error")).toDouble();
+    return result;
+}
+
+/**
+ * Estimates the standard error of a libtest benchmark, which only prints the median of its samples
+ * and the range between the slowest and the fastest one.
+ *
+ * libtest takes 50 samples, whose range is about 4.5 standard deviations for a normal distribution,
+ * and the median of that many samples has a standard error of about 1.25 standard deviations divided by √50.
+ */
+double CargoBenchResult::libtestStandardError(double range)
+{
+    const int samples = 50;
+    const double rangeInDeviations = 4.5;
+    const double deviation = range / rangeInDeviations;
+    return 1.2533 * deviation / std::sqrt(double(samples));
+}
+
+const CargoBenchResult* CargoBenchHistory::latest(const QString& name) const
+{
+    auto it = results.constFind(name);
+    return (it == results.constEnd() || it->isEmpty()) ? nullptr : &it->last();
+}
+
+void CargoBenchHistory::add(const CargoBenchResult& result)
+{
+    QVector<CargoBenchResult>& list = results[result.name];
+    list << result;
+    if (list.size() > MaxResultsPerBench)
+    {
+        list.remove(0, list.size() - MaxResultsPerBench);
+    }
+}
+
+double CargoBenchHistory::score(const CargoBenchResult& before, const CargoBenchResult& after)
+{
+    const double difference = after.mean - before.mean;
+    const double error = std::sqrt(before.error * before.error + after.error * after.error);
+    if (error <= 0)
+    {
+        // Without any error estimate, every change is as significant as it gets
+        return difference > 0 ? HUGE_VAL : (difference < 0 ? -HUGE_VAL : 0);
+    }
+    return difference / error;
+}
+
+bool CargoBenchHistory::isRegression(const CargoBenchResult& before, const CargoBenchResult& after)
+{
+    if (before.mean <= 0)
+    {
+        return false;
+    }
+    const double change = (after.mean - before.mean) / before.mean;
+    return score(before, after) > SignificantScore && change > MinimalChange;
+}
+
+CargoBenchHistory CargoBenchHistory::load(const QString& fileName)
+{
+    CargoBenchHistory history;
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return history;
+    }
+
+    const QJsonObject benches = QJsonDocument::fromJson(file.readAll()).object();
+    for (auto it = benches.constBegin(); it != benches.constEnd(); ++it)
+    {
+        const QJsonArray array = it.value().toArray();
+        for (const QJsonValue& value : array)
+        {
+            history.add(CargoBenchResult::fromJson(it.key(), value.toObject()));
+        }
+    }
+    return history;
+}
+
+bool CargoBenchHistory::save(const QString& fileName) const
+{
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+    QJsonObject benches;
+    for (auto it = results.constBegin(); it != results.constEnd(); ++it)
+    {
+        QJsonArray array;
+        for (const CargoBenchResult& result : it.value())
+        {
+            array << result.toJson();
+        }
+        benches.insert(it.key(), array);
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    file.write(QJsonDocument(benches).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
@@ -0,0 +1,113 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOBENCHHISTORY_H
+#define CARGOBENCHHISTORY_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+class QJsonObject;
+
+/**
+ * A single measurement of a benchmark, as the mean time of one iteration in nanoseconds,
+ * with the standard error of that mean.
+ */
+struct CargoBenchResult
+{
+    QString name;
+    double mean = 0;
+    double error = 0;
+    QString commit;
+    QDateTime time;
+
+    QJsonObject toJson() const;
+    static CargoBenchResult fromJson(const QString& name, const QJsonObject& object);
+
+    /**
+     * Parses a line that libtest prints for a benchmark, such as
+     * "test name ... bench:       1,234 ns/iter (+/- 56)".
+     *
+     * @return the result, with an empty name if @p line is not the result of a benchmark
+     */
+    static CargoBenchResult fromLibtestLine(const QString& line);
+
+    /**
+     * Reads the mean of the estimates.json that Criterion writes for each benchmark.
+     *
+     * @return the result, with a mean of 0 if @p json does not contain a mean
+     */
+    static CargoBenchResult fromCriterionEstimates(const QString& name, const QByteArray& json);
+
+    /**
+     * Estimates the standard error of a libtest benchmark from the range it prints.
+     */
+    static double libtestStandardError(double range);
+};
+
+/**
+ * Past results of the benchmarks of a project, recorded with the commit they were measured at.
+ */
+class CargoBenchHistory
+{
+public:
+    static const int MaxResultsPerBench = 100;
+
+    /// Slowdowns with a z-score below this are not significant, at 99% confidence
+    static constexpr double SignificantScore = 2.58;
+
+    /// Slowdowns smaller than this fraction of the previous time are not reported, even if they are significant
+    static constexpr double MinimalChange = 0.02;
+
+    /**
+     * @return the latest result of the benchmark @p name, or nullptr if it was never run
+     */
+    const CargoBenchResult* latest(const QString& name) const;
+    void add(const CargoBenchResult& result);
+
+    /**
+     * Compares two results of a benchmark, treating their errors as standard deviations of normal distributions.
+     *
+     * @return the z-score of the difference, positive if @p after is slower
+     */
+    static double score(const CargoBenchResult& before, const CargoBenchResult& after);
+
+    /**
+     * @return whether @p after is significantly slower than @p before, by more than MinimalChange
+     */
+    static bool isRegression(const CargoBenchResult& before, const CargoBenchResult& after);
+
+    /**
+     * @return all results of the benchmark @p name, the oldest first
+     */
+    QVector<CargoBenchResult> resultsOf(const QString& name) const { return results.value(name); }
+
+    static CargoBenchHistory load(const QString& fileName);
+    bool save(const QString& fileName) const;
+
+private:
+    QHash<QString, QVector<CargoBenchResult>> results;
+};
+
+#endif
@@ -0,0 +1,216 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargobenchjob.h"
+#include "cargooutputmodel.h"
+#include "cargoplugin.h"
+#include "debug.h"
+
+#include <KLocalizedString>
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <interfaces/iproject.h>
+#include <project/projectmodel.h>
+
+#include <algorithm>
+
+using namespace KDevelop;
+
+static QString formatTime(double nanoseconds)
+{
+    if (nanoseconds >= 1e9)
+    {
+        return i18nc("duration in seconds", "%1 s", QString::number(nanoseconds / 1e9, 'f', 3));
+    }
+    if (nanoseconds >= 1e6)
+    {
+        return i18nc("duration in milliseconds", "%1 ms", QString::number(nanoseconds / 1e6, 'f', 3));
+    }
+    if (nanoseconds >= 1e3)
+    {
+        return i18nc("duration in microseconds", "%1 µs", QString::number(nanoseconds / 1e3, 'f', 3));
+    }
+    return i18nc("duration in nanoseconds", "%1 ns", QString::number(nanoseconds, 'f', 1));
+}
+
+CargoBenchJob::CargoBenchJob( CargoPlugin* plugin, ProjectBaseItem* item )
+    : CargoBuildJob( plugin, item, QStringLiteral("bench") )
+    , criterionDirectory( plugin->targetDirectory( item->project() ), QStringLiteral("criterion") )
+    , historyFile( Path( plugin->cacheDirectory( item->project() ), QStringLiteral("benchmarks.json") ).toLocalFile() )
+{
+    setJsonMessages( true );
+    setStandardViewType( KDevelop::IOutputView::RunView );
+    connect( this, &CargoBuildJob::messagesReceived, this, &CargoBenchJob::benchMessages );
+}
+
+void CargoBenchJob::start()
+{
+    startTime = QDateTime::currentDateTime();
+
+    // The commit is only needed at the end, so it is read while the benchmarks run
+    git = new QProcess( this );
+    git->setWorkingDirectory( project()->path().toLocalFile() );
+    connect( git.data(), static_cast<void(QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+             this, [this]( int exitCode, QProcess::ExitStatus exitStatus ) {
+        if (exitStatus == QProcess::NormalExit && exitCode == 0)
+        {
+            commit = QString::fromUtf8( git->readAllStandardOutput().trimmed() );
+        }
+    });
+    git->start( QStringLiteral("git"), { QStringLiteral("rev-parse"), QStringLiteral("--short"), QStringLiteral("HEAD") } );
+
+    CargoBuildJob::start();
+}
+
+void CargoBenchJob::benchMessages( const QVector<CargoMessage>& messages )
+{
+    for (const CargoMessage& message : messages)
+    {
+        if (message.reason != CargoMessage::ProgramOutput)
+        {
+            continue;
+        }
+
+        const CargoBenchResult result = CargoBenchResult::fromLibtestLine( message.text );
+        if (!result.name.isEmpty())
+        {
+            results << result;
+        }
+    }
+}
+
+void CargoBenchJob::collectCriterionResults()
+{
+    // Criterion keeps the estimates of the latest run of each benchmark in <id>/new/estimates.json
+    QDirIterator it( criterionDirectory.toLocalFile(), { QStringLiteral("estimates.json") }, QDir::Files, QDirIterator::Subdirectories );
+    while (it.hasNext())
+    {
+        const QFileInfo info( it.next() );
+        if (info.dir().dirName() != QLatin1String("new") || info.lastModified() < startTime)
+        {
+            continue;
+        }
+
+        QFile file( info.filePath() );
+        if (!file.open( QIODevice::ReadOnly ))
+        {
+            continue;
+        }
+
+        QDir benchDirectory = info.dir();
+        benchDirectory.cdUp();
+        QString name = QDir( criterionDirectory.toLocalFile() ).relativeFilePath( benchDirectory.path() );
+
+        QFile benchmark( info.dir().filePath( QStringLiteral("benchmark.json") ) );
+        if (benchmark.open( QIODevice::ReadOnly ))
+        {
+            const QString id = QJsonDocument::fromJson( benchmark.readAll() ).object().value( QStringLiteral("full_id") ).toString();
+            if (!id.isEmpty())
+            {
+                name = id;
+            }
+        }
+
+        const CargoBenchResult result = CargoBenchResult::fromCriterionEstimates( name, file.readAll() );
+        if (result.mean > 0)
+        {
+            results << result;
+        }
+    }
+}
+
+void CargoBenchJob::finishOutput( int exitCode )
+{
+    CargoBuildJob::finishOutput( exitCode );
+    if (exitCode == 0)
+    {
+        collectCriterionResults();
+        reportResults();
+    }
+}
+
+void CargoBenchJob::reportResults()
+{
+    if (results.isEmpty())
+    {
+        return;
+    }
+
+    // The commit was read while the benchmarks ran, the results are kept without it if git is still running
+
+    std::sort( results.begin(), results.end(), [](const CargoBenchResult& a, const CargoBenchResult& b) {
+        return a.name < b.name;
+    });
+
+    CargoBenchHistory history = CargoBenchHistory::load( historyFile );
+    QVector<FilteredItem> items;
+    items << FilteredItem( i18n( "Benchmark results:" ), FilteredItem::ActionItem );
+    int regressions = 0;
+
+    for (CargoBenchResult& result : results)
+    {
+        result.commit = commit;
+        result.time = startTime;
+
+        FilteredItem item( QStringLiteral("  %1: %2 (± %3)").arg( result.name, formatTime( result.mean ), formatTime( result.error ) ),
+                           FilteredItem::StandardItem );
+        const CargoBenchResult* previous = history.latest( result.name );
+        if (previous && previous->mean > 0)
+        {
+            const double change = (result.mean - previous->mean) / previous->mean;
+            const double score = CargoBenchHistory::score( *previous, result );
+            const QString baseline = previous->commit.isEmpty() ? previous->time.toString( Qt::DefaultLocaleShortDate ) : previous->commit;
+            item.originalLine += i18n( ", %1% compared with %2", QString::asprintf( "%+.1f", change * 100 ), baseline );
+
+            if (CargoBenchHistory::isRegression( *previous, result ))
+            {
+                item.type = FilteredItem::WarningItem;
+                item.originalLine += i18n( ", significantly slower (z = %1)", QString::number( score, 'f', 1 ) );
+                ++regressions;
+            }
+        }
+
+        items << item;
+        history.add( result );
+    }
+
+    if (regressions > 0)
+    {
+        items << FilteredItem( i18np( "1 benchmark got slower", "%1 benchmarks got slower", regressions ), FilteredItem::WarningItem );
+    }
+
+    if (model())
+    {
+        model()->appendItems( items );
+    }
+
+    if (!history.save( historyFile ))
+    {
+        qCWarning(CUSTOMBUILDSYSTEM) << "Could not store benchmark results in" << historyFile;
+    }
+}
@@ -0,0 +1,68 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOBENCHJOB_H
+#define CARGOBENCHJOB_H
+
+#include "cargobenchhistory.h"
+#include "cargobuildjob.h"
+
+#include <QDateTime>
+#include <QPointer>
+#include <QVector>
+
+#include <util/path.h>
+
+/**
+ * Runs cargo bench and compares the results with the previous run of each benchmark.
+ *
+ * Results are taken both from the output of libtest benchmarks and from the estimates
+ * that Criterion writes to the target directory. Each run is added to the history of the project,
+ * kept in its cache directory, and benchmarks that got significantly slower are marked in the output.
+ */
+class CargoBenchJob : public CargoBuildJob
+{
+Q_OBJECT
+public:
+    CargoBenchJob( CargoPlugin* plugin, KDevelop::ProjectBaseItem* item );
+
+    void start() override;
+
+protected:
+    void finishOutput( int exitCode ) override;
+
+private slots:
+    void benchMessages( const QVector<CargoMessage>& messages );
+
+private:
+    void collectCriterionResults();
+    void reportResults();
+
+    KDevelop::Path criterionDirectory;
+    QString historyFile;
+    QDateTime startTime;
+    QPointer<QProcess> git;
+    QString commit;
+    QVector<CargoBenchResult> results;
+};
+
+#endif
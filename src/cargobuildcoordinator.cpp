@@ -0,0 +1,281 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargobuildcoordinator.h"
+#include "debug.h"
+
+#include <QByteArray>
+#include <QThread>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+CargoBuildCoordinator::CargoBuildCoordinator( QObject* parent )
+    : QObject( parent )
+    , budget( qMax( QThread::idealThreadCount() - 1, 1 ) )
+    , freeTokens( budget )
+{
+}
+
+CargoBuildCoordinator::~CargoBuildCoordinator()
+{
+    const QList<QObject*> owners = jobservers.keys();
+    for (QObject* holder : owners)
+    {
+        closeJobserver( holder );
+    }
+}
+
+QString CargoBuildCoordinator::makeFlags( QObject* holder ) const
+{
+    const Jobserver jobserver = jobservers.value( holder );
+    if (jobserver.readFd < 0)
+    {
+        return QString();
+    }
+
+    // Older clients only understand --jobserver-fds, newer ones prefer --jobserver-auth
+    return QStringLiteral("-j --jobserver-fds=%1,%2 --jobserver-auth=%1,%2").arg( jobserver.readFd ).arg( jobserver.writeFd );
+}
+
+QVector<int> CargoBuildCoordinator::descriptors( QObject* holder ) const
+{
+    const Jobserver jobserver = jobservers.value( holder );
+    if (jobserver.readFd < 0)
+    {
+        return {};
+    }
+    return { jobserver.readFd, jobserver.writeFd };
+}
+
+bool CargoBuildCoordinator::acquire( const QString& targetDirectory, QObject* holder, const std::function<void()>& granted, int jobs )
+{
+    connect( holder, &QObject::destroyed, this, &CargoBuildCoordinator::release, Qt::UniqueConnection );
+    if (jobs > 0)
+    {
+        jobLimits.insert( holder, jobs );
+    }
+
+    if (!holders.contains( targetDirectory ))
+    {
+        grant( targetDirectory, holder );
+        granted();
+        return true;
+    }
+
+    qCDebug(CUSTOMBUILDSYSTEM) << "Queueing a build behind the one running in" << targetDirectory;
+    queues[targetDirectory] << qMakePair( holder, granted );
+    return false;
+}
+
+void CargoBuildCoordinator::release( QObject* holder )
+{
+    disconnect( holder, &QObject::destroyed, this, &CargoBuildCoordinator::release );
+    jobLimits.remove( holder );
+
+    for (auto it = queues.begin(); it != queues.end(); ++it)
+    {
+        auto& queue = it.value();
+        for (int i = 0; i < queue.size(); ++i)
+        {
+            if (queue.at( i ).first == holder)
+            {
+                queue.removeAt( i );
+                if (queue.isEmpty())
+                {
+                    queues.erase( it );
+                }
+                return;
+            }
+        }
+    }
+
+    const QString targetDirectory = holders.key( holder );
+    if (targetDirectory.isEmpty())
+    {
+        return;
+    }
+    holders.remove( targetDirectory );
+    closeJobserver( holder );
+
+    auto queue = queues.find( targetDirectory );
+    if (queue != queues.end() && !queue->isEmpty())
+    {
+        const auto next = queue->takeFirst();
+        if (queue->isEmpty())
+        {
+            queues.erase( queue );
+        }
+        grant( targetDirectory, next.first );
+        next.second();
+    }
+    else
+    {
+        shareFreeTokens();
+    }
+}
+
+void CargoBuildCoordinator::grant( const QString& targetDirectory, QObject* holder )
+{
+    holders.insert( targetDirectory, holder );
+    openJobserver( holder );
+}
+
+void CargoBuildCoordinator::openJobserver( QObject* holder )
+{
+#ifdef Q_OS_UNIX
+    /*
+     * The descriptors are close-on-exec, so that only the cargo processes given them
+     * in CargoProcess inherit them, and not every program the IDE starts.
+     */
+    int fds[2];
+#ifdef Q_OS_LINUX
+    const int created = pipe2( fds, O_CLOEXEC );
+#else
+    const int created = pipe( fds );
+    if (created == 0)
+    {
+        fcntl( fds[0], F_SETFD, FD_CLOEXEC );
+        fcntl( fds[1], F_SETFD, FD_CLOEXEC );
+    }
+#endif
+    if (created != 0)
+    {
+        qCWarning(CUSTOMBUILDSYSTEM) << "Could not create a pipe for the jobserver, the build is not limited together with others";
+        return;
+    }
+
+    Jobserver jobserver;
+    jobserver.readFd = fds[0];
+    jobserver.writeFd = fds[1];
+    if (jobLimits.contains( holder ))
+    {
+        // cargo itself holds one implicit token
+        jobserver.maxTokens = jobLimits.value( holder ) - 1;
+    }
+
+    // The share is taken from the free tokens first, then from what the other builds are not using
+    const int fairShare = qMax( budget / (jobservers.size() + 1), 1 );
+    const int share = jobserver.maxTokens >= 0 ? qMin( fairShare, jobserver.maxTokens ) : fairShare;
+    int tokens = qMin( freeTokens, share );
+    freeTokens -= tokens;
+    for (auto it = jobservers.begin(); it != jobservers.end() && tokens < share; ++it)
+    {
+        const int excess = it->tokens - fairShare;
+        if (excess > 0)
+        {
+            tokens += takeTokens( *it, qMin( excess, share - tokens ) );
+        }
+    }
+    giveTokens( jobserver, tokens );
+    freeTokens += tokens - jobserver.tokens;
+
+    jobservers.insert( holder, jobserver );
+#else
+    Q_UNUSED( holder );
+#endif
+}
+
+/**
+ * Closes the jobserver of a build that finished.
+ *
+ * All its tokens go back to the budget, whether they are still in the pipe or were held by a cargo
+ * that was killed, as nothing else can use the pipe once it is closed.
+ */
+void CargoBuildCoordinator::closeJobserver( QObject* holder )
+{
+    auto it = jobservers.find( holder );
+    if (it == jobservers.end())
+    {
+        return;
+    }
+
+#ifdef Q_OS_UNIX
+    close( it->readFd );
+    close( it->writeFd );
+#endif
+    freeTokens += it->tokens;
+    jobservers.erase( it );
+}
+
+void CargoBuildCoordinator::shareFreeTokens()
+{
+    int remaining = jobservers.size();
+    for (auto it = jobservers.begin(); it != jobservers.end() && freeTokens > 0; ++it, --remaining)
+    {
+        int tokens = freeTokens / remaining + (freeTokens % remaining > 0 ? 1 : 0);
+        if (it->maxTokens >= 0)
+        {
+            tokens = qMin( tokens, it->maxTokens - it->tokens );
+        }
+        const int before = it->tokens;
+        giveTokens( *it, tokens );
+        freeTokens -= it->tokens - before;
+    }
+}
+
+/**
+ * Takes up to @p count tokens that are in the pipe, without waiting for ones held by cargo.
+ *
+ * @return the number of tokens taken
+ */
+int CargoBuildCoordinator::takeTokens( Jobserver& jobserver, int count )
+{
+    int taken = 0;
+#ifdef Q_OS_UNIX
+    const int flags = fcntl( jobserver.readFd, F_GETFL );
+    fcntl( jobserver.readFd, F_SETFL, flags | O_NONBLOCK );
+    char buffer[64];
+    while (taken < count)
+    {
+        const ssize_t bytes = read( jobserver.readFd, buffer, qMin( count - taken, int( sizeof(buffer) ) ) );
+        if (bytes <= 0)
+        {
+            break;
+        }
+        taken += bytes;
+    }
+    fcntl( jobserver.readFd, F_SETFL, flags );
+#endif
+    jobserver.tokens -= taken;
+    return taken;
+}
+
+void CargoBuildCoordinator::giveTokens( Jobserver& jobserver, int count )
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+#ifdef Q_OS_UNIX
+    const QByteArray fill( count, '+' );
+    const ssize_t written = write( jobserver.writeFd, fill.constData(), fill.size() );
+    if (written != fill.size())
+    {
+        qCWarning(CUSTOMBUILDSYSTEM) << "Could not fill the jobserver with" << count << "tokens";
+    }
+    jobserver.tokens += qMax( written, ssize_t( 0 ) );
+#endif
+}
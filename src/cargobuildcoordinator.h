@@ -0,0 +1,118 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOBUILDCOORDINATOR_H
+#define CARGOBUILDCOORDINATOR_H
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+#include <functional>
+
+/**
+ * Shares the machine between cargo processes of all open projects.
+ *
+ * Every build holding a target directory gets a GNU make jobserver of its own,
+ * passed to cargo in CARGO_MAKEFLAGS and inherited through a CargoProcess.
+ * The tokens of all jobservers together never exceed the budget, so builds of several projects
+ * together do not compile more crates at once than there are processors.
+ * Each cargo process also owns one implicit token, so the total can exceed
+ * the budget by the number of builds running at the same time.
+ *
+ * The tokens are counted per build. A new build gets an equal share, taken from the tokens
+ * the others do not use at the moment, and the tokens of a build that finished, including
+ * the ones a killed cargo never gave back, are shared between the builds that are still running.
+ *
+ * cargo ignores CARGO_BUILD_JOBS and -j once it uses a jobserver, so a build asking for fewer jobs
+ * gets fewer tokens instead. The budget still applies, so the smaller of the two limits wins.
+ *
+ * Builds sharing a target directory would only wait for each other on its lock,
+ * so they are queued here instead and started one after another, in order.
+ */
+class CargoBuildCoordinator : public QObject
+{
+Q_OBJECT
+public:
+    explicit CargoBuildCoordinator( QObject* parent = nullptr );
+    ~CargoBuildCoordinator() override;
+
+    /**
+     * @return the value of CARGO_MAKEFLAGS that makes cargo use the jobserver of @p holder,
+     * or an empty string if it does not hold a directory or its jobserver could not be created
+     */
+    QString makeFlags( QObject* holder ) const;
+
+    /**
+     * @return the descriptors of the jobserver of @p holder, for CargoProcess::setInheritedDescriptors()
+     */
+    QVector<int> descriptors( QObject* holder ) const;
+
+    /**
+     * Calls @p granted once no other holder uses @p targetDirectory, immediately if it is free.
+     *
+     * The directory is held until release() is called or @p holder is destroyed.
+     * A holder that is destroyed while waiting is removed from the queue.
+     *
+     * @param jobs the number of parallel jobs the build is limited to, such as CARGO_BUILD_JOBS, or 0 for no limit
+     * @return true if the directory was free
+     */
+    bool acquire( const QString& targetDirectory, QObject* holder, const std::function<void()>& granted, int jobs = 0 );
+
+    /**
+     * Releases the directory held by @p holder, or removes it from the queue,
+     * and starts the next build waiting for the directory.
+     */
+    void release( QObject* holder );
+
+private:
+    struct Jobserver
+    {
+        int readFd = -1;
+        int writeFd = -1;
+        /// Tokens given to this jobserver, both in its pipe and held by cargo
+        int tokens = 0;
+        /// The most tokens this jobserver gets, or -1 for no limit
+        int maxTokens = -1;
+    };
+
+    void grant( const QString& targetDirectory, QObject* holder );
+    void openJobserver( QObject* holder );
+    void closeJobserver( QObject* holder );
+    void shareFreeTokens();
+    static int takeTokens( Jobserver& jobserver, int count );
+    static void giveTokens( Jobserver& jobserver, int count );
+
+    int budget;
+    /// Tokens of the budget that are not given to any jobserver
+    int freeTokens;
+    QHash<QObject*, Jobserver> jobservers;
+    /// The jobs requested in acquire(), until the holder releases the directory
+    QHash<QObject*, int> jobLimits;
+    QHash<QString, QObject*> holders;
+    QHash<QString, QList<QPair<QObject*, std::function<void()>>>> queues;
+};
+
+#endif
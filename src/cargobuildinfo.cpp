@@ -0,0 +1,200 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargobuildinfo.h"
+#include "cargomessage.h"
+#include "cargometadata.h"
+
+#include <QMutexLocker>
+
+#include <algorithm>
+
+using KDevelop::Path;
+
+static QString quoted(const QString& value)
+{
+    return QLatin1Char('"') + value + QLatin1Char('"');
+}
+
+CargoBuildInfo::CargoBuildInfo(const Path& workspaceRoot)
+    : workspaceRoot(workspaceRoot)
+{
+}
+
+void CargoBuildInfo::setMetadata(const CargoMetadata& metadata)
+{
+    QMutexLocker lock(&mutex);
+    this->metadata = metadata;
+    packages.clear();
+}
+
+bool CargoBuildInfo::containsPath(const Path& path)
+{
+    QMutexLocker lock(&mutex);
+    return metadata.packageForPath(path);
+}
+
+void CargoBuildInfo::addMessages(const QVector<CargoMessage>& messages)
+{
+    QMutexLocker lock(&mutex);
+    for (const CargoMessage& message : messages)
+    {
+        if (message.reason == CargoMessage::CompilerArtifact && !message.targetKinds.contains(QStringLiteral("custom-build")))
+        {
+            QStringList& known = features[message.packageName];
+            if (known != message.features)
+            {
+                known = message.features;
+                packages.remove(message.packageName);
+            }
+
+            /*
+             * Workspace members are built from the workspace, anything else is a dependency.
+             * The source directory of a crate is the one containing its root, usually src.
+             */
+            const Path root = Path(message.sourcePath).parent();
+            if (!message.sourcePath.isEmpty() && !workspaceRoot.isParentOf(root) && !dependencyRoots.contains(root))
+            {
+                dependencyRoots.insert(root);
+                packages.clear();
+            }
+        }
+        else if (message.reason == CargoMessage::BuildScriptExecuted && !message.outDir.isEmpty())
+        {
+            // Each build of a build script gets a new directory, only the latest one is used
+            QStringList& dirs = outDirs[message.packageName];
+            if (dirs != QStringList{ message.outDir })
+            {
+                dirs = QStringList{ message.outDir };
+                packages.remove(message.packageName);
+            }
+        }
+    }
+}
+
+void CargoBuildInfo::setHostConfiguration(const QByteArray& output)
+{
+    QVector<QPair<QString, QString>> configuration;
+
+    // Lines are either a name, or a name and a quoted value, such as target_os="linux"
+    const QList<QByteArray> lines = output.split('\n');
+    for (const QByteArray& rawLine : lines)
+    {
+        const QString line = QString::fromUtf8(rawLine).trimmed();
+        if (line.isEmpty())
+        {
+            continue;
+        }
+
+        const int equals = line.indexOf(QLatin1Char('='));
+        if (equals < 0)
+        {
+            configuration << qMakePair(line, QString());
+        }
+        else
+        {
+            QString value = line.mid(equals + 1);
+            if (value.startsWith(QLatin1Char('"')) && value.endsWith(QLatin1Char('"')) && value.size() >= 2)
+            {
+                value = value.mid(1, value.size() - 2);
+            }
+            configuration << qMakePair(line.left(equals), value);
+        }
+    }
+
+    QMutexLocker lock(&mutex);
+    hostConfiguration = configuration;
+    packages.clear();
+}
+
+CargoBuildInfo::Package CargoBuildInfo::packageForPath(const Path& path)
+{
+    QMutexLocker lock(&mutex);
+
+    const CargoPackage* found = metadata.packageForPath(path);
+    if (!found)
+    {
+        return Package();
+    }
+    const CargoPackage& package = *found;
+
+    auto it = packages.find(package.name);
+    if (it != packages.end())
+    {
+        return *it;
+    }
+
+    Package info;
+
+    /*
+     * Flags like target_feature appear once for every value, so those are defined with the value in the name,
+     * the same way as they are written in a cfg attribute.
+     */
+    QHash<QString, int> occurrences;
+    for (const auto& flag : qAsConst(hostConfiguration))
+    {
+        ++occurrences[flag.first];
+    }
+    for (const auto& flag : qAsConst(hostConfiguration))
+    {
+        if (flag.second.isEmpty())
+        {
+            info.defines.insert(flag.first, QString());
+        }
+        else if (occurrences.value(flag.first) > 1)
+        {
+            info.defines.insert(flag.first + QLatin1Char('=') + quoted(flag.second), QString());
+        }
+        else
+        {
+            info.defines.insert(flag.first, flag.second);
+        }
+    }
+
+    const QStringList activeFeatures = features.value(package.name);
+    for (const QString& feature : activeFeatures)
+    {
+        info.defines.insert(QStringLiteral("feature=") + quoted(feature), QString());
+    }
+
+    for (const QString& dir : outDirs.value(package.name))
+    {
+        info.includeDirectories << Path(dir);
+    }
+    Path::List roots( dependencyRoots.begin(), dependencyRoots.end() );
+    std::sort(roots.begin(), roots.end());
+    info.includeDirectories << roots;
+
+    // Arguments as rustc would get them, so a bridge to other tools can pass them on
+    QStringList arguments;
+    if (!package.edition.isEmpty())
+    {
+        arguments << QStringLiteral("--edition=") + package.edition;
+    }
+    for (const QString& feature : activeFeatures)
+    {
+        arguments << QStringLiteral("--cfg") << QStringLiteral("'feature=\"%1\"'").arg(feature);
+    }
+    info.extraArguments = arguments.join(QLatin1Char(' '));
+
+    return *packages.insert(package.name, info);
+}
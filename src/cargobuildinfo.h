@@ -0,0 +1,102 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOBUILDINFO_H
+#define CARGOBUILDINFO_H
+
+#include "cargometadata.h"
+
+#include <util/path.h>
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+struct CargoMessage;
+
+/**
+ * Build information of the packages of a workspace, for language support.
+ *
+ * The active features and the OUT_DIR of build scripts are taken from the messages
+ * of builds and checks, the conditional compilation flags of the host from rustc --print cfg,
+ * which is run by the plugin without blocking and passed to setHostConfiguration().
+ * The information of each package is only put together when it is first asked for,
+ * and kept until messages about the package change it.
+ *
+ * Language support asks for the information from its own threads, so all methods are thread-safe.
+ * The packages are looked up in a copy of the metadata, as the plugin replaces its own on the GUI thread.
+ */
+class CargoBuildInfo
+{
+public:
+    struct Package
+    {
+        QHash<QString, QString> defines;
+        KDevelop::Path::List includeDirectories;
+        QString extraArguments;
+    };
+
+    explicit CargoBuildInfo(const KDevelop::Path& workspaceRoot);
+
+    void addMessages(const QVector<CargoMessage>& messages);
+
+    /**
+     * Sets the cfg flags of the host from the output of rustc --print cfg.
+     */
+    void setHostConfiguration(const QByteArray& output);
+
+    /**
+     * Sets the metadata the packages are looked up in, and forgets the information put together for them.
+     */
+    void setMetadata(const CargoMetadata& metadata);
+
+    /**
+     * @return whether @p path is part of any package
+     */
+    bool containsPath(const KDevelop::Path& path);
+
+    /**
+     * @return the build information of the innermost package containing @p path,
+     * or an empty one if it is not part of any package
+     */
+    Package packageForPath(const KDevelop::Path& path);
+
+private:
+    QMutex mutex;
+    KDevelop::Path workspaceRoot;
+    CargoMetadata metadata;
+    /// Names and values of the cfg flags of the host, with an empty value for flags without one
+    QVector<QPair<QString, QString>> hostConfiguration;
+
+    QHash<QString, QStringList> features;
+    QHash<QString, QStringList> outDirs;
+    /// Source directories of the crates the workspace depends on
+    QSet<KDevelop::Path> dependencyRoots;
+    QHash<QString, Package> packages;
+};
+
+#endif
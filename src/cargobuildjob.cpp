@@ -25,237 +25,391 @@
 #include <KLocalizedString>
 #include <KShell>
 
+#include <QFileInfo>
+#include <QThread>
+#include <QTimer>
+
 #include <interfaces/iproject.h>
-#include <outputview/outputmodel.h>
 #include <outputview/outputdelegate.h>
-#include <outputview/filtereditem.h>
-#include <outputview/outputfilteringstrategies.h>
-#include <util/commandexecutor.h>
 #include <project/projectmodel.h>
 
 #include "cargoplugin.h"
+#include "cargobuildcoordinator.h"
+#include "cargooutputmodel.h"
+#include "cargooutputworker.h"
+#include "debug.h"
 
 using namespace KDevelop;
 
-class CargoFilterStrategy : public KDevelop::IFilterStrategy
+CargoBuildJob::CargoBuildJob( CargoPlugin* plugin, KDevelop::ProjectBaseItem* item, const QString& command )
+    : OutputJob( plugin )
+    , command( command)
+    , buildProject( item->project() )
+    , configArguments( plugin->cargoConfigArguments( item->project() ) )
+    , processEnvironment( plugin->cargoEnvironment( item->project() ) )
+    , targetDirectory( plugin->targetDirectory( item->project() ).toLocalFile() )
+    , coordinator( plugin->buildCoordinator() )
+    , exitCode( 0 )
+    , exec(nullptr)
+    , thread(nullptr)
+    , jsonMessages( false )
+    , background( false )
+    , killed( false )
+    , started( false )
 {
-public:
-    explicit CargoFilterStrategy(const QUrl& buildDir);
-    virtual ~CargoFilterStrategy();
+    setCapabilities( Killable );
+    // Cargo runs in the project, the build directory is where it puts the artifacts
+    builddir = item->project()->path().toLocalFile();
 
-    FilteredItem errorInLine(const QString& line) override;
-    FilteredItem actionInLine(const QString& line) override;
+    cmd = CargoPlugin::cargoExecutable();
 
-private:
-    KDevelop::Path buildDir;
-    QString currentFile;
-    KDevelop::FilteredItem::FilteredOutputItemType currentItemType;
-};
+    QString title = i18nc("<command> <arguments>", "%1 %2", cmd, command);
+    setTitle(title);
+    setObjectName(title);
+    setDelegate( new KDevelop::OutputDelegate );
+    standardViewType = KDevelop::IOutputView::BuildView;
 
-CargoFilterStrategy::CargoFilterStrategy(const QUrl& buildDir)
- : buildDir(buildDir)
-{
+    // Killed jobs finish without cargo reporting back, so the directory is released on any finish
+    connect( this, &KJob::finished, coordinator, [this]() {
+        coordinator->release( this );
+    });
 }
 
-CargoFilterStrategy::~CargoFilterStrategy()
+CargoBuildJob::~CargoBuildJob()
 {
+    if (thread)
+    {
+        // The worker is deleted in its own thread once the event loop quits
+        thread->quit();
+        thread->wait();
+    }
 }
 
-KDevelop::FilteredItem CargoFilterStrategy::errorInLine(const QString& line)
+void CargoBuildJob::addPackages( const QStringList& packages )
 {
-    KDevelop::FilteredItem item(line);
-    if (line.startsWith(QStringLiteral("error:")) || line.startsWith(QStringLiteral("error[")))
-    {
-        item.type = FilteredItem::ErrorItem;
-    }
-    else if (line.startsWith(QStringLiteral("warning:")) || line.startsWith(QStringLiteral("warning[")))
+    if (started || this->packages.isEmpty())
     {
-        item.type = FilteredItem::WarningItem;
+        return;
     }
-    else if (line.startsWith(QStringLiteral("   Compiling"))
-            || line.startsWith(QStringLiteral("    Finished")))
+
+    if (packages.isEmpty())
     {
-        item.type = FilteredItem::ActionItem;
+        this->packages.clear();
+        return;
     }
-    else
+
+    for (const QString& package : packages)
     {
-        QStringList elements = line.split(' ', QString::SkipEmptyParts);
-        if (elements.size() > 1 && elements[0] == QStringLiteral("-->"))
+        if (!this->packages.contains( package ))
         {
-            item.type = currentItemType;
-            QStringList location = elements[1].split(':');
-            if (location.size() > 0)
-            {
-                currentFile = location[0];
-
-                item.isActivatable = true;
-                item.url = Path(buildDir, currentFile).toUrl();
-                if (location.size() > 1)
-                {
-                    /*
-                     * Cargo counts lines from 1, and so does Kate,
-                     * but KDevelop internally counts from 0,
-                     * so we have to decrement the line number by 1.
-                     * The same is true for column numbers.
-                     */
-                    item.lineNo = location[1].toInt() - 1;
-                }
-                if (location.size() > 2)
-                {
-                    item.columnNo = location[2].toInt() - 1;
-                }
-            }
-        }
-        else if (elements.size() >= 1 && (elements[0] == '|' || elements[0] == '='))
-        {
-            item.type = FilteredItem::InformationItem;
-        }
-        else if (elements.size() >= 2 && elements[1] == '|')
-        {
-            item.type = FilteredItem::InformationItem;
-            item.isActivatable = true;
-            item.url = Path(buildDir, currentFile).toUrl();
-            item.lineNo = elements[0].toInt() - 1;
-
-            /*
-             * We determine the column number from the line itself,
-             * as the first non-space character after the line number and '|'.
-             */
-            int idx = elements[0].size() + 3;
-            int length = line.size();
-
-            item.columnNo = 0;
-            for (int i = idx; i < length; ++i)
-            {
-                if (!line[i].isSpace())
-                {
-                    item.columnNo = i - idx;
-                    break;
-                }
-            }
-        }
-        else
-        {
-            item.type = FilteredItem::StandardItem;
+            this->packages << package;
         }
     }
-    currentItemType = item.type;
-    return item;
 }
 
-KDevelop::FilteredItem CargoFilterStrategy::actionInLine(const QString& line)
+void CargoBuildJob::start()
 {
-    return KDevelop::FilteredItem(line);
+    started = true;
+    if (command.isEmpty())
+    {
+        setError( NoCommand );
+        setErrorText( i18n( "No Cargo command specified" ) );
+        emitResult();
+    }
+    else if (!coordinator->acquire( targetDirectory, this, [this]() { directoryAcquired(); },
+                                    processEnvironment.value( QStringLiteral("CARGO_BUILD_JOBS") ).toInt() ))
+    {
+        emit infoMessage( this, i18n( "Waiting for another build in %1", targetDirectory ) );
+    }
 }
 
+void CargoBuildJob::directoryAcquired()
+{
+    if (!cacheStatsFile.isEmpty() && !sccacheProgram().isEmpty())
+    {
+        // The statistics of sccache are counters of its server, so they are read before cargo starts
+        sccacheBefore = new QProcess( this );
+        connect( sccacheBefore.data(), static_cast<void(QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+                 this, &CargoBuildJob::startCargo );
+        connect( sccacheBefore.data(), &QProcess::errorOccurred, this, [this]( QProcess::ProcessError error ) {
+            if (error == QProcess::FailedToStart)
+            {
+                startCargo();
+            }
+        });
+        sccacheBefore->start( sccacheProgram(), { QStringLiteral("--show-stats") } );
+    }
+    else
+    {
+        startCargo();
+    }
+}
 
-CargoBuildJob::CargoBuildJob( CargoPlugin* plugin, KDevelop::ProjectBaseItem* item, const QString& command )
-    : OutputJob( plugin )
-    , command( command)
-    , exec(nullptr)
-    , killed( false )
-    , enabled( false )
+void CargoBuildJob::startCargo()
 {
-    setCapabilities( Killable );
-    QString subgrpname;
-    projectName = item->project()->name();
-    builddir = plugin->buildDirectory( item ).toLocalFile();
+    if (killed)
+    {
+        return;
+    }
 
-    cmd = "cargo";
+    QStringList arguments;
+    arguments << command << configArguments;
+    if (!installPrefix.isEmpty())
+    {
+        arguments << QStringLiteral("--root") << installPrefix.toLocalFile();
+    }
 
-    QString title = i18nc("<command> <arguments>", "%1 %2", cmd, command);
-    setTitle(title);
-    setObjectName(title);
-    setDelegate( new KDevelop::OutputDelegate );
-    standardViewType = KDevelop::IOutputView::BuildView;
-}
+    for (const QString& package : qAsConst(packages))
+    {
+        arguments << QStringLiteral("-p") << package;
+    }
 
-void CargoBuildJob::start()
-{
-    if (command.isEmpty())
+    if (jsonMessages)
     {
-        setError( NoCommand );
-        setErrorText( i18n( "No Cargo command specified" ) );
-        emitResult();
+        arguments << QStringLiteral("--message-format=json");
     }
-    else
+
+    if (!runArguments.isEmpty())
     {
-        QStringList arguments;
-        arguments << command;
-        if (!installPrefix.isEmpty())
-        {
-            arguments << QStringLiteral("--root") << installPrefix.toLocalFile();
-        }
+        arguments << runArguments;
+    }
 
-        if (!runArguments.isEmpty())
-        {
-            arguments << runArguments;
-        }
+    if (!cacheStatsFile.isEmpty())
+    {
+        cacheStats.setSettings( CargoCacheStats::cacheSettings( arguments, processEnvironment ) );
+    }
 
+    // A jobserver set up by the user, for example when KDevelop runs under make, is left alone
+    const QString makeFlags = coordinator->makeFlags( this );
+    const bool useJobserver = !makeFlags.isEmpty() && !processEnvironment.contains( QStringLiteral("CARGO_MAKEFLAGS") );
+    if (useJobserver)
+    {
+        processEnvironment.insert( QStringLiteral("CARGO_MAKEFLAGS"), makeFlags );
+    }
+
+    QUrl buildUrl = QUrl::fromLocalFile(builddir);
+    exec = new CargoOutputWorker( buildUrl, cmd, arguments, builddir, processEnvironment, jsonMessages );
+    exec->setShowItems( !background );
+    if (useJobserver)
+    {
+        exec->setInheritedDescriptors( coordinator->descriptors( this ) );
+    }
+    thread = new QThread( this );
+    exec->moveToThread( thread );
+
+    connect( thread, &QThread::finished, exec, &QObject::deleteLater );
+    connect( exec, &CargoOutputWorker::messagesReady, this, &CargoBuildJob::procMessages );
+    connect( exec, &CargoOutputWorker::finished, this, &CargoBuildJob::procFinished );
+    connect( exec, &CargoOutputWorker::failed, this, &CargoBuildJob::procError );
+
+    if (!background)
+    {
         setStandardToolView( standardViewType );
         setBehaviours( KDevelop::IOutputView::AllowUserClose | KDevelop::IOutputView::AutoScroll );
-        QUrl buildUrl = QUrl::fromLocalFile(builddir);
-        KDevelop::OutputModel* model = new KDevelop::OutputModel(buildUrl);
-        model->setFilteringStrategy(new CargoFilterStrategy(buildUrl));
+        CargoOutputModel* model = new CargoOutputModel(buildUrl);
         setModel( model );
 
         startOutput();
 
-        exec = new KDevelop::CommandExecutor( cmd, this );
-
-        exec->setArguments( arguments );
-        exec->setWorkingDirectory( builddir );
-        
-        connect( exec, &CommandExecutor::completed, this, &CargoBuildJob::procFinished );
-        connect( exec, &CommandExecutor::failed, this, &CargoBuildJob::procError );
-
-        connect( exec, &CommandExecutor::receivedStandardError, model, &OutputModel::appendLines );
-        connect( exec, &CommandExecutor::receivedStandardOutput, model, &OutputModel::appendLines );
-
+        connect( exec, &CargoOutputWorker::itemsReady, model, &CargoOutputModel::appendItems );
         model->appendLine( QStringLiteral("%1> %2 %3").arg( builddir ).arg( cmd ).arg( KShell::joinArgs(arguments) ) );
-        exec->start();
     }
+
+    elapsed.start();
+    thread->start();
+    QMetaObject::invokeMethod( exec, "start", Qt::QueuedConnection );
 }
 
 bool CargoBuildJob::doKill()
 {
     killed = true;
-    exec->kill();
+    if (exec)
+    {
+        QMetaObject::invokeMethod( exec, "kill", Qt::QueuedConnection );
+    }
     return true;
 }
 
 void CargoBuildJob::procError( QProcess::ProcessError err )
 {
-    if( !killed ) {
-        if( err == QProcess::FailedToStart ) {
-            setError( FailedToStart );
-            setErrorText( i18n( "Failed to start command." ) );
-        } else if( err == QProcess::Crashed ) {
-            setError( Crashed );
-            setErrorText( i18n( "Command crashed." ) );
-        } else {
-            setError( UnknownExecError );
-            setErrorText( i18n( "Unknown error executing command." ) );
-        }
+    // A killed job has already finished when doKill() returned
+    if( killed ) {
+        return;
+    }
+
+    if( err == QProcess::FailedToStart ) {
+        setError( FailedToStart );
+        setErrorText( i18n( "Failed to start command." ) );
+    } else if( err == QProcess::Crashed ) {
+        setError( Crashed );
+        setErrorText( i18n( "Command crashed." ) );
+    } else {
+        setError( UnknownExecError );
+        setErrorText( i18n( "Unknown error executing command." ) );
     }
     emitResult();
 }
 
-KDevelop::OutputModel* CargoBuildJob::model()
+void CargoBuildJob::procMessages( const QVector<CargoMessage>& messages )
 {
-    return qobject_cast<KDevelop::OutputModel*>( OutputJob::model() );
+    for (const CargoMessage& message : messages)
+    {
+        if (!timingsDirectory.isEmpty())
+        {
+            timings.addMessage( message );
+        }
+        if (!cacheStatsFile.isEmpty())
+        {
+            cacheStats.addMessage( message );
+        }
+    }
+    emit messagesReceived( messages );
+}
+
+void CargoBuildJob::reportTimings()
+{
+    if (timingsDirectory.isEmpty() || !jsonMessages || killed || !model())
+    {
+        return;
+    }
+
+    timings.setTotalTime( elapsed.elapsed() );
+    const CargoBuildTimings previous = CargoBuildTimings::loadLatest( timingsDirectory );
+    for (const QString& line : timings.report( previous ))
+    {
+        model()->appendLine( line );
+    }
+
+    if (!timings.save( timingsDirectory ))
+    {
+        qCWarning(CUSTOMBUILDSYSTEM) << "Could not store build timings in" << timingsDirectory;
+    }
+}
+
+QString CargoBuildJob::sccacheProgram() const
+{
+    const QString wrapper = processEnvironment.value( QStringLiteral("RUSTC_WRAPPER") );
+    return QFileInfo( wrapper ).baseName() == QLatin1String("sccache") ? wrapper : QString();
+}
+
+void CargoBuildJob::reportCacheStats()
+{
+    if (cacheStatsFile.isEmpty() || !jsonMessages || killed || !model())
+    {
+        return;
+    }
+
+    /*
+     * The counters are global to the sccache server,
+     * so builds running at the same time are counted as well.
+     */
+    qint64 hitsBefore = 0, missesBefore = 0, hitsAfter = 0, missesAfter = 0;
+    if (sccacheBefore && sccacheAfter
+        && CargoCacheStats::parseSccacheStats( sccacheBefore->readAllStandardOutput(), &hitsBefore, &missesBefore )
+        && CargoCacheStats::parseSccacheStats( sccacheAfter->readAllStandardOutput(), &hitsAfter, &missesAfter ))
+    {
+        cacheStats.setCacheCounters( hitsAfter - hitsBefore, missesAfter - missesBefore );
+    }
+
+    for (const QString& line : cacheStats.finish( cacheStatsFile ))
+    {
+        model()->appendLine( line );
+    }
+}
+
+void CargoBuildJob::finishOutput( int exitCode )
+{
+    if (exitCode == 0)
+    {
+        reportTimings();
+        reportCacheStats();
+    }
+}
+
+CargoOutputModel* CargoBuildJob::model()
+{
+    return qobject_cast<CargoOutputModel*>( OutputJob::model() );
 }
 
 void CargoBuildJob::procFinished(int code)
 {
+    // See procError()
+    if( killed ) {
+        return;
+    }
+
     //TODO: Make this configurable when the first report comes in from a tool
     //      where non-zero does not indicate error status
     if( code != 0 ) {
         setError( FailedShownError );
-        model()->appendLine( i18n( "*** Failed ***" ) );
-    } else {
-        model()->appendLine( i18n( "*** Finished ***" ) );
+    }
+    exitCode = code;
+
+    // The statistics of sccache after the build are read without blocking, the job finishes once they arrive
+    if (code == 0 && sccacheBefore && jsonMessages && model())
+    {
+        sccacheAfter = new QProcess( this );
+        connect( sccacheAfter.data(), static_cast<void(QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+                 this, &CargoBuildJob::finish );
+        connect( sccacheAfter.data(), &QProcess::errorOccurred, this, [this]( QProcess::ProcessError error ) {
+            if (error == QProcess::FailedToStart)
+            {
+                finish();
+            }
+        });
+        sccacheAfter->start( sccacheProgram(), { QStringLiteral("--show-stats") } );
+        return;
+    }
+    finish();
+}
+
+void CargoBuildJob::finish()
+{
+    if (killed)
+    {
+        return;
+    }
+
+    finishOutput( exitCode );
+
+    if( model() ) {
+        model()->appendLine( exitCode != 0 ? i18n( "*** Failed ***" ) : i18n( "*** Finished ***" ) );
     }
     emitResult();
 }
 
+
+CargoMergedBuildJob::CargoMergedBuildJob( CargoBuildJob* job )
+    : KJob( job->parent() )
+    , job( job )
+    , buildDone( false )
+    , waiting( false )
+{
+    setObjectName( i18n( "Merged into %1", job->objectName() ) );
+    connect( job, &KJob::result, this, &CargoMergedBuildJob::buildFinished );
+}
+
+void CargoMergedBuildJob::start()
+{
+    waiting = true;
+    if (buildDone || !job)
+    {
+        QTimer::singleShot( 0, this, &CargoMergedBuildJob::finish );
+    }
+}
+
+void CargoMergedBuildJob::buildFinished( KJob* build )
+{
+    buildDone = true;
+    setError( build->error() );
+    setErrorText( build->errorText() );
+    if (waiting)
+    {
+        finish();
+    }
+}
+
+void CargoMergedBuildJob::finish()
+{
+    emitResult();
+}
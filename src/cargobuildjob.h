@@ -24,15 +24,23 @@
 #define CARGOBUILDJOB_H
 
 #include <outputview/outputjob.h>
+#include <QElapsedTimer>
+#include <QPointer>
 #include <QProcess>
 #include <QUrl>
 
+#include "cargobuildtimings.h"
+#include "cargocachestats.h"
+#include "cargomessage.h"
+
 class CargoPlugin;
+class CargoBuildCoordinator;
+class CargoOutputModel;
+class CargoOutputWorker;
+class QThread;
 namespace KDevelop
 {
 class ProjectBaseItem;
-class CommandExecutor;
-class OutputModel;
 class IProject;
 }
 
@@ -51,6 +59,7 @@ public:
     };
 
     CargoBuildJob( CargoPlugin*, KDevelop::ProjectBaseItem*, const QString& command );
+    ~CargoBuildJob() override;
     void start() override;
     bool doKill() override;
 
@@ -58,22 +67,130 @@ public:
     void setRunArguments(const QStringList &arguments) { this->runArguments = arguments; }
     void setStandardViewType(KDevelop::IOutputView::StandardToolView view) { this->standardViewType = view; }
 
+    /**
+     * Sets a variable in the environment of cargo, which otherwise is the one from CargoPlugin::cargoEnvironment().
+     */
+    void setEnvironmentVariable(const QString &name, const QString &value) { this->processEnvironment.insert(name, value); }
+
+    /**
+     * Runs cargo with --message-format=json and fills the output
+     * with diagnostics decoded from its JSON messages.
+     */
+    void setJsonMessages(bool jsonMessages) { this->jsonMessages = jsonMessages; }
+
+    /**
+     * Restricts the command to the given packages, passed to cargo with -p.
+     * An empty list, the default, lets cargo choose the packages.
+     */
+    void setPackages(const QStringList &packages) { this->packages = packages; }
+    QStringList selectedPackages() const { return packages; }
+
+    /**
+     * Merges the packages of another selection into this job, if it has not started yet.
+     * Adding an empty list means that cargo chooses the packages.
+     */
+    void addPackages(const QStringList &packages);
+
+    /**
+     * Collects the compile times of packages and appends a summary to the output when the job finishes.
+     * Each run is stored in @p directory and compared with the previous one.
+     *
+     * Timings are taken from the JSON messages, so they have to be enabled as well.
+     * An empty directory, the default, disables the timings.
+     */
+    void setTimingsDirectory(const QString &directory) { this->timingsDirectory = directory; }
+
+    /**
+     * Reports how much of the build was reused when the job finishes, from the JSON messages
+     * and, when RUSTC_WRAPPER is sccache, its statistics before and after the build.
+     * Each run is stored in @p fileName and compared with the previous one.
+     *
+     * An empty file name, the default, disables the report.
+     */
+    void setCacheStatsFile(const QString &fileName) { this->cacheStatsFile = fileName; }
+
+    /**
+     * Runs without an output view, for jobs whose results are only used through messagesReceived().
+     */
+    void setBackground(bool background) { this->background = background; }
+
+    bool isStarted() const { return started; }
+    KDevelop::IProject* project() const { return buildProject; }
+
+signals:
+    /**
+     * Emitted with the JSON messages read from cargo, in batches
+     */
+    void messagesReceived( const QVector<CargoMessage>& messages );
+
+protected:
+    CargoOutputModel* model();
+
+    /**
+     * Called when cargo exits, before the final line is added to the output and the result is emitted.
+     * Subclasses can add their own reports to the output here.
+     */
+    virtual void finishOutput( int exitCode );
+
 private slots:
+    void directoryAcquired();
+    void startCargo();
     void procFinished(int);
     void procError( QProcess::ProcessError );
+    void procMessages( const QVector<CargoMessage>& messages );
 private:
-    KDevelop::OutputModel* model();
+    void finish();
+    void reportTimings();
+    void reportCacheStats();
+    QString sccacheProgram() const;
     QString command;
-    QString projectName;
+    KDevelop::IProject* buildProject;
     QString cmd;
-    QString environment;
+    QStringList configArguments;
+    QProcessEnvironment processEnvironment;
     QString builddir;
+    QString targetDirectory;
+    CargoBuildCoordinator* coordinator;
     QUrl installPrefix;
     QStringList runArguments;
-    KDevelop::CommandExecutor* exec;
+    QStringList packages;
+    QString timingsDirectory;
+    CargoBuildTimings timings;
+    QString cacheStatsFile;
+    CargoCacheStats cacheStats;
+    QPointer<QProcess> sccacheBefore;
+    QPointer<QProcess> sccacheAfter;
+    int exitCode;
+    QElapsedTimer elapsed;
+    CargoOutputWorker* exec;
+    QThread* thread;
+    bool jsonMessages;
+    bool background;
     bool killed;
-    bool enabled;
+    bool started;
     KDevelop::IOutputView::StandardToolView standardViewType;
 };
 
+/**
+ * Stands in for a build that was merged into another CargoBuildJob.
+ *
+ * It finishes together with that job, with the same result.
+ */
+class CargoMergedBuildJob : public KJob
+{
+Q_OBJECT
+public:
+    explicit CargoMergedBuildJob( CargoBuildJob* job );
+    void start() override;
+
+private slots:
+    void buildFinished( KJob* job );
+    void finish();
+
+private:
+    QPointer<CargoBuildJob> job;
+    bool buildDone;
+    bool waiting;
+};
+
 #endif 
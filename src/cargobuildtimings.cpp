@@ -0,0 +1,357 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargobuildtimings.h"
+#include "cargomessage.h"
+
+#include <KLocalizedString>
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+#include <algorithm>
+
+/**
+ * A package on the critical path may start a little after its dependency finished,
+ * the time it takes cargo to print the status line.
+ */
+static const qint64 CriticalPathSlack = 100;
+
+/// Changes in duration smaller than this are not reported when comparing builds
+static const qint64 MinimalReportedChange = 500;
+
+static QString formatTime(qint64 milliseconds)
+{
+    return i18nc("duration in seconds", "%1 s", QString::number(milliseconds / 1000.0, 'f', 1));
+}
+
+void CargoBuildTimings::addMessage(const CargoMessage& message)
+{
+    if (message.reason == CargoMessage::UnitStarted)
+    {
+        freshPackages.remove(message.packageName);
+        if (!unitIndex.contains(message.packageName))
+        {
+            CargoUnitTiming unit;
+            unit.package = message.packageName;
+            unit.start = message.time;
+            unitIndex.insert(unit.package, unitList.size());
+            unitList << unit;
+        }
+    }
+    else if (message.reason == CargoMessage::CompilerArtifact)
+    {
+        const auto it = unitIndex.constFind(message.packageName);
+        if (it != unitIndex.constEnd())
+        {
+            unitList[*it].end = message.time;
+        }
+        else if (message.fresh)
+        {
+            freshPackages.insert(message.packageName);
+        }
+    }
+}
+
+bool CargoBuildTimings::isEmpty() const
+{
+    return units().isEmpty();
+}
+
+QVector<CargoUnitTiming> CargoBuildTimings::units() const
+{
+    QVector<CargoUnitTiming> ret;
+    ret.reserve(unitList.size());
+    for (const CargoUnitTiming& unit : unitList)
+    {
+        // Packages that failed to compile never produce an artifact
+        if (unit.start >= 0 && unit.end >= unit.start)
+        {
+            ret << unit;
+        }
+    }
+
+    std::sort(ret.begin(), ret.end(), [](const CargoUnitTiming& a, const CargoUnitTiming& b) {
+        return a.duration() > b.duration();
+    });
+    return ret;
+}
+
+double CargoBuildTimings::averageParallelism() const
+{
+    const QVector<double> slices = parallelism(1);
+    return slices.isEmpty() ? 0.0 : slices.first();
+}
+
+QVector<double> CargoBuildTimings::parallelism(int slices) const
+{
+    const QVector<CargoUnitTiming> compiled = units();
+    qint64 first = -1;
+    qint64 last = -1;
+    for (const CargoUnitTiming& unit : compiled)
+    {
+        first = (first < 0) ? unit.start : qMin(first, unit.start);
+        last = qMax(last, unit.end);
+    }
+
+    if (compiled.isEmpty() || last <= first || slices <= 0)
+    {
+        return {};
+    }
+
+    // The average number of packages in a slice is the time they spent in it, divided by its length
+    const double length = double(last - first) / slices;
+    QVector<double> busy(slices, 0.0);
+    for (const CargoUnitTiming& unit : compiled)
+    {
+        for (int i = 0; i < slices; ++i)
+        {
+            const double sliceStart = first + i * length;
+            const double sliceEnd = sliceStart + length;
+            const double overlap = qMin<double>(sliceEnd, unit.end) - qMax<double>(sliceStart, unit.start);
+            if (overlap > 0)
+            {
+                busy[i] += overlap;
+            }
+        }
+    }
+
+    for (double& value : busy)
+    {
+        value /= length;
+    }
+    return busy;
+}
+
+QVector<CargoUnitTiming> CargoBuildTimings::criticalPath() const
+{
+    const QVector<CargoUnitTiming> compiled = units();
+    if (compiled.isEmpty())
+    {
+        return {};
+    }
+
+    const auto finishedLast = [](const CargoUnitTiming& a, const CargoUnitTiming& b) {
+        return a.end < b.end;
+    };
+
+    QVector<CargoUnitTiming> path;
+    path << *std::max_element(compiled.begin(), compiled.end(), finishedLast);
+    while (true)
+    {
+        const CargoUnitTiming& current = path.last();
+        const CargoUnitTiming* previous = nullptr;
+        for (const CargoUnitTiming& unit : compiled)
+        {
+            if (unit.end <= current.start + CriticalPathSlack && unit.end < current.end
+                && (!previous || unit.end > previous->end))
+            {
+                previous = &unit;
+            }
+        }
+
+        if (!previous)
+        {
+            break;
+        }
+        path << *previous;
+    }
+
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+QStringList CargoBuildTimings::report(const CargoBuildTimings& previous) const
+{
+    const QVector<CargoUnitTiming> compiled = units();
+    QStringList lines;
+    lines << i18n("Build timings: %1 packages compiled and %2 up to date in %3",
+                  compiled.size(), freshUnits(), formatTime(totalTime));
+    if (compiled.isEmpty())
+    {
+        return lines;
+    }
+
+    QStringList slices;
+    for (double value : parallelism(10))
+    {
+        slices << QString::number(value, 'f', 1);
+    }
+    lines << i18n("Average parallelism %1, over time: %2",
+                  QString::number(averageParallelism(), 'f', 1), slices.join(QLatin1Char(' ')));
+
+    lines << i18n("Packages by compile time:");
+    for (const CargoUnitTiming& unit : compiled)
+    {
+        lines << QStringLiteral("  %1  %2").arg(formatTime(unit.duration()), 8).arg(unit.package);
+    }
+
+    const QVector<CargoUnitTiming> path = criticalPath();
+    QStringList names;
+    for (const CargoUnitTiming& unit : path)
+    {
+        names << unit.package;
+    }
+    lines << i18n("Critical path (approximate, %1): %2",
+                  formatTime(path.last().end - path.first().start), names.join(QStringLiteral(" -> ")));
+
+    if (previous.isEmpty())
+    {
+        return lines;
+    }
+
+    lines << i18n("Compared with the previous build: %1 instead of %2",
+                  formatTime(totalTime), formatTime(previous.totalTime));
+
+    QVector<QPair<qint64, QString>> changes;
+    for (const CargoUnitTiming& unit : compiled)
+    {
+        const auto it = previous.unitIndex.constFind(unit.package);
+        if (it == previous.unitIndex.constEnd())
+        {
+            continue;
+        }
+
+        const CargoUnitTiming& before = previous.unitList.at(*it);
+        if (before.end < before.start)
+        {
+            continue;
+        }
+
+        const qint64 change = unit.duration() - before.duration();
+        if (qAbs(change) >= MinimalReportedChange && qAbs(change) * 5 >= before.duration())
+        {
+            changes << qMakePair(change, QStringLiteral("  %1: %2 -> %3").arg(unit.package,
+                                 formatTime(before.duration()), formatTime(unit.duration())));
+        }
+    }
+
+    std::sort(changes.begin(), changes.end(), [](const QPair<qint64, QString>& a, const QPair<qint64, QString>& b) {
+        return qAbs(a.first) > qAbs(b.first);
+    });
+    for (const auto& change : qAsConst(changes))
+    {
+        lines << change.second;
+    }
+    return lines;
+}
+
+QJsonObject CargoBuildTimings::toJson() const
+{
+    QJsonArray units;
+    for (const CargoUnitTiming& unit : unitList)
+    {
+        units << QJsonObject{
+            { QStringLiteral("package"), unit.package },
+            { QStringLiteral("start"), unit.start },
+            { QStringLiteral("end"), unit.end }
+        };
+    }
+
+    QJsonArray fresh;
+    for (const QString& package : freshPackages)
+    {
+        fresh << package;
+    }
+
+    return QJsonObject{
+        { QStringLiteral("total"), totalTime },
+        { QStringLiteral("units"), units },
+        { QStringLiteral("fresh"), fresh }
+    };
+}
+
+CargoBuildTimings CargoBuildTimings::fromJson(const QJsonObject& object)
+{
+    CargoBuildTimings timings;
+    timings.totalTime = object.value(QStringLiteral("total")).toDouble();
+
+    const QJsonArray units = object.value(QStringLiteral("units")).toArray();
+    for (const QJsonValue& value : units)
+    {
+        const QJsonObject unitObject = value.toObject();
+        CargoUnitTiming unit;
+        unit.package = unitObject.value(QStringLiteral("package")).toString();
+        unit.start = unitObject.value(QStringLiteral("start")).toDouble(-1);
+        unit.end = unitObject.value(QStringLiteral("end")).toDouble(-1);
+        timings.unitIndex.insert(unit.package, timings.unitList.size());
+        timings.unitList << unit;
+    }
+
+    const QJsonArray fresh = object.value(QStringLiteral("fresh")).toArray();
+    for (const QJsonValue& value : fresh)
+    {
+        timings.freshPackages.insert(value.toString());
+    }
+    return timings;
+}
+
+bool CargoBuildTimings::save(const QString& directory) const
+{
+    QDir dir(directory);
+    if (!dir.mkpath(QStringLiteral(".")))
+    {
+        return false;
+    }
+
+    // The names sort in the order of the runs
+    const QString name = QDateTime::currentDateTimeUtc().toString(QStringLiteral("yyyyMMdd-HHmmsszzz")) + QLatin1String(".json");
+    QSaveFile file(dir.filePath(name));
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    file.write(QJsonDocument(toJson()).toJson(QJsonDocument::Compact));
+    if (!file.commit())
+    {
+        return false;
+    }
+
+    const QStringList runs = dir.entryList({ QStringLiteral("*.json") }, QDir::Files, QDir::Name);
+    for (int i = 0; i < runs.size() - MaxStoredRuns; ++i)
+    {
+        dir.remove(runs.at(i));
+    }
+    return true;
+}
+
+CargoBuildTimings CargoBuildTimings::loadLatest(const QString& directory)
+{
+    const QDir dir(directory);
+    const QStringList runs = dir.entryList({ QStringLiteral("*.json") }, QDir::Files, QDir::Name);
+    if (runs.isEmpty())
+    {
+        return CargoBuildTimings();
+    }
+
+    QFile file(dir.filePath(runs.last()));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return CargoBuildTimings();
+    }
+    return fromJson(QJsonDocument::fromJson(file.readAll()).object());
+}
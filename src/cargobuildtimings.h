@@ -0,0 +1,123 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOBUILDTIMINGS_H
+#define CARGOBUILDTIMINGS_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QJsonObject;
+struct CargoMessage;
+
+/**
+ * Time spent compiling a single package.
+ *
+ * Times are in milliseconds since the start of the build.
+ * A package starts with its "Compiling" status line, and ends with the last of its artifacts.
+ */
+struct CargoUnitTiming
+{
+    QString package;
+    qint64 start = -1;
+    qint64 end = -1;
+
+    qint64 duration() const { return end - start; }
+};
+
+/**
+ * Timings of a single build, collected from the messages of a build job.
+ *
+ * The stable output of cargo only says when a package starts compiling and when its artifacts are done,
+ * so the timings are per package, and the time spent in codegen is not known.
+ */
+class CargoBuildTimings
+{
+public:
+    /// Number of runs kept in the timings directory of a project
+    static const int MaxStoredRuns = 50;
+
+    void addMessage(const CargoMessage& message);
+    void setTotalTime(qint64 totalTime) { this->totalTime = totalTime; }
+
+    /**
+     * @return true if no package was compiled
+     */
+    bool isEmpty() const;
+
+    /**
+     * @return the packages that were compiled, the slowest first
+     */
+    QVector<CargoUnitTiming> units() const;
+
+    /**
+     * @return the number of packages that were up to date
+     */
+    int freshUnits() const { return freshPackages.size(); }
+
+    /**
+     * @return the names of the packages that were up to date
+     */
+    QSet<QString> freshPackageNames() const { return freshPackages; }
+
+    /**
+     * @return the average number of packages compiled at the same time,
+     * over the whole build or in each of @p slices equal parts of it
+     */
+    double averageParallelism() const;
+    QVector<double> parallelism(int slices) const;
+
+    /**
+     * Approximates the critical path by walking back from the package that finished last,
+     * each time to the package that finished last before the current one started.
+     */
+    QVector<CargoUnitTiming> criticalPath() const;
+
+    /**
+     * @return lines summarizing the build, compared with the @p previous one if it is not empty
+     */
+    QStringList report(const CargoBuildTimings& previous) const;
+
+    QJsonObject toJson() const;
+    static CargoBuildTimings fromJson(const QJsonObject& object);
+
+    /**
+     * Stores these timings as a new run in @p directory, removing the oldest runs over MaxStoredRuns.
+     */
+    bool save(const QString& directory) const;
+
+    /**
+     * @return the timings of the latest run stored in @p directory, or empty timings if there is none
+     */
+    static CargoBuildTimings loadLatest(const QString& directory);
+
+private:
+    QVector<CargoUnitTiming> unitList;
+    QHash<QString, int> unitIndex;
+    QSet<QString> freshPackages;
+    qint64 totalTime = 0;
+};
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargocachestats.h"
+#include "cargomessage.h"
+
+#include <KLocalizedString>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QSaveFile>
+
+/// Rebuilt packages listed in the summary, the rest are only counted
+static const int MaxListedPackages = 10;
+
+/**
+ * A build that compiles nearly everything after one that reused most of it
+ * suggests that something invalidated the fingerprints of all packages.
+ */
+static const double CacheBustingRatio = 0.9;
+
+static QString formatTime(qint64 milliseconds)
+{
+    return i18nc("duration in seconds", "%1 s", QString::number(milliseconds / 1000.0, 'f', 1));
+}
+
+static int percentage(qint64 part, qint64 total)
+{
+    return total > 0 ? qRound(100.0 * part / total) : 0;
+}
+
+QJsonObject CargoCacheRun::toJson() const
+{
+    QJsonObject settingsObject;
+    for (auto it = settings.constBegin(); it != settings.constEnd(); ++it)
+    {
+        settingsObject.insert(it.key(), it.value());
+    }
+
+    return QJsonObject{
+        { QStringLiteral("time"), time.toString(Qt::ISODate) },
+        { QStringLiteral("fresh"), freshUnits },
+        { QStringLiteral("compiled"), compiledUnits },
+        { QStringLiteral("rebuilt"), QJsonArray::fromStringList(rebuilt) },
+        { QStringLiteral("hits"), cacheHits },
+        { QStringLiteral("misses"), cacheMisses },
+        { QStringLiteral("saved"), savedTime },
+        { QStringLiteral("settings"), settingsObject }
+    };
+}
+
+CargoCacheRun CargoCacheRun::fromJson(const QJsonObject& object)
+{
+    CargoCacheRun run;
+    run.time = QDateTime::fromString(object.value(QStringLiteral("time")).toString(), Qt::ISODate);
+    run.freshUnits = object.value(QStringLiteral("fresh")).toInt();
+    run.compiledUnits = object.value(QStringLiteral("compiled")).toInt();
+    for (const QJsonValue& value : object.value(QStringLiteral("rebuilt")).toArray())
+    {
+        run.rebuilt << value.toString();
+    }
+    run.cacheHits = object.value(QStringLiteral("hits")).toDouble(-1);
+    run.cacheMisses = object.value(QStringLiteral("misses")).toDouble(-1);
+    run.savedTime = object.value(QStringLiteral("saved")).toDouble();
+
+    const QJsonObject settingsObject = object.value(QStringLiteral("settings")).toObject();
+    for (auto it = settingsObject.constBegin(); it != settingsObject.constEnd(); ++it)
+    {
+        run.settings.insert(it.key(), it.value().toString());
+    }
+    return run;
+}
+
+bool CargoCacheStats::parseSccacheStats(const QByteArray& output, qint64* hits, qint64* misses)
+{
+    // The totals are on lines like "Cache hits                          123", followed by per-language lines
+    static const QRegularExpression counter(QStringLiteral("^Cache (hits|misses)\\s+(\\d+)\\s*$"),
+                                            QRegularExpression::MultilineOption);
+
+    bool foundHits = false;
+    bool foundMisses = false;
+    auto it = counter.globalMatch(QString::fromUtf8(output));
+    while (it.hasNext())
+    {
+        const QRegularExpressionMatch match = it.next();
+        if (match.captured(1) == QLatin1String("hits"))
+        {
+            *hits = match.captured(2).toLongLong();
+            foundHits = true;
+        }
+        else
+        {
+            *misses = match.captured(2).toLongLong();
+            foundMisses = true;
+        }
+    }
+    return foundHits && foundMisses;
+}
+
+QMap<QString, QString> CargoCacheStats::cacheSettings(const QStringList& arguments, const QProcessEnvironment& environment)
+{
+    static const QStringList variables = {
+        QStringLiteral("RUSTFLAGS"),
+        QStringLiteral("CARGO_ENCODED_RUSTFLAGS"),
+        QStringLiteral("RUSTC"),
+        QStringLiteral("RUSTC_WRAPPER"),
+        QStringLiteral("CARGO_INCREMENTAL"),
+        QStringLiteral("CARGO_TARGET_DIR")
+    };
+
+    QMap<QString, QString> settings;
+    settings.insert(QStringLiteral("arguments"), arguments.join(QLatin1Char(' ')));
+
+    const QStringList keys = environment.keys();
+    for (const QString& key : keys)
+    {
+        if (variables.contains(key) || key.startsWith(QLatin1String("CARGO_PROFILE_"))
+            || key.startsWith(QLatin1String("CARGO_BUILD_")))
+        {
+            settings.insert(key, environment.value(key));
+        }
+    }
+    return settings;
+}
+
+void CargoCacheStats::setCacheCounters(qint64 hits, qint64 misses)
+{
+    run.cacheHits = hits;
+    run.cacheMisses = misses;
+}
+
+void CargoCacheStats::addMessage(const CargoMessage& message)
+{
+    timings.addMessage(message);
+}
+
+QStringList CargoCacheStats::finish(const QString& fileName)
+{
+    QJsonObject history;
+    QFile file(fileName);
+    if (file.open(QIODevice::ReadOnly))
+    {
+        history = QJsonDocument::fromJson(file.readAll()).object();
+        file.close();
+    }
+
+    QJsonArray runs = history.value(QStringLiteral("runs")).toArray();
+    QJsonObject durations = history.value(QStringLiteral("durations")).toObject();
+    const CargoCacheRun previous = runs.isEmpty() ? CargoCacheRun() : CargoCacheRun::fromJson(runs.last().toObject());
+
+    const QVector<CargoUnitTiming> compiled = timings.units();
+    run.time = QDateTime::currentDateTime();
+    run.freshUnits = timings.freshUnits();
+    run.compiledUnits = compiled.size();
+
+    for (const QString& package : timings.freshPackageNames())
+    {
+        run.savedTime += qint64(durations.value(package).toDouble());
+    }
+    for (const CargoUnitTiming& unit : compiled)
+    {
+        run.rebuilt << unit.package;
+        const qint64 slowest = qint64(durations.value(unit.package).toDouble());
+        if (unit.end < 0)
+        {
+            continue;
+        }
+        if (slowest > unit.duration())
+        {
+            run.savedTime += slowest - unit.duration();
+        }
+        else
+        {
+            durations.insert(unit.package, double(unit.duration()));
+        }
+    }
+
+    const int total = run.freshUnits + run.compiledUnits;
+    QStringList lines;
+    lines << i18n("Reuse: %1 of %2 packages up to date (%3%), %4 compiled",
+                  run.freshUnits, total, percentage(run.freshUnits, total), run.compiledUnits);
+    if (run.cacheHits >= 0)
+    {
+        lines << i18n("sccache: %1 hits, %2 misses (%3% hit rate)",
+                      run.cacheHits, run.cacheMisses, percentage(run.cacheHits, run.cacheHits + run.cacheMisses));
+    }
+    if (!run.rebuilt.isEmpty())
+    {
+        QStringList listed = run.rebuilt.mid(0, MaxListedPackages);
+        if (run.rebuilt.size() > MaxListedPackages)
+        {
+            listed << i18np("and %1 more", "and %1 more", run.rebuilt.size() - MaxListedPackages);
+        }
+        lines << i18n("Compiled: %1", listed.join(QStringLiteral(", ")));
+    }
+    if (run.savedTime > 0)
+    {
+        lines << i18n("Estimated time saved by reuse: %1", formatTime(run.savedTime));
+    }
+
+    if (!previous.settings.isEmpty())
+    {
+        QStringList changed;
+        QStringList keys = previous.settings.keys() + run.settings.keys();
+        keys.removeDuplicates();
+        keys.sort();
+        for (const QString& key : qAsConst(keys))
+        {
+            if (previous.settings.value(key) != run.settings.value(key))
+            {
+                changed << key;
+            }
+        }
+
+        const int previousTotal = previous.freshUnits + previous.compiledUnits;
+        const bool busted = total > 0 && previousTotal > 0
+            && run.compiledUnits >= CacheBustingRatio * total
+            && previous.freshUnits * 2 >= previousTotal;
+        if (busted && !changed.isEmpty())
+        {
+            lines << i18n("Almost everything was compiled again after changes to: %1", changed.join(QStringLiteral(", ")));
+        }
+        else if (busted)
+        {
+            lines << i18n("Almost everything was compiled again, although the arguments and environment did not change");
+        }
+        else if (!changed.isEmpty())
+        {
+            lines << i18n("Changed since the previous build: %1", changed.join(QStringLiteral(", ")));
+        }
+    }
+
+    runs.append(run.toJson());
+    while (runs.size() > MaxStoredRuns)
+    {
+        runs.removeFirst();
+    }
+    history.insert(QStringLiteral("runs"), runs);
+    history.insert(QStringLiteral("durations"), durations);
+
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile output(fileName);
+    if (output.open(QIODevice::WriteOnly))
+    {
+        output.write(QJsonDocument(history).toJson(QJsonDocument::Compact));
+        output.commit();
+    }
+    return lines;
+}
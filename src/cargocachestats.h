@@ -0,0 +1,101 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOCACHESTATS_H
+#define CARGOCACHESTATS_H
+
+#include <QDateTime>
+#include <QMap>
+#include <QProcessEnvironment>
+#include <QString>
+#include <QStringList>
+
+#include "cargobuildtimings.h"
+
+class QJsonObject;
+struct CargoMessage;
+
+/**
+ * How much of a single build was reused from earlier builds.
+ *
+ * Counts of the compiler cache are -1 when the build did not use sccache.
+ */
+struct CargoCacheRun
+{
+    QDateTime time;
+    int freshUnits = 0;
+    int compiledUnits = 0;
+    QStringList rebuilt;
+    qint64 cacheHits = -1;
+    qint64 cacheMisses = -1;
+    qint64 savedTime = 0;
+
+    /// Arguments and environment variables that decide whether cached units can be reused
+    QMap<QString, QString> settings;
+
+    QJsonObject toJson() const;
+    static CargoCacheRun fromJson(const QJsonObject& object);
+};
+
+/**
+ * Collects the reuse of a build from its messages and the counters of sccache,
+ * and compares it with the previous builds of the project.
+ *
+ * The time saved is estimated from the slowest recorded compile of each package:
+ * all of it for packages that were up to date, and the difference for packages
+ * that compiled faster, which is what a compiler cache hit looks like from the outside.
+ */
+class CargoCacheStats
+{
+public:
+    /// Number of runs kept in the history file
+    static const int MaxStoredRuns = 50;
+
+    /**
+     * Reads the total number of cache hits and misses from the output of sccache --show-stats.
+     *
+     * @return false if the output does not contain them
+     */
+    static bool parseSccacheStats(const QByteArray& output, qint64* hits, qint64* misses);
+
+    /**
+     * @return the values of the arguments and the variables of @p environment that cargo includes in its fingerprints
+     */
+    static QMap<QString, QString> cacheSettings(const QStringList& arguments, const QProcessEnvironment& environment);
+
+    void setSettings(const QMap<QString, QString>& settings) { run.settings = settings; }
+    void setCacheCounters(qint64 hits, qint64 misses);
+    void addMessage(const CargoMessage& message);
+
+    /**
+     * Completes the run and stores it in the history file @p fileName.
+     *
+     * @return lines summarizing the run, compared with the previous one
+     */
+    QStringList finish(const QString& fileName);
+
+private:
+    CargoBuildTimings timings;
+    CargoCacheRun run;
+};
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargoconfigpage.h"
+#include "cargoplugin.h"
+
+#include <KConfigGroup>
+#include <KLocalizedString>
+
+#include <interfaces/iproject.h>
+
+CargoConfigPage::CargoConfigPage( CargoPlugin* plugin, KDevelop::IProject* project, QWidget* parent )
+    : ConfigPage( plugin, nullptr, parent )
+    , plugin( plugin )
+    , project( project )
+{
+    setupUi( this );
+    targetDirectory->setMode( KFile::Directory | KFile::LocalOnly );
+    targetDirectory->setStartDir( project->path().toUrl() );
+
+    connect( targetDirectory, &KUrlRequester::textChanged, this, &CargoConfigPage::changed );
+    connect( rustcWrapper, &QComboBox::editTextChanged, this, &CargoConfigPage::changed );
+    connect( linker, &QComboBox::editTextChanged, this, &CargoConfigPage::changed );
+    connect( jobs, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &CargoConfigPage::changed );
+    connect( collectTimings, &QCheckBox::toggled, this, &CargoConfigPage::changed );
+    connect( cacheStats, &QCheckBox::toggled, this, &CargoConfigPage::changed );
+    connect( checkOnSave, &QCheckBox::toggled, this, &CargoConfigPage::changed );
+    connect( discoverTests, &QCheckBox::toggled, this, &CargoConfigPage::changed );
+    connect( testShards, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &CargoConfigPage::changed );
+
+    reset();
+}
+
+QString CargoConfigPage::name() const
+{
+    return i18n( "Cargo" );
+}
+
+QString CargoConfigPage::fullName() const
+{
+    return i18n( "Configure Cargo Settings" );
+}
+
+QIcon CargoConfigPage::icon() const
+{
+    return QIcon::fromTheme( QStringLiteral("cargo") );
+}
+
+void CargoConfigPage::apply()
+{
+    KConfigGroup group = project->projectConfiguration()->group( "Cargo" );
+    group.writeEntry( "TargetDirectory", targetDirectory->text().trimmed() );
+    group.writeEntry( "RustcWrapper", rustcWrapper->currentText().trimmed() );
+    group.writeEntry( "Linker", linker->currentText().trimmed() );
+    group.writeEntry( "Jobs", jobs->value() );
+    group.writeEntry( "CollectTimings", collectTimings->isChecked() );
+    group.writeEntry( "CacheStats", cacheStats->isChecked() );
+    group.writeEntry( "CheckOnSave", checkOnSave->isChecked() );
+    group.writeEntry( "DiscoverTests", discoverTests->isChecked() );
+    group.writeEntry( "TestShards", testShards->value() );
+    group.sync();
+
+    plugin->settingsChanged( project );
+}
+
+void CargoConfigPage::reset()
+{
+    const KConfigGroup group = project->projectConfiguration()->group( "Cargo" );
+    targetDirectory->setText( group.readEntry( "TargetDirectory", QString() ) );
+    rustcWrapper->setEditText( group.readEntry( "RustcWrapper", QString() ) );
+    linker->setEditText( group.readEntry( "Linker", QString() ) );
+    jobs->setValue( group.readEntry( "Jobs", 0 ) );
+    collectTimings->setChecked( group.readEntry( "CollectTimings", false ) );
+    cacheStats->setChecked( group.readEntry( "CacheStats", false ) );
+    checkOnSave->setChecked( group.readEntry( "CheckOnSave", true ) );
+    discoverTests->setChecked( group.readEntry( "DiscoverTests", true ) );
+    testShards->setValue( group.readEntry( "TestShards", 1 ) );
+}
+
+void CargoConfigPage::defaults()
+{
+    targetDirectory->clear();
+    rustcWrapper->setEditText( QString() );
+    linker->setEditText( QString() );
+    jobs->setValue( 0 );
+    collectTimings->setChecked( false );
+    cacheStats->setChecked( false );
+    checkOnSave->setChecked( true );
+    discoverTests->setChecked( true );
+    testShards->setValue( 1 );
+}
@@ -0,0 +1,211 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargodiagnosticsindex.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+
+namespace
+{
+
+enum RecordField {
+    PackageField,
+    FileNameField,
+    TextField,
+    RenderedField,
+    CodeField,
+    LineField,
+    ColumnField,
+    LineEndField,
+    ColumnEndField,
+    SeverityField,
+    FieldCount
+};
+
+// The header contains the magic, version, number of records and size of the string table
+const int HeaderSize = 4 * sizeof(quint32);
+const int RecordSize = FieldCount * sizeof(quint32);
+
+void writeNumber(uchar* data, int index, quint32 value)
+{
+    qToLittleEndian<quint32>(value, data + index * sizeof(quint32));
+}
+
+quint32 readNumber(const uchar* data, int index)
+{
+    return qFromLittleEndian<quint32>(data + index * sizeof(quint32));
+}
+
+/**
+ * Builds the string table, storing each distinct string once.
+ */
+class StringTable
+{
+public:
+    StringTable()
+    {
+        // Offset 0 is the empty string
+        table.append('\0');
+        offsets.insert(QString(), 0);
+    }
+
+    quint32 add(const QString& string)
+    {
+        auto it = offsets.constFind(string);
+        if (it != offsets.constEnd())
+        {
+            return *it;
+        }
+
+        const quint32 offset = table.size();
+        table.append(string.toUtf8());
+        table.append('\0');
+        offsets.insert(string, offset);
+        return offset;
+    }
+
+    QByteArray table;
+
+private:
+    QHash<QString, quint32> offsets;
+};
+
+}
+
+QVector<CargoDiagnostic> CargoDiagnosticsIndex::allDiagnostics() const
+{
+    QVector<CargoDiagnostic> ret;
+    for (const QVector<CargoDiagnostic>& package : diagnostics)
+    {
+        ret << package;
+    }
+    return ret;
+}
+
+bool CargoDiagnosticsIndex::load(const QString& fileName)
+{
+    diagnostics.clear();
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < HeaderSize)
+    {
+        return false;
+    }
+
+    const uchar* data = file.map(0, file.size());
+    if (!data)
+    {
+        return false;
+    }
+
+    const quint32 count = readNumber(data, 2);
+    const quint32 tableSize = readNumber(data, 3);
+    if (readNumber(data, 0) != IndexMagic || readNumber(data, 1) != IndexVersion
+        || tableSize == 0 || file.size() != HeaderSize + qint64(count) * RecordSize + tableSize)
+    {
+        return false;
+    }
+
+    const char* table = reinterpret_cast<const char*>(data + HeaderSize + count * RecordSize);
+    if (table[tableSize - 1] != '\0')
+    {
+        return false;
+    }
+
+    // Decoding each string once lets the diagnostics share them
+    QHash<quint32, QString> strings;
+    const auto string = [&](quint32 offset) -> QString {
+        if (offset >= tableSize)
+        {
+            return QString();
+        }
+        auto it = strings.find(offset);
+        if (it == strings.end())
+        {
+            it = strings.insert(offset, QString::fromUtf8(table + offset));
+        }
+        return *it;
+    };
+
+    for (quint32 i = 0; i < count; ++i)
+    {
+        const uchar* record = data + HeaderSize + i * RecordSize;
+
+        CargoDiagnostic diagnostic;
+        diagnostic.package = string(readNumber(record, PackageField));
+        diagnostic.fileName = string(readNumber(record, FileNameField));
+        diagnostic.text = string(readNumber(record, TextField));
+        diagnostic.rendered = string(readNumber(record, RenderedField));
+        diagnostic.code = string(readNumber(record, CodeField));
+        diagnostic.line = readNumber(record, LineField);
+        diagnostic.column = readNumber(record, ColumnField);
+        diagnostic.lineEnd = readNumber(record, LineEndField);
+        diagnostic.columnEnd = readNumber(record, ColumnEndField);
+        diagnostic.severity = static_cast<CargoDiagnostic::Severity>(qMin<quint32>(readNumber(record, SeverityField), CargoDiagnostic::Hint));
+        addDiagnostic(diagnostic);
+    }
+    return true;
+}
+
+bool CargoDiagnosticsIndex::save(const QString& fileName) const
+{
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+    const QVector<CargoDiagnostic> all = allDiagnostics();
+    QByteArray records(HeaderSize + all.size() * RecordSize, '\0');
+    uchar* data = reinterpret_cast<uchar*>(records.data());
+
+    StringTable strings;
+    for (int i = 0; i < all.size(); ++i)
+    {
+        const CargoDiagnostic& diagnostic = all.at(i);
+        uchar* record = data + HeaderSize + i * RecordSize;
+        writeNumber(record, PackageField, strings.add(diagnostic.package));
+        writeNumber(record, FileNameField, strings.add(diagnostic.fileName));
+        writeNumber(record, TextField, strings.add(diagnostic.text));
+        writeNumber(record, RenderedField, strings.add(diagnostic.rendered));
+        writeNumber(record, CodeField, strings.add(diagnostic.code));
+        writeNumber(record, LineField, diagnostic.line);
+        writeNumber(record, ColumnField, diagnostic.column);
+        writeNumber(record, LineEndField, diagnostic.lineEnd);
+        writeNumber(record, ColumnEndField, diagnostic.columnEnd);
+        writeNumber(record, SeverityField, diagnostic.severity);
+    }
+
+    writeNumber(data, 0, IndexMagic);
+    writeNumber(data, 1, IndexVersion);
+    writeNumber(data, 2, all.size());
+    writeNumber(data, 3, strings.table.size());
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    file.write(records);
+    file.write(strings.table);
+    return file.commit();
+}
@@ -0,0 +1,89 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGODIAGNOSTICSINDEX_H
+#define CARGODIAGNOSTICSINDEX_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+/**
+ * A compiler diagnostic with a source location, as kept between sessions.
+ *
+ * The file name is absolute, line and column numbers count from 1, as cargo reports them.
+ */
+struct CargoDiagnostic
+{
+    enum Severity {
+        Error,
+        Warning,
+        Hint
+    };
+
+    QString package;
+    QString fileName;
+    QString text;
+    QString rendered;
+    QString code;
+    int line = 0;
+    int column = 0;
+    int lineEnd = 0;
+    int columnEnd = 0;
+    Severity severity = Error;
+};
+
+/**
+ * The last known diagnostics of each package in a workspace.
+ *
+ * The index is stored in a compact binary file that can be read back without parsing:
+ * a header, an array of fixed-size records, one per diagnostic,
+ * and a table of zero-terminated UTF-8 strings that the records refer to by offset.
+ * Strings that repeat, such as file and package names, are only stored once.
+ */
+class CargoDiagnosticsIndex
+{
+public:
+    static const quint32 IndexMagic = 0x43444958;
+    static const quint32 IndexVersion = 1;
+
+    /**
+     * Removes the diagnostics of @p package, before new ones are added
+     */
+    void clearPackage(const QString& package) { diagnostics.remove(package); }
+    void addDiagnostic(const CargoDiagnostic& diagnostic) { diagnostics[diagnostic.package] << diagnostic; }
+
+    bool isEmpty() const { return diagnostics.isEmpty(); }
+    QVector<CargoDiagnostic> allDiagnostics() const;
+
+    /**
+     * Replaces the contents of this index with the file written by save().
+     * If the file does not exist or is not valid, the index is left empty.
+     */
+    bool load(const QString& fileName);
+    bool save(const QString& fileName) const;
+
+private:
+    QHash<QString, QVector<CargoDiagnostic>> diagnostics;
+};
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargoexecjob.h"
+#include "cargoplugin.h"
+
+#include <KConfigGroup>
+#include <KLocalizedString>
+
+#include <interfaces/ilaunchconfiguration.h>
+
+using namespace KDevelop;
+
+CargoExecJob::CargoExecJob( CargoPlugin* plugin, ILaunchConfiguration* config )
+    : OutputExecuteJob( nullptr, OutputJob::Verbose )
+    , plugin( plugin )
+    , config( config )
+{
+    setCapabilities( Killable );
+    setStandardToolView( IOutputView::RunView );
+    setBehaviours( IOutputView::AllowUserClose | IOutputView::AutoScroll );
+    setProperties( DisplayStdout | DisplayStderr );
+    setJobName( config->name() );
+    setWorkingDirectory( plugin->workingDirectory( config ) );
+#if KDEVPLATFORM_VERSION >= VERSION_5_2
+    setEnvironmentProfile( plugin->environmentProfileName( config ) );
+#else
+    setEnvironmentProfile( plugin->environmentGroup( config ) );
+#endif
+}
+
+void CargoExecJob::start()
+{
+    const QString executable = plugin->launchExecutable( config );
+    if (executable.isEmpty())
+    {
+        setError( NoExecutable );
+        setErrorText( i18n( "Could not determine the executable of %1. "
+                            "Set the executable name if the project has more than one.", config->name() ) );
+        emitResult();
+        return;
+    }
+
+    QString error;
+    *this << executable << plugin->arguments( config, error );
+    OutputExecuteJob::start();
+}
@@ -22,6 +22,9 @@
 
 #include "cargoexecutionconfig.h"
 #include "cargobuildjob.h"
+#include "cargobenchjob.h"
+#include "cargoexecjob.h"
+#include "cargoprofilejob.h"
 #include "cargoplugin.h"
 
 #include <KLocalizedString>
@@ -33,15 +36,17 @@
 #include <interfaces/iruncontroller.h>
 #include <project/projectmodel.h>
 #include <project/builderjob.h>
-#include <serialization/indexedstring.h>
 #include <util/kdevstringhandler.h>
 #include <util/executecompositejob.h>
+#include <util/environmentselectionwidget.h>
 #include <util/path.h>
 
 #include <KMessageBox>
+#include <KShell>
 #include <KParts/MainWindow>
 #include <KConfigGroup>
 #include <QMenu>
+#include <QCheckBox>
 #include <QLineEdit>
 #include <QDebug>
 class la;
@@ -70,7 +75,14 @@ CargoExecutionConfig::CargoExecutionConfig( QWidget* parent )
     : LaunchConfigurationPage( parent )
 {
     setupUi(this);
+    profile->lineEdit()->setPlaceholderText(i18n("Default for the command"));
     connect( identifier->lineEdit(), &QLineEdit::textEdited, this, &CargoExecutionConfig::changed );
+    connect( arguments, &QLineEdit::textEdited, this, &CargoExecutionConfig::changed );
+    connect( profile->lineEdit(), &QLineEdit::textChanged, this, &CargoExecutionConfig::changed );
+    connect( features, &QLineEdit::textEdited, this, &CargoExecutionConfig::changed );
+    connect( noDefaultFeatures, &QCheckBox::toggled, this, &CargoExecutionConfig::changed );
+    connect( targetTriple, &QLineEdit::textEdited, this, &CargoExecutionConfig::changed );
+    connect( environment, &KDevelop::EnvironmentSelectionWidget::currentProfileChanged, this, &CargoExecutionConfig::changed );
 }
 
 void CargoExecutionConfig::saveToConfiguration( KConfigGroup cfg, KDevelop::IProject* project ) const
@@ -78,13 +90,40 @@ void CargoExecutionConfig::saveToConfiguration( KConfigGroup cfg, KDevelop::IPro
     Q_UNUSED( project );
     cfg.writeEntry("CargoIdentifier", identifier->lineEdit()->text());
     cfg.writeEntry("CargoArguments", arguments->text());
+    cfg.writeEntry("CargoProfile", profile->lineEdit()->text().trimmed());
+    cfg.writeEntry("CargoFeatures", features->text());
+    cfg.writeEntry("CargoNoDefaultFeatures", noDefaultFeatures->isChecked());
+    cfg.writeEntry("CargoTargetTriple", targetTriple->text().trimmed());
+    cfg.writeEntry("EnvironmentGroup", environment->currentProfile());
 }
 
-void CargoExecutionConfig::loadFromConfiguration(const KConfigGroup& cfg, KDevelop::IProject* )
+void CargoExecutionConfig::loadFromConfiguration(const KConfigGroup& cfg, KDevelop::IProject* project )
 {
     bool b = blockSignals( true );
     identifier->lineEdit()->setText(cfg.readEntry("CargoIdentifier", ""));
     arguments->setText(cfg.readEntry("CargoArguments", ""));
+
+    // The profiles, including custom ones, are offered when the metadata is known
+    profile->clear();
+    CargoPlugin* plugin = project ? dynamic_cast<CargoPlugin*>(project->buildSystemManager()) : nullptr;
+    if (const CargoMetadata* metadata = plugin ? plugin->metadata(project) : nullptr)
+    {
+        profile->addItems(metadata->profiles());
+
+        QStringList available;
+        for (const CargoPackage& package : metadata->packages)
+        {
+            available << package.features;
+        }
+        available.removeDuplicates();
+        available.sort();
+        features->setToolTip(available.isEmpty() ? QString() : i18n("Available features: %1", available.join(QStringLiteral(", "))));
+    }
+    profile->lineEdit()->setText(cfg.readEntry("CargoProfile", ""));
+    features->setText(cfg.readEntry("CargoFeatures", ""));
+    noDefaultFeatures->setChecked(cfg.readEntry("CargoNoDefaultFeatures", false));
+    targetTriple->setText(cfg.readEntry("CargoTargetTriple", ""));
+    environment->setCurrentProfile(cfg.readEntry("EnvironmentGroup", QString()));
     blockSignals( b );
 }
 
@@ -128,19 +167,68 @@ KJob* CargoLauncher::start(const QString& launchMode, KDevelop::ILaunchConfigura
 
     if( launchMode == "execute" )
     {
-        CargoBuildJob* job = new CargoBuildJob(m_plugin, cfg->project()->projectItem(), QStringLiteral("run"));
-        job->setStandardViewType(KDevelop::IOutputView::RunView);
+        // The arguments are checked here, so the launch does not start with a build that could never run
+        QString err;
+        m_plugin->profileArguments(cfg, err);
+        if (!err.isEmpty())
+        {
+            KMessageBox::error(KDevelop::ICore::self()->uiController()->activeMainWindow(), err);
+            return nullptr;
+        }
+
+        QList<KJob*> jobs;
+        if (KJob* build = m_plugin->dependencyJob(cfg))
+        {
+            jobs << build;
+        }
+        jobs << new CargoExecJob(m_plugin, cfg);
+        return new KDevelop::ExecuteCompositeJob(KDevelop::ICore::self()->runController(), jobs);
+    }
+    else if( launchMode == CargoBenchLaunchMode::modeId() )
+    {
+        CargoBenchJob* job = new CargoBenchJob(m_plugin, cfg->project()->projectItem());
         job->setTitle(cfg->name());
 
-        QString err;
-        QStringList runArguments = m_plugin->arguments(cfg, err);
-        runArguments.takeFirst();
-        job->setRunArguments(runArguments);
+        // Only a bench target is run on its own, other identifiers are for cargo run
+        const KConfigGroup group = cfg->config();
+        const QString identifier = group.readEntry("CargoIdentifier", "");
+        QStringList benchArguments;
+        if (const CargoMetadata* metadata = m_plugin->metadata(cfg->project()))
+        {
+            for (const CargoPackage& package : metadata->packages)
+            {
+                for (const CargoTarget& target : package.targets)
+                {
+                    if (target.isBench() && target.name == identifier)
+                    {
+                        benchArguments << QStringLiteral("--bench") << identifier;
+                    }
+                }
+            }
+        }
 
-        qWarning() << "Running build job with arguments" << runArguments;
+        QString err;
+        benchArguments << m_plugin->profileArguments(cfg, err);
+        if (!err.isEmpty())
+        {
+            delete job;
+            KMessageBox::error(KDevelop::ICore::self()->uiController()->activeMainWindow(), err);
+            return nullptr;
+        }
 
+        const QStringList filter = KShell::splitArgs(group.readEntry("CargoArguments", ""));
+        if (!filter.isEmpty())
+        {
+            benchArguments << QStringLiteral("--") << filter;
+        }
+        job->setRunArguments(benchArguments);
         return job;
     }
+    else if( launchMode == "profile" )
+    {
+        // The profile mode itself is provided by KDevelop
+        return new CargoProfileJob(m_plugin, cfg);
+    }
     qWarning() << "Unknown launch mode " << launchMode << "for config:" << cfg->name();
     return nullptr;
 }
@@ -159,7 +247,22 @@ KJob* CargoLauncher::dependencies(KDevelop::ILaunchConfiguration* cfg)
 
 QStringList CargoLauncher::supportedModes() const
 {
-    return QStringList() << "execute";
+    return QStringList() << "execute" << CargoBenchLaunchMode::modeId() << "profile";
+}
+
+QString CargoBenchLaunchMode::modeId()
+{
+    return "bench";
+}
+
+QIcon CargoBenchLaunchMode::icon() const
+{
+    return QIcon::fromTheme("chronometer");
+}
+
+QString CargoBenchLaunchMode::name() const
+{
+    return i18n("Benchmark");
 }
 
 KDevelop::LaunchConfigurationPage* CargoPageFactory::createWidget(QWidget* parent)
@@ -170,7 +273,8 @@ KDevelop::LaunchConfigurationPage* CargoPageFactory::createWidget(QWidget* paren
 CargoPageFactory::CargoPageFactory()
 {}
 
-CargoExecutionConfigType::CargoExecutionConfigType()
+CargoExecutionConfigType::CargoExecutionConfigType( CargoPlugin* plugin )
+    : m_plugin( plugin )
 {
     factoryList.append( new CargoPageFactory );
 }
@@ -201,61 +305,94 @@ QIcon CargoExecutionConfigType::icon() const
     return QIcon::fromTheme("cargo");
 }
 
-static bool canLaunchMetadataFile(const KDevelop::Path &path)
-{
-    KConfig cfg(path.toLocalFile(), KConfig::SimpleConfig);
-    KConfigGroup group(&cfg, "Desktop Entry");
-    QStringList services = group.readEntry("ServiceTypes", group.readEntry("X-KDE-ServiceTypes", QStringList()));
-    return services.contains("Plasma/Applet");
-}
-
 //don't bother, nobody uses this interface
 bool CargoExecutionConfigType::canLaunch(const QUrl& ) const
 {
     return false;
 }
 
-bool CargoExecutionConfigType::canLaunch(KDevelop::ProjectBaseItem* item) const
+/*
+ * The context menu asks for every selected item, so this is a lookup
+ * in the index of crate roots, not a search through the targets.
+ */
+const CargoTarget* CargoExecutionConfigType::targetForItem(KDevelop::ProjectBaseItem* item) const
 {
-    KDevelop::ProjectFolderItem* folder = item->folder();
-    if(folder && folder->hasFileOrFolder("metadata.desktop")) {
-        return canLaunchMetadataFile(KDevelop::Path(folder->path(), "metadata.desktop"));
+    if (const CargoTargetItem* targetItem = dynamic_cast<const CargoTargetItem*>(item)) {
+        return &targetItem->target();
     }
-    return false;
+
+    const CargoMetadata* metadata = m_plugin->metadata(item->project());
+    if (!metadata) {
+        return nullptr;
+    }
+
+    // Targets in a directory of their own, such as src/bin/tool/main.rs, can be launched from the directory
+    if (item->folder()) {
+        return metadata->targetForSource(KDevelop::Path(item->path(), QStringLiteral("main.rs")));
+    }
+    return metadata->targetForSource(item->path());
+}
+
+bool CargoExecutionConfigType::canLaunch(KDevelop::ProjectBaseItem* item) const
+{
+    const CargoTarget* target = targetForItem(item);
+    return target && (target->isBinary() || target->isExample() || target->isBench() || target->isTest());
 }
 
 void CargoExecutionConfigType::configureLaunchFromItem(KConfigGroup config, KDevelop::ProjectBaseItem* item) const
 {
-    config.writeEntry("CargoIdentifier", item->path().toUrl().toLocalFile());
+    if (const CargoTarget* target = targetForItem(item)) {
+        config.writeEntry("CargoIdentifier", target->name);
+    }
 }
 
 void CargoExecutionConfigType::configureLaunchFromCmdLineArguments(KConfigGroup /*config*/, const QStringList &/*args*/) const
 {}
 
+/*
+ * Suggestions come from the targets in the metadata, which is already in memory,
+ * so opening the menu does not depend on the number of files in the projects.
+ */
 QMenu* CargoExecutionConfigType::launcherSuggestions()
 {
-    QList<QAction*> found;
-    QList<KDevelop::IProject*> projects = KDevelop::ICore::self()->projectController()->projects();
-    foreach(KDevelop::IProject* p, projects) {
-        QSet<KDevelop::IndexedString> files = p->fileSet();
-        foreach(const KDevelop::IndexedString& file, files) {
-            KDevelop::Path path(file.str());
-            if (path.lastPathSegment() == "metadata.desktop" && canLaunchMetadataFile(path)) {
-                path = path.parent();
-                QString relUrl = p->path().relativePath(path);
-                QAction* action = new QAction(relUrl, this);
-                action->setProperty("url", relUrl);
-                action->setProperty("project", qVariantFromValue<KDevelop::IProject*>(p));
-                connect(action, &QAction::triggered, this, &CargoExecutionConfigType::suggestionTriggered);
-                found.append(action);
+    QList<QMenu*> projectMenus;
+    const QList<KDevelop::IProject*> projects = KDevelop::ICore::self()->projectController()->projects();
+    for (KDevelop::IProject* p : projects) {
+        const CargoMetadata* metadata = m_plugin->metadata(p);
+        if (!metadata || metadata->launchTargets().isEmpty()) {
+            continue;
+        }
+
+        QMenu* projectMenu = new QMenu(p->name());
+        for (const CargoTarget& target : metadata->launchTargets()) {
+            QString text = target.name;
+            if (target.isExample()) {
+                text = i18nc("launch suggestion for an example", "%1 (example)", target.name);
+            } else if (target.isBench()) {
+                text = i18nc("launch suggestion for a benchmark", "%1 (benchmark)", target.name);
             }
+
+            QAction* action = projectMenu->addAction(text);
+            action->setProperty("identifier", target.name);
+            action->setProperty("bench", target.isBench());
+            action->setProperty("project", qVariantFromValue<KDevelop::IProject*>(p));
+            connect(action, &QAction::triggered, this, &CargoExecutionConfigType::suggestionTriggered);
         }
+        projectMenus << projectMenu;
+    }
+
+    if (projectMenus.isEmpty()) {
+        return nullptr;
+    }
+    if (projectMenus.size() == 1) {
+        projectMenus.first()->setTitle(i18n("Cargo"));
+        return projectMenus.first();
     }
 
-    QMenu *m = nullptr;
-    if(!found.isEmpty()) {
-        m = new QMenu(i18n("Cargos"));
-        m->addActions(found);
+    QMenu* m = new QMenu(i18n("Cargo"));
+    for (QMenu* projectMenu : projectMenus) {
+        projectMenu->setParent(m, projectMenu->windowFlags());
+        m->addMenu(projectMenu);
     }
     return m;
 }
@@ -264,14 +401,15 @@ void CargoExecutionConfigType::suggestionTriggered()
 {
     QAction* action = qobject_cast<QAction*>(sender());
     KDevelop::IProject* p = action->property("project").value<KDevelop::IProject*>();
-    QString relUrl = action->property("url").toString();
+    const QString identifier = action->property("identifier").toString();
 
+    // Benches only make sense in the benchmark mode
     KDevelop::ILauncher* launcherInstance = launchers().at( 0 );
-    QPair<QString,QString> launcher = qMakePair( launcherInstance->supportedModes().at(0), launcherInstance->id() );
+    const QString mode = action->property("bench").toBool() ? CargoBenchLaunchMode::modeId() : launcherInstance->supportedModes().at(0);
+    QPair<QString,QString> launcher = qMakePair( mode, launcherInstance->id() );
 
-    QString name = relUrl.mid(relUrl.lastIndexOf('/')+1);
-    KDevelop::ILaunchConfiguration* config = KDevelop::ICore::self()->runController()->createLaunchConfiguration(this, launcher, p, name);
+    KDevelop::ILaunchConfiguration* config = KDevelop::ICore::self()->runController()->createLaunchConfiguration(this, launcher, p, identifier);
     KConfigGroup cfg = config->config();
-    cfg.writeEntry("CargoIdentifier", relUrl);
+    cfg.writeEntry("CargoIdentifier", identifier);
     emit signalAddLaunchConfiguration(config);
 }
@@ -31,6 +31,7 @@
 #include "ui_cargoexecutionconfig.h"
 
 class CargoPlugin;
+struct CargoTarget;
 
 class CargoExecutionConfig : public KDevelop::LaunchConfigurationPage, Ui::CargoExecutionPage
 {
@@ -60,6 +61,18 @@ private:
     CargoPlugin* m_plugin;
 };
 
+/**
+ * Launch mode for running the benchmarks of a project with cargo bench.
+ */
+class CargoBenchLaunchMode : public KDevelop::ILaunchMode
+{
+public:
+    static QString modeId();
+    QIcon icon() const override;
+    QString id() const override { return modeId(); }
+    QString name() const override;
+};
+
 class CargoPageFactory : public KDevelop::LaunchConfigurationPageFactory
 {
 public:
@@ -76,7 +89,7 @@ class CargoExecutionConfigType : public KDevelop::LaunchConfigurationType
 {
 Q_OBJECT
 public:
-    CargoExecutionConfigType();
+    explicit CargoExecutionConfigType( CargoPlugin* plugin );
     ~CargoExecutionConfigType() override;
 
     static QString typeId();
@@ -92,6 +105,9 @@ public:
     QMenu* launcherSuggestions() override;
 
 private:
+    const CargoTarget* targetForItem(KDevelop::ProjectBaseItem* item) const;
+
+    CargoPlugin* m_plugin;
     QList<KDevelop::LaunchConfigurationPageFactory*> factoryList;
 
 public slots:
@@ -0,0 +1,311 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargofilterstrategy.h"
+
+#include <cstring>
+
+using namespace KDevelop;
+
+static int skipSpaces(const QByteArray& line, int pos)
+{
+    while (pos < line.size() && line.at(pos) == ' ')
+    {
+        ++pos;
+    }
+    return pos;
+}
+
+static int tokenEnd(const QByteArray& line, int pos)
+{
+    while (pos < line.size() && line.at(pos) != ' ')
+    {
+        ++pos;
+    }
+    return pos;
+}
+
+static bool tokenIs(const QByteArray& line, int begin, int end, const char* token)
+{
+    const int length = std::strlen(token);
+    return end - begin == length && std::memcmp(line.constData() + begin, token, length) == 0;
+}
+
+/**
+ * Parses a decimal number from the range [begin, end) of the line.
+ * Like QString::toInt(), it returns 0 if the range is not a number.
+ */
+static int parseNumber(const QByteArray& line, int begin, int end)
+{
+    int value = 0;
+    for (int i = begin; i < end; ++i)
+    {
+        const char c = line.at(i);
+        if (c < '0' || c > '9')
+        {
+            return 0;
+        }
+        value = value * 10 + (c - '0');
+    }
+    return value;
+}
+
+CargoFilterStrategy::CargoFilterStrategy(const QUrl& buildDir)
+ : buildDir(buildDir)
+ , jsonMessages(false)
+ , showItems(true)
+ , lines(0)
+ , bytes(0)
+ , currentUrl(buildDir)
+ , currentItemType(FilteredItem::StandardItem)
+{
+    clock.start();
+}
+
+CargoFilterStrategy::~CargoFilterStrategy()
+{
+}
+
+void CargoFilterStrategy::handleLine(QProcess::ProcessChannel channel, const QByteArray& line)
+{
+    ++lines;
+    bytes += line.size();
+
+    if (jsonMessages && channel == QProcess::StandardOutput)
+    {
+        CargoMessage message = CargoMessageParser::parse(line);
+        switch (message.reason)
+        {
+            case CargoMessage::InvalidMessage:
+                // Not a cargo message, probably output of the program itself
+                message.reason = CargoMessage::ProgramOutput;
+                if (showItems)
+                {
+                    items << errorInLine(line);
+                    message.text = items.last().originalLine;
+                }
+                else
+                {
+                    message.text = QString::fromUtf8(line);
+                }
+                break;
+
+            case CargoMessage::CompilerMessage:
+                if (showItems)
+                {
+                    items << itemsForMessage(message);
+                }
+                break;
+
+            default:
+                break;
+        }
+        message.time = clock.elapsed();
+        messages << message;
+        return;
+    }
+
+    if (showItems)
+    {
+        items << errorInLine(line);
+    }
+
+    if (jsonMessages && line.startsWith("   Compiling "))
+    {
+        // The package name is the first token after "Compiling"
+        const int first = skipSpaces(line, 12);
+        CargoMessage message;
+        message.reason = CargoMessage::UnitStarted;
+        message.packageName = QString::fromUtf8(line.constData() + first, tokenEnd(line, first) - first);
+        message.time = clock.elapsed();
+        messages << message;
+    }
+}
+
+QVector<FilteredItem> CargoFilterStrategy::takeItems()
+{
+    QVector<FilteredItem> ret;
+    ret.swap(items);
+    return ret;
+}
+
+QVector<CargoMessage> CargoFilterStrategy::takeMessages()
+{
+    QVector<CargoMessage> ret;
+    ret.swap(messages);
+    return ret;
+}
+
+QUrl CargoFilterStrategy::urlForFile(const QByteArray& file)
+{
+    /*
+     * Consecutive locations almost always point to the same file,
+     * so only build a new url when the file changes.
+     */
+    if (file != currentFile)
+    {
+        currentFile = QByteArray(file.constData(), file.size());
+        currentUrl = Path(buildDir, QString::fromUtf8(currentFile)).toUrl();
+    }
+    return currentUrl;
+}
+
+QVector<FilteredItem> CargoFilterStrategy::itemsForMessage(const CargoMessage& message) const
+{
+    FilteredItem::FilteredOutputItemType type = FilteredItem::InformationItem;
+    if (message.level.startsWith(QLatin1String("error")))
+    {
+        type = FilteredItem::ErrorItem;
+    }
+    else if (message.level == QLatin1String("warning"))
+    {
+        type = FilteredItem::WarningItem;
+    }
+
+    QUrl url;
+    int lineNo = -1;
+    int columnNo = -1;
+    if (const CargoSpan* span = message.primarySpan())
+    {
+        // See errorInLine() for why the line and column are decremented
+        url = Path(buildDir, span->fileName).toUrl();
+        lineNo = span->lineStart - 1;
+        columnNo = span->columnStart - 1;
+    }
+
+    QStringList lines = message.rendered.split(QLatin1Char('\n'));
+    while (!lines.isEmpty() && lines.last().isEmpty())
+    {
+        lines.removeLast();
+    }
+
+    QVector<FilteredItem> items;
+    items.reserve(lines.size());
+    for (const QString& line : qAsConst(lines))
+    {
+        FilteredItem item(line, items.isEmpty() ? type : FilteredItem::InformationItem);
+        if (!url.isEmpty())
+        {
+            item.isActivatable = true;
+            item.url = url;
+            item.lineNo = lineNo;
+            item.columnNo = columnNo;
+        }
+        items << item;
+    }
+    return items;
+}
+
+KDevelop::FilteredItem CargoFilterStrategy::errorInLine(const QByteArray& line)
+{
+    KDevelop::FilteredItem item(QString::fromUtf8(line));
+    if (line.startsWith("error:") || line.startsWith("error["))
+    {
+        item.type = FilteredItem::ErrorItem;
+    }
+    else if (line.startsWith("warning:") || line.startsWith("warning["))
+    {
+        item.type = FilteredItem::WarningItem;
+    }
+    else if (line.startsWith("   Compiling")
+            || line.startsWith("    Finished"))
+    {
+        item.type = FilteredItem::ActionItem;
+    }
+    else
+    {
+        // Only the first two space-separated tokens are ever needed
+        const int first = skipSpaces(line, 0);
+        const int firstEnd = tokenEnd(line, first);
+        const int second = skipSpaces(line, firstEnd);
+        const int secondEnd = tokenEnd(line, second);
+
+        if (second < secondEnd && tokenIs(line, first, firstEnd, "-->"))
+        {
+            item.type = currentItemType;
+
+            // The location has the form file:line:column
+            int fileEnd = line.indexOf(':', second);
+            if (fileEnd < 0 || fileEnd > secondEnd)
+            {
+                fileEnd = secondEnd;
+            }
+
+            item.isActivatable = true;
+            item.url = urlForFile(QByteArray::fromRawData(line.constData() + second, fileEnd - second));
+            if (fileEnd < secondEnd)
+            {
+                int lineEnd = line.indexOf(':', fileEnd + 1);
+                if (lineEnd < 0 || lineEnd > secondEnd)
+                {
+                    lineEnd = secondEnd;
+                }
+
+                /*
+                 * Cargo counts lines from 1, and so does Kate,
+                 * but KDevelop internally counts from 0,
+                 * so we have to decrement the line number by 1.
+                 * The same is true for column numbers.
+                 */
+                item.lineNo = parseNumber(line, fileEnd + 1, lineEnd) - 1;
+                if (lineEnd < secondEnd)
+                {
+                    item.columnNo = parseNumber(line, lineEnd + 1, secondEnd) - 1;
+                }
+            }
+        }
+        else if (firstEnd - first == 1 && (line.at(first) == '|' || line.at(first) == '='))
+        {
+            item.type = FilteredItem::InformationItem;
+        }
+        else if (second < secondEnd && tokenIs(line, second, secondEnd, "|"))
+        {
+            item.type = FilteredItem::InformationItem;
+            item.isActivatable = true;
+            item.url = currentUrl;
+            item.lineNo = parseNumber(line, first, firstEnd) - 1;
+
+            /*
+             * We determine the column number from the line itself,
+             * as the first non-space character after the line number and '|'.
+             */
+            const int idx = secondEnd + 1;
+            const int length = line.size();
+
+            item.columnNo = 0;
+            for (int i = idx; i < length; ++i)
+            {
+                if (line.at(i) != ' ' && line.at(i) != '\t')
+                {
+                    item.columnNo = i - idx;
+                    break;
+                }
+            }
+        }
+        else
+        {
+            item.type = FilteredItem::StandardItem;
+        }
+    }
+    currentItemType = item.type;
+    return item;
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOFILTERSTRATEGY_H
+#define CARGOFILTERSTRATEGY_H
+
+#include <outputview/filtereditem.h>
+#include <util/path.h>
+
+#include <QElapsedTimer>
+#include <QVector>
+
+#include "cargooutputreader.h"
+#include "cargomessage.h"
+
+/**
+ * Turns the output of cargo into items for CargoOutputModel.
+ *
+ * Human readable output is classified line by line, directly on the raw bytes.
+ * With JSON messages enabled, standard output is decoded as cargo messages instead.
+ */
+class CargoFilterStrategy : public CargoLineHandler
+{
+public:
+    explicit CargoFilterStrategy(const QUrl& buildDir);
+    ~CargoFilterStrategy() override;
+
+    void setJsonMessages(bool jsonMessages) { this->jsonMessages = jsonMessages; }
+
+    /**
+     * Whether items are made for the lines, true by default.
+     * Without an output view there is nothing to show them in, so lines are only decoded
+     * as far as the messages need them, and no strings are made for the others.
+     */
+    void setShowItems(bool showItems) { this->showItems = showItems; }
+
+    void handleLine(QProcess::ProcessChannel channel, const QByteArray& line) override;
+
+    KDevelop::FilteredItem errorInLine(const QByteArray& line);
+
+    /**
+     * Converts a compiler message to output items, one for each line of its rendered text.
+     *
+     * All the items point to the primary span of the message,
+     * so no state is carried over between lines.
+     */
+    QVector<KDevelop::FilteredItem> itemsForMessage(const CargoMessage& message) const;
+
+    /**
+     * @return the items produced since the last call
+     */
+    QVector<KDevelop::FilteredItem> takeItems();
+
+    /**
+     * @return the cargo messages decoded since the last call, only collected with JSON messages enabled
+     */
+    QVector<CargoMessage> takeMessages();
+
+    int lineCount() const { return lines; }
+    qint64 byteCount() const { return bytes; }
+
+private:
+    QUrl urlForFile(const QByteArray& file);
+
+    KDevelop::Path buildDir;
+    bool jsonMessages;
+    bool showItems;
+    QVector<KDevelop::FilteredItem> items;
+    QVector<CargoMessage> messages;
+    QElapsedTimer clock;
+    int lines;
+    qint64 bytes;
+    QByteArray currentFile;
+    QUrl currentUrl;
+    KDevelop::FilteredItem::FilteredOutputItemType currentItemType;
+};
+
+#endif
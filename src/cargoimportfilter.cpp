@@ -0,0 +1,267 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargoimportfilter.h"
+
+#include <QFile>
+#include <QMutexLocker>
+
+using KDevelop::Path;
+
+/**
+ * Translates a gitignore pattern to a regular expression matching a whole path or name.
+ *
+ * Wildcards and character classes never match a slash. A ** only crosses directories
+ * as a whole component, otherwise it is a regular *, as in git.
+ */
+static QString gitignoreToRegularExpression(const QString& pattern)
+{
+    QString regexp;
+    const int size = pattern.size();
+    for (int i = 0; i < size; ++i)
+    {
+        const QChar c = pattern.at(i);
+        if (c == QLatin1Char('*') && i + 1 < size && pattern.at(i + 1) == QLatin1Char('*')
+            && (i == 0 || pattern.at(i - 1) == QLatin1Char('/')))
+        {
+            if (i + 2 == size)
+            {
+                // A trailing /** matches everything inside
+                regexp += QLatin1String(".*");
+                ++i;
+                continue;
+            }
+            if (pattern.at(i + 2) == QLatin1Char('/'))
+            {
+                // A leading **/ or a /**/ matches zero or more directories
+                regexp += QLatin1String("(?:.*/)?");
+                i += 2;
+                continue;
+            }
+        }
+
+        if (c == QLatin1Char('*'))
+        {
+            while (i + 1 < size && pattern.at(i + 1) == QLatin1Char('*'))
+            {
+                ++i;
+            }
+            regexp += QLatin1String("[^/]*");
+        }
+        else if (c == QLatin1Char('?'))
+        {
+            regexp += QLatin1String("[^/]");
+        }
+        else if (c == QLatin1Char('[') && pattern.indexOf(QLatin1Char(']'), i + 2) > 0)
+        {
+            int end = pattern.indexOf(QLatin1Char(']'), i + 2);
+            int start = i + 1;
+            regexp += QLatin1Char('[');
+            if (pattern.at(start) == QLatin1Char('!') || pattern.at(start) == QLatin1Char('^'))
+            {
+                // A negated class does not match a slash either
+                regexp += QLatin1String("^/");
+                ++start;
+                // A ] right after the negation is part of the class
+                if (end == start)
+                {
+                    end = pattern.indexOf(QLatin1Char(']'), end + 1);
+                    if (end < 0)
+                    {
+                        return QString();
+                    }
+                }
+            }
+            for (int j = start; j < end; ++j)
+            {
+                const QChar member = pattern.at(j);
+                if (member == QLatin1Char('\\') || member == QLatin1Char('[') || member == QLatin1Char(']')
+                    || member == QLatin1Char('^'))
+                {
+                    regexp += QLatin1Char('\\');
+                }
+                regexp += member;
+            }
+            regexp += QLatin1Char(']');
+            i = end;
+        }
+        else if (c == QLatin1Char('\\') && i + 1 < size)
+        {
+            regexp += QRegularExpression::escape(pattern.at(++i));
+        }
+        else
+        {
+            regexp += QRegularExpression::escape(c);
+        }
+    }
+    return QRegularExpression::anchoredPattern(regexp);
+}
+
+CargoImportFilter::CargoImportFilter(const Path& projectRoot, const Path& targetDirectory)
+    : projectRoot(projectRoot)
+    , targetDirectory(targetDirectory)
+{
+}
+
+void CargoImportFilter::setTargetDirectory(const Path& targetDirectory)
+{
+    QMutexLocker lock(&mutex);
+    this->targetDirectory = targetDirectory;
+}
+
+bool CargoImportFilter::isExcluded(const Path& path, bool isFolder) const
+{
+    QMutexLocker lock(&mutex);
+
+    if (isFolder)
+    {
+        if (path == targetDirectory)
+        {
+            return true;
+        }
+
+        // Members of a workspace that were built on their own have their own target directory
+        if (path.lastPathSegment() == QLatin1String("target")
+            && QFile::exists(Path(path.parent(), QStringLiteral("Cargo.toml")).toLocalFile()))
+        {
+            return true;
+        }
+    }
+
+    return isIgnored(path, isFolder);
+}
+
+QStringList CargoImportFilter::ignoreFiles() const
+{
+    QMutexLocker lock(&mutex);
+
+    QSet<Path> directories = ignoreFileDirectories;
+    directories.insert(projectRoot);
+
+    QStringList files;
+    for (const Path& directory : qAsConst(directories))
+    {
+        files << Path(directory, QStringLiteral(".gitignore")).toLocalFile();
+    }
+    return files;
+}
+
+void CargoImportFilter::reloadRules(const Path& directory)
+{
+    QMutexLocker lock(&mutex);
+    rules.remove(directory);
+}
+
+bool CargoImportFilter::isIgnored(const Path& path, bool isFolder) const
+{
+    // The .gitignore files that apply to a path are in its ancestors, the deepest one has the last word
+    QVector<Path> directories;
+    for (Path directory = path.parent(); projectRoot == directory || projectRoot.isParentOf(directory); directory = directory.parent())
+    {
+        directories.prepend(directory);
+    }
+
+    bool ignored = false;
+    for (const Path& directory : qAsConst(directories))
+    {
+        const QVector<Rule>& directoryRules = rulesForDirectory(directory);
+        if (directoryRules.isEmpty())
+        {
+            continue;
+        }
+
+        const QString relativePath = directory.relativePath(path);
+        const QString name = path.lastPathSegment();
+        for (const Rule& rule : directoryRules)
+        {
+            if (rule.directoryOnly && !isFolder)
+            {
+                continue;
+            }
+            if (rule.pattern.match(rule.anchored ? relativePath : name).hasMatch())
+            {
+                ignored = !rule.negated;
+            }
+        }
+    }
+    return ignored;
+}
+
+const QVector<CargoImportFilter::Rule>& CargoImportFilter::rulesForDirectory(const Path& directory) const
+{
+    auto it = rules.constFind(directory);
+    if (it != rules.constEnd())
+    {
+        return *it;
+    }
+
+    QVector<Rule> directoryRules;
+
+    QFile file(Path(directory, QStringLiteral(".gitignore")).toLocalFile());
+    if (file.open(QIODevice::ReadOnly))
+    {
+        ignoreFileDirectories.insert(directory);
+        while (!file.atEnd())
+        {
+            QString line = QString::fromUtf8(file.readLine()).trimmed();
+            if (line.isEmpty() || line.startsWith(QLatin1Char('#')))
+            {
+                continue;
+            }
+
+            Rule rule;
+            if (line.startsWith(QLatin1Char('!')))
+            {
+                rule.negated = true;
+                line.remove(0, 1);
+            }
+            if (line.endsWith(QLatin1Char('/')))
+            {
+                rule.directoryOnly = true;
+                line.chop(1);
+            }
+            if (line.startsWith(QLatin1Char('/')))
+            {
+                rule.anchored = true;
+                line.remove(0, 1);
+            }
+            else if (line.contains(QLatin1Char('/')))
+            {
+                // Relative to the directory of the .gitignore, a leading **/ still matches at any depth
+                rule.anchored = true;
+            }
+
+            if (line.isEmpty())
+            {
+                continue;
+            }
+
+            rule.pattern = QRegularExpression(gitignoreToRegularExpression(line));
+            if (!rule.pattern.pattern().isEmpty() && rule.pattern.isValid())
+            {
+                directoryRules << rule;
+            }
+        }
+    }
+
+    return *rules.insert(directory, directoryRules);
+}
@@ -0,0 +1,81 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOIMPORTFILTER_H
+#define CARGOIMPORTFILTER_H
+
+#include <util/path.h>
+
+#include <QHash>
+#include <QMutex>
+#include <QRegularExpression>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * Decides which files and folders of a cargo project are imported.
+ *
+ * The target directory, as well as any directory called target next to a Cargo.toml,
+ * is excluded, and so is everything ignored by the .gitignore files of the project.
+ * Excluded folders are never listed, so nothing below them is visited during import.
+ *
+ * Only the common subset of the gitignore syntax is supported:
+ * negation, directory-only and anchored patterns, the wildcards * and ?, character classes,
+ * escapes, and ** as a whole path component at the start, in the middle or at the end.
+ * Trailing spaces are always removed, even when escaped.
+ */
+class CargoImportFilter
+{
+public:
+    CargoImportFilter(const KDevelop::Path& projectRoot, const KDevelop::Path& targetDirectory);
+
+    void setTargetDirectory(const KDevelop::Path& targetDirectory);
+
+    bool isExcluded(const KDevelop::Path& path, bool isFolder) const;
+
+    /// The .gitignore files whose rules were read, and the one of the project root
+    QStringList ignoreFiles() const;
+    /// Forgets the rules of the .gitignore file in @p directory, they are read again when needed
+    void reloadRules(const KDevelop::Path& directory);
+
+private:
+    struct Rule
+    {
+        QRegularExpression pattern;
+        bool negated = false;
+        bool directoryOnly = false;
+        bool anchored = false;
+    };
+
+    const QVector<Rule>& rulesForDirectory(const KDevelop::Path& directory) const;
+    bool isIgnored(const KDevelop::Path& path, bool isFolder) const;
+
+    KDevelop::Path projectRoot;
+    KDevelop::Path targetDirectory;
+
+    mutable QMutex mutex;
+    mutable QHash<KDevelop::Path, QVector<Rule>> rules;
+    mutable QSet<KDevelop::Path> ignoreFileDirectories;
+};
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargomanifestwatcher.h"
+
+#include <KDirWatch>
+
+#include <QTimer>
+
+CargoManifestWatcher::CargoManifestWatcher( QObject* parent )
+    : QObject( parent )
+    , watcher( new KDirWatch( this ) )
+    , timer( new QTimer( this ) )
+{
+    timer->setSingleShot( true );
+    timer->setInterval( SettleDelay );
+
+    connect( watcher, &KDirWatch::dirty, this, &CargoManifestWatcher::fileChanged );
+    connect( watcher, &KDirWatch::created, this, &CargoManifestWatcher::fileChanged );
+    connect( watcher, &KDirWatch::deleted, this, &CargoManifestWatcher::fileChanged );
+    connect( timer, &QTimer::timeout, this, &CargoManifestWatcher::settled );
+}
+
+CargoManifestWatcher::~CargoManifestWatcher()
+{
+}
+
+void CargoManifestWatcher::setFiles( const QStringList& newFiles )
+{
+    for (const QString& file : qAsConst(files))
+    {
+        if (!newFiles.contains( file ))
+        {
+            watcher->removeFile( file );
+        }
+    }
+    for (const QString& file : newFiles)
+    {
+        if (!files.contains( file ))
+        {
+            watcher->addFile( file );
+        }
+    }
+    files = newFiles;
+}
+
+void CargoManifestWatcher::setDirectories( const QStringList& newDirectories )
+{
+    for (const QString& directory : qAsConst(directories))
+    {
+        if (!newDirectories.contains( directory ))
+        {
+            watcher->removeDir( directory );
+        }
+    }
+    for (const QString& directory : newDirectories)
+    {
+        if (!directories.contains( directory ))
+        {
+            watcher->addDir( directory );
+        }
+    }
+    directories = newDirectories;
+}
+
+void CargoManifestWatcher::fileChanged( const QString& file )
+{
+    pending.insert( file );
+    timer->start();
+}
+
+void CargoManifestWatcher::settled()
+{
+    const QStringList changedFiles( pending.begin(), pending.end() );
+    pending.clear();
+    emit changed( changedFiles );
+}
@@ -0,0 +1,77 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOMANIFESTWATCHER_H
+#define CARGOMANIFESTWATCHER_H
+
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+
+class KDirWatch;
+class QTimer;
+
+/**
+ * Watches the manifests and the lock file of a workspace.
+ *
+ * Changes are collected for a short while before they are reported,
+ * so that a burst of changes, such as the ones made by a git checkout,
+ * results in a single changed() signal.
+ */
+class CargoManifestWatcher : public QObject
+{
+Q_OBJECT
+public:
+    /**
+     * Time in milliseconds without further changes before they are reported.
+     */
+    static const int SettleDelay = 500;
+
+    explicit CargoManifestWatcher( QObject* parent = nullptr );
+    ~CargoManifestWatcher() override;
+
+    /**
+     * Replaces the set of watched files. Files that do not exist yet are watched for creation.
+     */
+    void setFiles( const QStringList& files );
+
+    /**
+     * Replaces the set of watched directories, where changes to the entries are reported.
+     */
+    void setDirectories( const QStringList& directories );
+
+signals:
+    void changed( const QStringList& files );
+
+private slots:
+    void fileChanged( const QString& file );
+    void settled();
+
+private:
+    KDirWatch* watcher;
+    QTimer* timer;
+    QStringList files;
+    QStringList directories;
+    QSet<QString> pending;
+};
+
+#endif
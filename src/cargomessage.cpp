@@ -0,0 +1,192 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargomessage.h"
+
+#include <QByteArray>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+const CargoSpan* CargoMessage::primarySpan() const
+{
+    for (const CargoSpan& span : spans)
+    {
+        if (span.isPrimary)
+        {
+            return &span;
+        }
+    }
+    return nullptr;
+}
+
+static QStringList toStringList(const QJsonArray& array)
+{
+    QStringList ret;
+    ret.reserve(array.size());
+    for (const QJsonValue& value : array)
+    {
+        ret << value.toString();
+    }
+    return ret;
+}
+
+/**
+ * Cargo names files of the workspace relative to its root. Other files have absolute paths,
+ * and code generated by the compiler has names in angle brackets, such as "<::core::macros::panic macros>".
+ */
+static bool isWorkspaceFile(const QString& fileName)
+{
+    return !fileName.startsWith(QLatin1Char('<')) && !QDir::isAbsolutePath(fileName);
+}
+
+static CargoSpan parseSpan(const QJsonObject& object)
+{
+    CargoSpan span;
+    span.fileName = object.value(QStringLiteral("file_name")).toString();
+    span.lineStart = object.value(QStringLiteral("line_start")).toInt();
+    span.columnStart = object.value(QStringLiteral("column_start")).toInt();
+    span.lineEnd = object.value(QStringLiteral("line_end")).toInt();
+    span.columnEnd = object.value(QStringLiteral("column_end")).toInt();
+    span.isPrimary = object.value(QStringLiteral("is_primary")).toBool();
+
+    // Expansions are nested from the innermost macro outwards, the last call site is in the code that was compiled
+    QJsonObject expansion = object.value(QStringLiteral("expansion")).toObject();
+    while (!isWorkspaceFile(span.fileName) && !expansion.isEmpty())
+    {
+        const QJsonObject callSite = expansion.value(QStringLiteral("span")).toObject();
+        span.fileName = callSite.value(QStringLiteral("file_name")).toString();
+        span.lineStart = callSite.value(QStringLiteral("line_start")).toInt();
+        span.columnStart = callSite.value(QStringLiteral("column_start")).toInt();
+        span.lineEnd = callSite.value(QStringLiteral("line_end")).toInt();
+        span.columnEnd = callSite.value(QStringLiteral("column_end")).toInt();
+        span.macroName = expansion.value(QStringLiteral("macro_decl_name")).toString();
+        expansion = callSite.value(QStringLiteral("expansion")).toObject();
+    }
+    return span;
+}
+
+static void parseCompilerMessage(const QJsonObject& object, CargoMessage& message)
+{
+    message.level = object.value(QStringLiteral("level")).toString();
+    message.text = object.value(QStringLiteral("message")).toString();
+    message.rendered = object.value(QStringLiteral("rendered")).toString();
+    message.code = object.value(QStringLiteral("code")).toObject().value(QStringLiteral("code")).toString();
+
+    const QJsonArray spans = object.value(QStringLiteral("spans")).toArray();
+    message.spans.reserve(spans.size());
+    for (const QJsonValue& value : spans)
+    {
+        message.spans << parseSpan(value.toObject());
+    }
+}
+
+static void parseCompilerArtifact(const QJsonObject& object, CargoMessage& message)
+{
+    const QJsonObject target = object.value(QStringLiteral("target")).toObject();
+    message.targetName = target.value(QStringLiteral("name")).toString();
+    message.targetKinds = toStringList(target.value(QStringLiteral("kind")).toArray());
+    message.sourcePath = target.value(QStringLiteral("src_path")).toString();
+    message.features = toStringList(object.value(QStringLiteral("features")).toArray());
+    message.filenames = toStringList(object.value(QStringLiteral("filenames")).toArray());
+    message.executable = object.value(QStringLiteral("executable")).toString();
+    message.fresh = object.value(QStringLiteral("fresh")).toBool();
+    message.test = object.value(QStringLiteral("profile")).toObject().value(QStringLiteral("test")).toBool();
+}
+
+CargoMessage CargoMessageParser::parse(const QByteArray& line)
+{
+    CargoMessage message;
+
+    /*
+     * Cheap check before handing the line to the JSON parser,
+     * output of programs run by cargo is mixed with the messages.
+     */
+    int start = 0;
+    while (start < line.size() && (line.at(start) == ' ' || line.at(start) == '\t'))
+    {
+        ++start;
+    }
+    if (start == line.size() || line.at(start) != '{')
+    {
+        return message;
+    }
+
+    QJsonParseError error;
+    const QJsonDocument document = QJsonDocument::fromJson(line, &error);
+    if (error.error != QJsonParseError::NoError || !document.isObject())
+    {
+        return message;
+    }
+
+    const QJsonObject object = document.object();
+    const QString reason = object.value(QStringLiteral("reason")).toString();
+    message.packageId = object.value(QStringLiteral("package_id")).toString();
+    message.packageName = packageName(message.packageId);
+
+    if (reason == QLatin1String("compiler-message"))
+    {
+        message.reason = CargoMessage::CompilerMessage;
+        parseCompilerMessage(object.value(QStringLiteral("message")).toObject(), message);
+    }
+    else if (reason == QLatin1String("compiler-artifact"))
+    {
+        message.reason = CargoMessage::CompilerArtifact;
+        parseCompilerArtifact(object, message);
+    }
+    else if (reason == QLatin1String("build-script-executed"))
+    {
+        message.reason = CargoMessage::BuildScriptExecuted;
+        message.outDir = object.value(QStringLiteral("out_dir")).toString();
+    }
+    else if (reason == QLatin1String("build-finished"))
+    {
+        message.reason = CargoMessage::BuildFinished;
+        message.success = object.value(QStringLiteral("success")).toBool();
+    }
+    else
+    {
+        message.reason = CargoMessage::OtherMessage;
+    }
+
+    return message;
+}
+
+QString CargoMessageParser::packageName(const QString& packageId)
+{
+    const int hash = packageId.lastIndexOf(QLatin1Char('#'));
+    if (hash < 0)
+    {
+        return packageId.section(QLatin1Char(' '), 0, 0);
+    }
+
+    const QString fragment = packageId.mid(hash + 1);
+    const int at = fragment.indexOf(QLatin1Char('@'));
+    if (at >= 0)
+    {
+        return fragment.left(at);
+    }
+
+    // The name is left out when it is the same as the last segment of the source
+    return packageId.left(hash).section(QLatin1Char('/'), -1, -1, QString::SectionSkipEmpty);
+}
@@ -0,0 +1,140 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOMESSAGE_H
+#define CARGOMESSAGE_H
+
+#include <QMetaType>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QByteArray;
+
+/**
+ * A source location attached to a compiler diagnostic,
+ * as reported in the "spans" array of a cargo JSON message.
+ *
+ * Line and column numbers are kept as cargo reports them, counting from 1.
+ *
+ * Spans inside macros that are not part of the workspace, such as the ones of the standard library,
+ * point to the place where the macro was used in the workspace instead.
+ */
+struct CargoSpan
+{
+    QString fileName;
+    int lineStart = 0;
+    int columnStart = 0;
+    int lineEnd = 0;
+    int columnEnd = 0;
+    bool isPrimary = false;
+    /// The outermost macro the location was taken out of, empty if it was not moved
+    QString macroName;
+};
+
+/**
+ * A single message from the output of cargo run with --message-format=json.
+ *
+ * Only the fields used by the plugin are decoded,
+ * which ones are filled depends on the reason of the message.
+ */
+struct CargoMessage
+{
+    enum Reason {
+        InvalidMessage,
+        CompilerMessage,
+        CompilerArtifact,
+        BuildScriptExecuted,
+        BuildFinished,
+        OtherMessage,
+        /// Not a JSON message, but the "Compiling" status line cargo prints when it starts on a package
+        UnitStarted,
+        /// Not a JSON message, but a line printed by a program that cargo runs, kept in text
+        ProgramOutput
+    };
+
+    Reason reason = InvalidMessage;
+    QString packageId;
+    QString packageName;
+
+    /// Time when the message was read, in milliseconds since the start of the build
+    qint64 time = 0;
+
+    // compiler-message
+    QString level;
+    QString code;
+    QString text;
+    QString rendered;
+    QVector<CargoSpan> spans;
+
+    // compiler-artifact
+    QString targetName;
+    QStringList targetKinds;
+    QStringList filenames;
+    QString executable;
+    /// The crate root of the target
+    QString sourcePath;
+    /// The features the unit was compiled with
+    QStringList features;
+    bool fresh = false;
+    /// Whether the artifact was built with the test profile, such as a test harness
+    bool test = false;
+
+    // build-script-executed
+    QString outDir;
+
+    // build-finished
+    bool success = false;
+
+    /**
+     * @return the primary span of a compiler message, or nullptr if it has none
+     */
+    const CargoSpan* primarySpan() const;
+};
+
+/**
+ * Decoder for the JSON lines printed by cargo with --message-format=json.
+ *
+ * Every line is a self-contained JSON object, so lines can be decoded
+ * one by one as they arrive, without keeping any state between them.
+ */
+class CargoMessageParser
+{
+public:
+    /**
+     * Decodes a single line of cargo output.
+     *
+     * Lines that are not JSON objects, such as the output of a program
+     * started with cargo run, result in a message with reason InvalidMessage.
+     */
+    static CargoMessage parse(const QByteArray& line);
+
+    /**
+     * Extracts the package name from a package id, which has the form
+     * "name version (source)" in older versions of cargo, and "source#name@version" in newer ones.
+     */
+    static QString packageName(const QString& packageId);
+};
+
+Q_DECLARE_METATYPE(CargoMessage)
+
+#endif
@@ -0,0 +1,629 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargometadata.h"
+#include "cargoplugin.h"
+#include "debug.h"
+
+#include <KLocalizedString>
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QSet>
+#include <QTimer>
+
+using KDevelop::Path;
+using KDevelop::IProject;
+using KDevelop::ProjectBaseItem;
+
+static const quint32 CacheMagic = 0x4b444361;
+
+/**
+ * Must be increased whenever the layout of the cache file changes.
+ */
+static const quint32 CacheVersion = 1;
+
+bool CargoTarget::isLibrary() const
+{
+    static const QStringList libraryKinds = {
+        QStringLiteral("lib"),
+        QStringLiteral("rlib"),
+        QStringLiteral("dylib"),
+        QStringLiteral("cdylib"),
+        QStringLiteral("staticlib"),
+        QStringLiteral("proc-macro")
+    };
+
+    for (const QString& kind : kinds)
+    {
+        if (libraryKinds.contains(kind))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CargoTarget::operator==(const CargoTarget& other) const
+{
+    return name == other.name
+        && kinds == other.kinds
+        && srcPath == other.srcPath
+        && edition == other.edition;
+}
+
+Path CargoPackage::directory() const
+{
+    return Path(manifestPath).parent();
+}
+
+bool CargoPackage::operator==(const CargoPackage& other) const
+{
+    return id == other.id
+        && name == other.name
+        && version == other.version
+        && manifestPath == other.manifestPath
+        && edition == other.edition
+        && features == other.features
+        && targets == other.targets;
+}
+
+const CargoPackage* CargoMetadata::packageInDirectory(const Path& directory) const
+{
+    auto it = packageIndex.constFind(directory);
+    return it == packageIndex.constEnd() ? nullptr : &packages.at(*it);
+}
+
+const CargoPackage* CargoMetadata::packageForPath(const Path& path) const
+{
+    const Path root(workspaceRoot);
+    for (Path directory = path; directory.isValid(); directory = directory.parent())
+    {
+        if (const CargoPackage* package = packageInDirectory(directory))
+        {
+            return package;
+        }
+        if (directory == root || !root.isParentOf(directory))
+        {
+            break;
+        }
+    }
+    return nullptr;
+}
+
+void CargoMetadata::updateIndex()
+{
+    memberListing = memberListingHash();
+    packageIndex.clear();
+    packageIndex.reserve(packages.size());
+    launchTargetList.clear();
+    sourceIndex.clear();
+    for (int i = 0; i < packages.size(); ++i)
+    {
+        packageIndex.insert(packages.at(i).directory(), i);
+        const QVector<CargoTarget>& targets = packages.at(i).targets;
+        for (int j = 0; j < targets.size(); ++j)
+        {
+            const CargoTarget& target = targets.at(j);
+            if (target.isBinary() || target.isExample() || target.isBench())
+            {
+                launchTargetList << target;
+            }
+            sourceIndex.insert(Path(target.srcPath), qMakePair(i, j));
+        }
+    }
+}
+
+const CargoTarget* CargoMetadata::targetForSource(const Path& sourceFile) const
+{
+    const auto it = sourceIndex.constFind(sourceFile);
+    if (it == sourceIndex.constEnd())
+    {
+        return nullptr;
+    }
+    return &packages.at(it->first).targets.at(it->second);
+}
+
+static QStringList toStringList(const QJsonArray& array)
+{
+    QStringList ret;
+    ret.reserve(array.size());
+    for (const QJsonValue& value : array)
+    {
+        ret << value.toString();
+    }
+    return ret;
+}
+
+CargoMetadata CargoMetadata::fromJson(const QByteArray& json, QString* error)
+{
+    CargoMetadata metadata;
+
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(json, &parseError);
+    if (!document.isObject())
+    {
+        if (error)
+        {
+            *error = parseError.errorString();
+        }
+        return metadata;
+    }
+
+    const QJsonObject object = document.object();
+    metadata.workspaceRoot = object.value(QStringLiteral("workspace_root")).toString();
+    metadata.targetDirectory = object.value(QStringLiteral("target_directory")).toString();
+
+    // Without --no-deps, dependencies are listed as well, but only members are part of the project
+    const QStringList memberList = toStringList(object.value(QStringLiteral("workspace_members")).toArray());
+    const QSet<QString> members(memberList.begin(), memberList.end());
+
+    const QJsonArray packages = object.value(QStringLiteral("packages")).toArray();
+    metadata.packages.reserve(packages.size());
+    for (const QJsonValue& packageValue : packages)
+    {
+        const QJsonObject packageObject = packageValue.toObject();
+
+        CargoPackage package;
+        package.id = packageObject.value(QStringLiteral("id")).toString();
+        if (!members.isEmpty() && !members.contains(package.id))
+        {
+            continue;
+        }
+
+        package.name = packageObject.value(QStringLiteral("name")).toString();
+        package.version = packageObject.value(QStringLiteral("version")).toString();
+        package.manifestPath = packageObject.value(QStringLiteral("manifest_path")).toString();
+        package.edition = packageObject.value(QStringLiteral("edition")).toString();
+        package.features = packageObject.value(QStringLiteral("features")).toObject().keys();
+
+        const QJsonArray targets = packageObject.value(QStringLiteral("targets")).toArray();
+        package.targets.reserve(targets.size());
+        for (const QJsonValue& targetValue : targets)
+        {
+            const QJsonObject targetObject = targetValue.toObject();
+
+            CargoTarget target;
+            target.name = targetObject.value(QStringLiteral("name")).toString();
+            target.kinds = toStringList(targetObject.value(QStringLiteral("kind")).toArray());
+            target.srcPath = targetObject.value(QStringLiteral("src_path")).toString();
+            target.edition = targetObject.value(QStringLiteral("edition")).toString();
+            package.targets << target;
+        }
+
+        metadata.packages << package;
+    }
+
+    if (!metadata.isValid() && error)
+    {
+        *error = i18n("The output of cargo metadata does not contain a workspace root");
+    }
+
+    metadata.updateIndex();
+    return metadata;
+}
+
+QStringList CargoMetadata::manifestFiles() const
+{
+    QStringList files;
+    files << workspaceRoot + QLatin1String("/Cargo.toml")
+          << workspaceRoot + QLatin1String("/Cargo.lock");
+    for (const CargoPackage& package : packages)
+    {
+        files << package.manifestPath;
+    }
+    files.sort();
+    files.removeDuplicates();
+    return files;
+}
+
+/**
+ * Reads the members of the [workspace] section of a manifest.
+ *
+ * Like profiles(), this only needs a small part of TOML:
+ * the members are an array of strings, possibly spread over several lines.
+ */
+static QStringList workspaceMembers(const QString& manifestPath)
+{
+    static const QRegularExpression section(QStringLiteral("^\\s*\\[workspace\\]\\s*$"), QRegularExpression::MultilineOption);
+    static const QRegularExpression nextSection(QStringLiteral("^\\s*\\["), QRegularExpression::MultilineOption);
+    static const QRegularExpression members(QStringLiteral("^\\s*members\\s*=\\s*\\[([^\\]]*)\\]"), QRegularExpression::MultilineOption);
+    static const QRegularExpression string(QStringLiteral("\"([^\"]*)\"|'([^']*)'"));
+
+    QFile manifest(manifestPath);
+    if (!manifest.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        return {};
+    }
+    const QString text = QString::fromUtf8(manifest.readAll());
+
+    const QRegularExpressionMatch sectionMatch = section.match(text);
+    if (!sectionMatch.hasMatch())
+    {
+        return {};
+    }
+    const int begin = sectionMatch.capturedEnd();
+    const QRegularExpressionMatch endMatch = nextSection.match(text, begin);
+    const QString body = text.mid(begin, endMatch.hasMatch() ? endMatch.capturedStart() - begin : -1);
+
+    QStringList ret;
+    auto it = string.globalMatch(members.match(body).captured(1));
+    while (it.hasNext())
+    {
+        const QRegularExpressionMatch match = it.next();
+        ret << (match.capturedLength(1) ? match.captured(1) : match.captured(2));
+    }
+    return ret;
+}
+
+QStringList CargoMetadata::matchedMembers(QStringList* searchedDirectories) const
+{
+    static const QRegularExpression wildcard(QStringLiteral("[*?\\[]"));
+
+    QStringList ret;
+    const QStringList patterns = workspaceMembers(workspaceRoot + QLatin1String("/Cargo.toml"));
+    for (const QString& pattern : patterns)
+    {
+        // Members without wildcards are packages, their manifests are already among the manifestFiles()
+        if (!pattern.contains(wildcard))
+        {
+            continue;
+        }
+
+        QStringList current = { workspaceRoot };
+        const QStringList components = pattern.split(QLatin1Char('/'), Qt::SkipEmptyParts);
+        for (const QString& component : components)
+        {
+            QStringList next;
+            for (const QString& directory : qAsConst(current))
+            {
+                if (component.contains(wildcard))
+                {
+                    if (searchedDirectories)
+                    {
+                        *searchedDirectories << directory;
+                    }
+                    const QStringList entries = QDir(directory).entryList({ component }, QDir::Dirs | QDir::NoDotAndDotDot);
+                    for (const QString& entry : entries)
+                    {
+                        next << directory + QLatin1Char('/') + entry;
+                    }
+                }
+                else if (QFileInfo(directory + QLatin1Char('/') + component).isDir())
+                {
+                    next << QDir::cleanPath(directory + QLatin1Char('/') + component);
+                }
+            }
+            current = next;
+        }
+        ret << current;
+    }
+
+    ret.sort();
+    ret.removeDuplicates();
+    return ret;
+}
+
+QStringList CargoMetadata::memberDirectories() const
+{
+    QStringList ret;
+    const QStringList matched = matchedMembers(&ret);
+    ret << matched;
+    ret.sort();
+    ret.removeDuplicates();
+    return ret;
+}
+
+/**
+ * A hash of the directories matched by the member patterns, and which of them have a manifest.
+ */
+QByteArray CargoMetadata::memberListingHash() const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    const QStringList directories = matchedMembers();
+    for (const QString& directory : directories)
+    {
+        hash.addData(directory.toUtf8());
+        hash.addData(QFileInfo::exists(directory + QLatin1String("/Cargo.toml")) ? "+" : "-", 1);
+    }
+    return hash.result();
+}
+
+QStringList CargoMetadata::profiles() const
+{
+    static const QRegularExpression profileSection(QStringLiteral("^\\s*\\[profile\\.([A-Za-z0-9_-]+)[\\].]"));
+
+    QStringList ret = {
+        QStringLiteral("dev"),
+        QStringLiteral("release"),
+        QStringLiteral("test"),
+        QStringLiteral("bench")
+    };
+
+    // Profiles can only be defined in the workspace manifest, and are simple enough not to need a TOML parser
+    QFile manifest(workspaceRoot + QLatin1String("/Cargo.toml"));
+    if (manifest.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        while (!manifest.atEnd())
+        {
+            const QRegularExpressionMatch match = profileSection.match(QString::fromUtf8(manifest.readLine()));
+            if (match.hasMatch() && !ret.contains(match.captured(1)))
+            {
+                ret << match.captured(1);
+            }
+        }
+    }
+    return ret;
+}
+
+QStringList CargoMetadata::unknownFeatures(const QStringList& features, const CargoPackage* package) const
+{
+    QStringList ret;
+    for (const QString& feature : features)
+    {
+        QString name = feature;
+        const CargoPackage* owner = package;
+        const int slash = feature.indexOf(QLatin1Char('/'));
+        if (slash >= 0)
+        {
+            // Features of dependencies are not known, so only workspace members are checked
+            owner = nullptr;
+            name = feature.mid(slash + 1);
+            for (const CargoPackage& member : packages)
+            {
+                if (member.name == feature.left(slash))
+                {
+                    owner = &member;
+                }
+            }
+            if (!owner)
+            {
+                continue;
+            }
+        }
+
+        bool found = false;
+        if (owner)
+        {
+            found = owner->features.contains(name);
+        }
+        else
+        {
+            for (const CargoPackage& member : packages)
+            {
+                found = found || member.features.contains(name);
+            }
+        }
+
+        if (!found)
+        {
+            ret << feature;
+        }
+    }
+    return ret;
+}
+
+QByteArray CargoMetadata::manifestHash() const
+{
+    const QStringList files = manifestFiles();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for (const QString& fileName : files)
+    {
+        hash.addData(fileName.toUtf8());
+
+        QFile file(fileName);
+        if (file.open(QIODevice::ReadOnly))
+        {
+            hash.addData(&file);
+        }
+        hash.addData("\0", 1);
+    }
+    hash.addData(memberListingHash());
+    return hash.result();
+}
+
+CargoMetadata CargoMetadata::load(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return CargoMetadata();
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+    if (magic != CacheMagic || version != CacheVersion)
+    {
+        return CargoMetadata();
+    }
+
+    CargoMetadata metadata;
+    QByteArray hash;
+    stream >> hash >> metadata.workspaceRoot >> metadata.targetDirectory >> metadata.packages;
+    if (stream.status() != QDataStream::Ok || hash != metadata.manifestHash())
+    {
+        return CargoMetadata();
+    }
+
+    metadata.updateIndex();
+    return metadata;
+}
+
+bool CargoMetadata::save(const QString& fileName) const
+{
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << CacheMagic << CacheVersion << manifestHash() << workspaceRoot << targetDirectory << packages;
+    return file.commit();
+}
+
+QDataStream& operator<<(QDataStream& stream, const CargoTarget& target)
+{
+    return stream << target.name << target.kinds << target.srcPath << target.edition;
+}
+
+QDataStream& operator>>(QDataStream& stream, CargoTarget& target)
+{
+    return stream >> target.name >> target.kinds >> target.srcPath >> target.edition;
+}
+
+QDataStream& operator<<(QDataStream& stream, const CargoPackage& package)
+{
+    return stream << package.id << package.name << package.version << package.manifestPath
+                  << package.edition << package.features << package.targets;
+}
+
+QDataStream& operator>>(QDataStream& stream, CargoPackage& package)
+{
+    return stream >> package.id >> package.name >> package.version >> package.manifestPath
+                  >> package.edition >> package.features >> package.targets;
+}
+
+CargoTargetItem::CargoTargetItem(IProject* project, const CargoTarget& target,
+                                 const Path& targetDirectory, ProjectBaseItem* parent)
+    : ProjectExecutableTargetItem(project, target.name, parent)
+    , m_target(target)
+{
+    // Tests and benches get a hash in their file name, so only cargo knows where they are
+    if (target.isBinary())
+    {
+        m_builtUrl = Path(targetDirectory, QLatin1String("debug/") + target.name).toUrl();
+    }
+    else if (target.isExample())
+    {
+        m_builtUrl = Path(targetDirectory, QLatin1String("debug/examples/") + target.name).toUrl();
+    }
+}
+
+QUrl CargoTargetItem::builtUrl() const
+{
+    return m_builtUrl;
+}
+
+QUrl CargoTargetItem::installedUrl() const
+{
+    return QUrl();
+}
+
+CargoMetadataJob::CargoMetadataJob(IProject* project, const QString& cacheFile, QObject* parent)
+    : KJob(parent)
+    , m_project(project)
+    , m_cacheFile(cacheFile)
+    , m_process(nullptr)
+    , m_environment(QProcessEnvironment::systemEnvironment())
+    , m_cached(false)
+{
+    setObjectName(i18n("Reading Cargo metadata of %1", project->name()));
+}
+
+void CargoMetadataJob::start()
+{
+    QTimer::singleShot(0, this, &CargoMetadataJob::loadCached);
+}
+
+void CargoMetadataJob::loadCached()
+{
+    if (!m_project)
+    {
+        emitResult();
+        return;
+    }
+
+    m_metadata = CargoMetadata::load(m_cacheFile);
+    if (m_metadata.isValid())
+    {
+        m_cached = true;
+        emitResult();
+        return;
+    }
+
+    m_process = new QProcess(this);
+    m_process->setWorkingDirectory(m_project->path().toLocalFile());
+    m_process->setProcessEnvironment(m_environment);
+    connect(m_process, static_cast<void(QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+            this, &CargoMetadataJob::procFinished);
+    connect(m_process, &QProcess::errorOccurred, this, &CargoMetadataJob::procError);
+
+    m_process->start(CargoPlugin::cargoExecutable(), {
+        QStringLiteral("metadata"),
+        QStringLiteral("--format-version"), QStringLiteral("1"),
+        QStringLiteral("--no-deps")
+    });
+}
+
+/*
+ * A failure to get the metadata is only logged, not reported as an error of the job.
+ * The project is still imported, just without any targets.
+ */
+
+void CargoMetadataJob::procFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    if (exitStatus != QProcess::NormalExit || exitCode != 0)
+    {
+        qCWarning(CUSTOMBUILDSYSTEM) << "cargo metadata failed:" << m_process->readAllStandardError();
+        emitResult();
+        return;
+    }
+
+    QString error;
+    m_metadata = CargoMetadata::fromJson(m_process->readAllStandardOutput(), &error);
+    if (!m_metadata.isValid())
+    {
+        qCWarning(CUSTOMBUILDSYSTEM) << "Could not parse cargo metadata:" << error;
+    }
+    else if (!m_metadata.save(m_cacheFile))
+    {
+        qCWarning(CUSTOMBUILDSYSTEM) << "Could not write the metadata cache" << m_cacheFile;
+    }
+    emitResult();
+}
+
+void CargoMetadataJob::procError(QProcess::ProcessError error)
+{
+    // Other errors are followed by finished()
+    if (error == QProcess::FailedToStart)
+    {
+        qCWarning(CUSTOMBUILDSYSTEM) << "Could not start cargo metadata:" << m_process->errorString();
+        emitResult();
+    }
+}
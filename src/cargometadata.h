@@ -0,0 +1,247 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOMETADATA_H
+#define CARGOMETADATA_H
+
+#include <KJob>
+
+#include <interfaces/iproject.h>
+#include <project/projectmodel.h>
+#include <util/path.h>
+
+#include <QHash>
+#include <QPointer>
+#include <QProcess>
+#include <QStringList>
+#include <QVector>
+
+class QDataStream;
+
+/**
+ * A single target of a package: a library, binary, example, test, bench or build script.
+ */
+struct CargoTarget
+{
+    QString name;
+    QStringList kinds;
+    QString srcPath;
+    QString edition;
+
+    bool isLibrary() const;
+    bool isBinary() const { return kinds.contains(QStringLiteral("bin")); }
+    bool isExample() const { return kinds.contains(QStringLiteral("example")); }
+    bool isTest() const { return kinds.contains(QStringLiteral("test")); }
+    bool isBench() const { return kinds.contains(QStringLiteral("bench")); }
+    bool isBuildScript() const { return kinds.contains(QStringLiteral("custom-build")); }
+
+    bool operator==(const CargoTarget& other) const;
+};
+
+/**
+ * A workspace member, as reported by cargo metadata.
+ */
+struct CargoPackage
+{
+    QString id;
+    QString name;
+    QString version;
+    QString manifestPath;
+    QString edition;
+    QStringList features;
+    QVector<CargoTarget> targets;
+
+    /**
+     * @return the directory containing the manifest of this package
+     */
+    KDevelop::Path directory() const;
+
+    bool operator==(const CargoPackage& other) const;
+    bool operator!=(const CargoPackage& other) const { return !(*this == other); }
+};
+
+/**
+ * The packages and targets of a cargo workspace.
+ *
+ * Only the parts of the cargo metadata output that the plugin uses are kept,
+ * so it can be stored in a small cache file and reloaded without running cargo.
+ */
+class CargoMetadata
+{
+public:
+    QString workspaceRoot;
+    QString targetDirectory;
+    QVector<CargoPackage> packages;
+
+    bool isValid() const { return !workspaceRoot.isEmpty(); }
+
+    /**
+     * @return the package whose manifest is in @p directory, or nullptr if there is none
+     */
+    const CargoPackage* packageInDirectory(const KDevelop::Path& directory) const;
+
+    /**
+     * @return the innermost package containing @p path, or nullptr if it is not part of any package
+     */
+    const CargoPackage* packageForPath(const KDevelop::Path& path) const;
+
+    /**
+     * Parses the output of cargo metadata --format-version 1.
+     */
+    static CargoMetadata fromJson(const QByteArray& json, QString* error = nullptr);
+
+    /**
+     * @return the paths of the workspace manifest, all the package manifests and the lock file
+     */
+    QStringList manifestFiles() const;
+
+    /**
+     * @return the directories where new workspace members can appear without any manifest changing:
+     * the ones searched by the glob patterns in the members of the workspace, and the ones matched by them
+     */
+    QStringList memberDirectories() const;
+
+    /**
+     * @return whether the glob patterns in the members of the workspace match other directories,
+     * or other directories with a manifest, than when the metadata was read
+     */
+    bool membersMayHaveChanged() const { return memberListingHash() != memberListing; }
+
+    /**
+     * @return the target whose crate root is @p sourceFile, or nullptr if it is not the root of any target
+     */
+    const CargoTarget* targetForSource(const KDevelop::Path& sourceFile) const;
+
+    /**
+     * @return the binaries, examples and benches of all workspace members, in the order of the packages
+     */
+    const QVector<CargoTarget>& launchTargets() const { return launchTargetList; }
+
+    /**
+     * @return the built-in profiles followed by the custom [profile.*] sections of the workspace manifest
+     */
+    QStringList profiles() const;
+
+    /**
+     * Checks that every feature in @p features is defined.
+     *
+     * Features of the form package/feature are looked up in that package,
+     * others in @p package, or in any workspace member if it is nullptr.
+     *
+     * @return the features that are not defined
+     */
+    QStringList unknownFeatures(const QStringList& features, const CargoPackage* package = nullptr) const;
+
+    /**
+     * Computes the cache key of this workspace, a hash of the contents of all the manifestFiles()
+     * and the directories matched by the glob patterns in the members of the workspace.
+     */
+    QByteArray manifestHash() const;
+
+    /**
+     * Loads metadata saved with save().
+     *
+     * The result is invalid if the file does not exist, is outdated,
+     * or the manifests changed since it was written.
+     */
+    static CargoMetadata load(const QString& fileName);
+    bool save(const QString& fileName) const;
+
+private:
+    void updateIndex();
+    /**
+     * @return the directories matched by the glob patterns in the members of the workspace,
+     * with the directories that were searched added to @p searchedDirectories
+     */
+    QStringList matchedMembers(QStringList* searchedDirectories = nullptr) const;
+    QByteArray memberListingHash() const;
+
+    QHash<KDevelop::Path, int> packageIndex;
+    QVector<CargoTarget> launchTargetList;
+    /// Crate roots of all targets, mapped to the indices of their package and target
+    QHash<KDevelop::Path, QPair<int, int>> sourceIndex;
+    /// The memberListingHash() when the metadata was read
+    QByteArray memberListing;
+};
+
+QDataStream& operator<<(QDataStream& stream, const CargoTarget& target);
+QDataStream& operator>>(QDataStream& stream, CargoTarget& target);
+QDataStream& operator<<(QDataStream& stream, const CargoPackage& package);
+QDataStream& operator>>(QDataStream& stream, CargoPackage& package);
+
+/**
+ * Project item for targets that produce an executable: binaries, examples, tests and benches.
+ */
+class CargoTargetItem : public KDevelop::ProjectExecutableTargetItem
+{
+public:
+    CargoTargetItem(KDevelop::IProject* project, const CargoTarget& target,
+                    const KDevelop::Path& targetDirectory, KDevelop::ProjectBaseItem* parent);
+
+    const CargoTarget& target() const { return m_target; }
+
+    QUrl builtUrl() const override;
+    QUrl installedUrl() const override;
+
+private:
+    CargoTarget m_target;
+    QUrl m_builtUrl;
+};
+
+/**
+ * Provides the metadata of a project, either from the cache or by running cargo metadata.
+ */
+class CargoMetadataJob : public KJob
+{
+Q_OBJECT
+public:
+    CargoMetadataJob(KDevelop::IProject* project, const QString& cacheFile, QObject* parent = nullptr);
+
+    void start() override;
+
+    /**
+     * Sets the environment of cargo metadata, which decides the target directory.
+     */
+    void setEnvironment(const QProcessEnvironment& environment) { m_environment = environment; }
+
+    CargoMetadata metadata() const { return m_metadata; }
+
+    /**
+     * @return whether the metadata was loaded from the cache, without running cargo
+     */
+    bool isCached() const { return m_cached; }
+
+private slots:
+    void loadCached();
+    void procFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void procError(QProcess::ProcessError error);
+
+private:
+    QPointer<KDevelop::IProject> m_project;
+    QString m_cacheFile;
+    QProcess* m_process;
+    CargoMetadata m_metadata;
+    QProcessEnvironment m_environment;
+    bool m_cached;
+};
+
+#endif
@@ -0,0 +1,354 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargooutputmodel.h"
+
+#include <interfaces/icore.h>
+#include <interfaces/idocumentcontroller.h>
+#include <outputview/outputmodel.h>
+
+#include <KTextEditor/Cursor>
+
+#include <QDataStream>
+#include <QFontDatabase>
+#include <QTemporaryFile>
+
+#include <algorithm>
+
+using KDevelop::FilteredItem;
+
+static bool isHighlight( const FilteredItem& item )
+{
+    return item.isActivatable && (item.type == FilteredItem::ErrorItem || item.type == FilteredItem::WarningItem);
+}
+
+static QDataStream& operator<<( QDataStream& stream, const FilteredItem& item )
+{
+    return stream << static_cast<qint32>( item.type ) << item.isActivatable << item.url
+                  << static_cast<qint32>( item.lineNo ) << static_cast<qint32>( item.columnNo ) << item.originalLine;
+}
+
+static QDataStream& operator>>( QDataStream& stream, FilteredItem& item )
+{
+    qint32 type, lineNo, columnNo;
+    stream >> type >> item.isActivatable >> item.url >> lineNo >> columnNo >> item.originalLine;
+    item.type = static_cast<FilteredItem::FilteredOutputItemType>( type );
+    item.lineNo = lineNo;
+    item.columnNo = columnNo;
+    return stream;
+}
+
+CargoOutputModel::CargoOutputModel( const QUrl& buildDir, QObject* parent )
+    : QAbstractListModel( parent )
+    , buildDir( buildDir )
+    , windowStart( 0 )
+    , spillFile( nullptr )
+    , mapped( nullptr )
+    , mappedSize( 0 )
+    , pageCache( MaxCachedPages )
+{
+}
+
+CargoOutputModel::~CargoOutputModel()
+{
+    // Also unmaps the file
+    delete spillFile;
+}
+
+int CargoOutputModel::rowCount( const QModelIndex& parent ) const
+{
+    return parent.isValid() ? 0 : windowStart + window.size();
+}
+
+FilteredItem CargoOutputModel::itemAt( int row ) const
+{
+    if (row >= windowStart)
+    {
+        return window.at( row - windowStart );
+    }
+
+    const int page = row / PageLines;
+    return spilledPage( page )->value( row - page * PageLines );
+}
+
+const QVector<FilteredItem>* CargoOutputModel::spilledPage( int page ) const
+{
+    QVector<FilteredItem>* items = pageCache.object( page );
+    if (!items)
+    {
+        items = new QVector<FilteredItem>( readPage( page ) );
+        pageCache.insert( page, items );
+    }
+    return items;
+}
+
+QVector<FilteredItem> CargoOutputModel::readPage( int page ) const
+{
+    const qint64 spilledSize = spillFile->size();
+    if (mappedSize < spilledSize)
+    {
+        if (mapped)
+        {
+            spillFile->unmap( mapped );
+        }
+        mapped = spillFile->map( 0, spilledSize );
+        mappedSize = mapped ? spilledSize : 0;
+    }
+
+    const int first = page * PageLines;
+    const int last = qMin( first + PageLines, windowStart );
+    QVector<FilteredItem> items;
+    if (!mapped || first >= last || page >= spilledPages.size())
+    {
+        return items;
+    }
+
+    const qint64 begin = spilledPages.at( page ).offset;
+    const qint64 end = (page + 1 < spilledPages.size()) ? spilledPages.at( page + 1 ).offset : spilledSize;
+    const QByteArray data = QByteArray::fromRawData( reinterpret_cast<const char*>( mapped ) + begin, end - begin );
+    QDataStream stream( data );
+
+    items.reserve( last - first );
+    for (int row = first; row < last; ++row)
+    {
+        FilteredItem item;
+        stream >> item;
+        items << item;
+    }
+    return items;
+}
+
+void CargoOutputModel::spill()
+{
+    if (!spillFile)
+    {
+        spillFile = new QTemporaryFile;
+        if (!spillFile->open())
+        {
+            // Without a file, everything stays in memory
+            return;
+        }
+    }
+    else if (!spillFile->isOpen())
+    {
+        return;
+    }
+
+    QByteArray chunk;
+    QDataStream stream( &chunk, QIODevice::WriteOnly );
+    qint64 offset = spillFile->size();
+
+    const int pageCount = spilledPages.size();
+    const int count = qMin( SpillLines, window.size() );
+    for (int i = 0; i < count; ++i)
+    {
+        if ((windowStart + i) % PageLines == 0)
+        {
+            spilledPages << SpilledPage{ offset + chunk.size(), false };
+        }
+        stream << window.at( i );
+    }
+
+    if (!spillFile->seek( offset ) || spillFile->write( chunk ) != chunk.size() || !spillFile->flush())
+    {
+        // Keep the lines that could not be written
+        spilledPages.resize( pageCount );
+        spillFile->close();
+        return;
+    }
+
+    // The last page may have been read while it was only partly spilled
+    pageCache.remove( windowStart / PageLines );
+
+    window.remove( 0, count );
+    windowStart += count;
+
+    // Only the pages remember where the spilled errors are
+    const auto spilledEnd = std::lower_bound( highlightRows.begin(), highlightRows.end(), windowStart );
+    for (auto it = highlightRows.begin(); it != spilledEnd; ++it)
+    {
+        spilledPages[*it / PageLines].hasHighlights = true;
+    }
+    highlightRows.erase( highlightRows.begin(), spilledEnd );
+}
+
+int CargoOutputModel::nextHighlightRow( int row ) const
+{
+    // Spilled rows are searched for in the pages that have any
+    for (int page = row / PageLines; page * PageLines < windowStart && page < spilledPages.size(); ++page)
+    {
+        if (!spilledPages.at( page ).hasHighlights)
+        {
+            continue;
+        }
+
+        const QVector<FilteredItem>* items = spilledPage( page );
+        for (int i = qMax( row - page * PageLines, 0 ); i < items->size(); ++i)
+        {
+            if (isHighlight( items->at( i ) ))
+            {
+                return page * PageLines + i;
+            }
+        }
+    }
+
+    auto it = std::lower_bound( highlightRows.constBegin(), highlightRows.constEnd(), row );
+    return it == highlightRows.constEnd() ? -1 : *it;
+}
+
+int CargoOutputModel::previousHighlightRow( int row ) const
+{
+    auto it = std::lower_bound( highlightRows.constBegin(), highlightRows.constEnd(), row );
+    if (it != highlightRows.constBegin())
+    {
+        return *(--it);
+    }
+
+    const int end = qMin( row, windowStart );
+    for (int page = (end - 1) / PageLines; end > 0 && page >= 0; --page)
+    {
+        if (page >= spilledPages.size() || !spilledPages.at( page ).hasHighlights)
+        {
+            continue;
+        }
+
+        const QVector<FilteredItem>* items = spilledPage( page );
+        for (int i = qMin( end - page * PageLines, items->size() ) - 1; i >= 0; --i)
+        {
+            if (isHighlight( items->at( i ) ))
+            {
+                return page * PageLines + i;
+            }
+        }
+    }
+    return -1;
+}
+
+QVariant CargoOutputModel::data( const QModelIndex& index, int role ) const
+{
+    if (!index.isValid() || index.row() >= rowCount())
+    {
+        return QVariant();
+    }
+
+    switch (role)
+    {
+        case Qt::DisplayRole:
+            return itemAt( index.row() ).originalLine;
+        case KDevelop::OutputModel::OutputItemTypeRole:
+            return static_cast<int>( itemAt( index.row() ).type );
+        case Qt::FontRole:
+            return QFontDatabase::systemFont( QFontDatabase::FixedFont );
+        default:
+            return QVariant();
+    }
+}
+
+void CargoOutputModel::activate( const QModelIndex& index )
+{
+    if (index.model() != this || index.row() >= rowCount())
+    {
+        return;
+    }
+
+    const FilteredItem item = itemAt( index.row() );
+    if (!item.isActivatable || item.url.isEmpty())
+    {
+        return;
+    }
+
+    QUrl url = item.url;
+    if (url.isRelative())
+    {
+        url = buildDir.resolved( url );
+    }
+    KDevelop::ICore::self()->documentController()->openDocument( url, KTextEditor::Cursor( item.lineNo, item.columnNo ) );
+}
+
+QModelIndex CargoOutputModel::firstHighlightIndex()
+{
+    const int row = nextHighlightRow( 0 );
+    return row < 0 ? QModelIndex() : index( row, 0 );
+}
+
+QModelIndex CargoOutputModel::lastHighlightIndex()
+{
+    const int row = previousHighlightRow( rowCount() );
+    return row < 0 ? QModelIndex() : index( row, 0 );
+}
+
+QModelIndex CargoOutputModel::nextHighlightIndex( const QModelIndex& current )
+{
+    int row = nextHighlightRow( current.isValid() ? current.row() + 1 : 0 );
+    if (row < 0)
+    {
+        // Wraps around to the first one
+        row = nextHighlightRow( 0 );
+    }
+    return row < 0 ? QModelIndex() : index( row, 0 );
+}
+
+QModelIndex CargoOutputModel::previousHighlightIndex( const QModelIndex& current )
+{
+    int row = previousHighlightRow( current.isValid() ? current.row() : rowCount() );
+    if (row < 0)
+    {
+        row = previousHighlightRow( rowCount() );
+    }
+    return row < 0 ? QModelIndex() : index( row, 0 );
+}
+
+void CargoOutputModel::appendItems( const QVector<FilteredItem>& newItems )
+{
+    if (newItems.isEmpty())
+    {
+        return;
+    }
+
+    const int first = rowCount();
+    beginInsertRows( QModelIndex(), first, first + newItems.size() - 1 );
+    window << newItems;
+    for (int i = 0; i < newItems.size(); ++i)
+    {
+        if (isHighlight( newItems.at( i ) ))
+        {
+            highlightRows << first + i;
+        }
+    }
+    endInsertRows();
+
+    // Rows do not change when they are spilled, so the view does not need to know
+    while (window.size() > MaxWindowLines)
+    {
+        const int spilled = windowStart;
+        spill();
+        if (windowStart == spilled)
+        {
+            break;
+        }
+    }
+}
+
+void CargoOutputModel::appendLine( const QString& line )
+{
+    appendItems( { FilteredItem( line, FilteredItem::StandardItem ) } );
+}
@@ -0,0 +1,107 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOOUTPUTMODEL_H
+#define CARGOOUTPUTMODEL_H
+
+#include <outputview/ioutputviewmodel.h>
+#include <outputview/filtereditem.h>
+
+#include <QAbstractListModel>
+#include <QCache>
+#include <QUrl>
+#include <QVector>
+
+class QTemporaryFile;
+
+/**
+ * Output model that is filled with items that were already filtered.
+ *
+ * Unlike KDevelop::OutputModel, it does not run a filtering strategy over the lines,
+ * the build job classifies them while reading cargo's output.
+ * Items are shown the same way, with KDevelop::OutputDelegate.
+ *
+ * Only a window of the most recent MaxWindowLines lines is kept in memory.
+ * Older lines, errors and warnings included, are spilled to an append-only temporary file,
+ * with the offset of each page of PageLines lines, and paged back in from a memory mapping of the file
+ * when the view shows them or the next error is looked for. Pages are only marked if they contain
+ * errors or warnings, so memory use grows with the number of pages, not with the number of lines.
+ */
+class CargoOutputModel : public QAbstractListModel, public KDevelop::IOutputViewModel
+{
+Q_OBJECT
+public:
+    static const int MaxWindowLines = 10000;
+    /// Number of lines spilled to the file at once, when the window is full
+    static constexpr int SpillLines = 2000;
+    /// Spilled lines are read back in pages of this many lines
+    static const int PageLines = 256;
+    static const int MaxCachedPages = 16;
+
+    explicit CargoOutputModel( const QUrl& buildDir, QObject* parent = nullptr );
+    ~CargoOutputModel() override;
+
+    int rowCount( const QModelIndex& parent = QModelIndex() ) const override;
+    QVariant data( const QModelIndex& index, int role = Qt::DisplayRole ) const override;
+
+    void activate( const QModelIndex& index ) override;
+    QModelIndex firstHighlightIndex() override;
+    QModelIndex nextHighlightIndex( const QModelIndex& current ) override;
+    QModelIndex previousHighlightIndex( const QModelIndex& current ) override;
+    QModelIndex lastHighlightIndex() override;
+
+    void appendItems( const QVector<KDevelop::FilteredItem>& items );
+    void appendLine( const QString& line );
+
+private:
+    struct SpilledPage
+    {
+        /// Offset of the first line of the page in spillFile
+        qint64 offset;
+        /// Whether any line of the page is an activatable error or warning
+        bool hasHighlights;
+    };
+
+    KDevelop::FilteredItem itemAt( int row ) const;
+    const QVector<KDevelop::FilteredItem>* spilledPage( int page ) const;
+    QVector<KDevelop::FilteredItem> readPage( int page ) const;
+    void spill();
+    /// @return the first highlighted row at or after @p row, or -1 if there is none
+    int nextHighlightRow( int row ) const;
+    /// @return the last highlighted row before @p row, or -1 if there is none
+    int previousHighlightRow( int row ) const;
+
+    QUrl buildDir;
+    /// The most recent lines, starting with row windowStart
+    QVector<KDevelop::FilteredItem> window;
+    int windowStart;
+    /// Rows of activatable errors and warnings in the window, in ascending order
+    QVector<int> highlightRows;
+
+    QTemporaryFile* spillFile;
+    QVector<SpilledPage> spilledPages;
+    mutable uchar* mapped;
+    mutable qint64 mappedSize;
+    mutable QCache<int, QVector<KDevelop::FilteredItem>> pageCache;
+};
+
+#endif
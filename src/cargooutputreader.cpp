@@ -0,0 +1,190 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargooutputreader.h"
+#include "cargoprocess.h"
+
+#include <cstring>
+
+/**
+ * Initial size of the read buffers, grown only if a single line does not fit.
+ */
+static const int InitialBufferSize = 64 * 1024;
+
+CargoLineHandler::~CargoLineHandler()
+{
+}
+
+CargoOutputReader::CargoOutputReader( QObject* parent )
+    : QObject( parent )
+    , process( new CargoProcess( this ) )
+    , handler( nullptr )
+{
+    process->setProcessChannelMode( QProcess::SeparateChannels );
+
+    connect( process, &QProcess::readyReadStandardOutput, this, &CargoOutputReader::readStandardOutput );
+    connect( process, &QProcess::readyReadStandardError, this, &CargoOutputReader::readStandardError );
+    connect( process, static_cast<void(QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+             this, &CargoOutputReader::processFinished );
+    connect( process, &QProcess::errorOccurred, this, &CargoOutputReader::processError );
+}
+
+CargoOutputReader::~CargoOutputReader()
+{
+}
+
+void CargoOutputReader::setProgram( const QString& program, const QStringList& arguments )
+{
+    process->setProgram( program );
+    process->setArguments( arguments );
+}
+
+void CargoOutputReader::setWorkingDirectory( const QString& directory )
+{
+    process->setWorkingDirectory( directory );
+}
+
+void CargoOutputReader::setEnvironment( const QProcessEnvironment& environment )
+{
+    process->setProcessEnvironment( environment );
+}
+
+void CargoOutputReader::setInheritedDescriptors( const QVector<int>& descriptors )
+{
+    process->setInheritedDescriptors( descriptors );
+}
+
+void CargoOutputReader::start()
+{
+    standardOutput.data.resize( InitialBufferSize );
+    standardError.data.resize( InitialBufferSize );
+    process->start();
+}
+
+void CargoOutputReader::kill()
+{
+    process->kill();
+}
+
+void CargoOutputReader::readStandardOutput()
+{
+    readChannel( QProcess::StandardOutput, standardOutput );
+    emit linesRead();
+}
+
+void CargoOutputReader::readStandardError()
+{
+    readChannel( QProcess::StandardError, standardError );
+    emit linesRead();
+}
+
+void CargoOutputReader::readChannel( QProcess::ProcessChannel channel, Buffer& buffer )
+{
+    process->setReadChannel( channel );
+
+    while (process->bytesAvailable() > 0)
+    {
+        if (buffer.end == buffer.data.size())
+        {
+            if (buffer.begin > 0)
+            {
+                // Move the unfinished line to the front and reuse the space before it
+                const int pending = buffer.end - buffer.begin;
+                std::memmove( buffer.data.data(), buffer.data.constData() + buffer.begin, pending );
+                buffer.begin = 0;
+                buffer.end = pending;
+            }
+            else
+            {
+                buffer.data.resize( buffer.data.size() * 2 );
+            }
+        }
+
+        const qint64 read = process->read( buffer.data.data() + buffer.end, buffer.data.size() - buffer.end );
+        if (read <= 0)
+        {
+            break;
+        }
+        buffer.end += read;
+        splitLines( channel, buffer, false );
+    }
+}
+
+void CargoOutputReader::splitLines( QProcess::ProcessChannel channel, Buffer& buffer, bool flush )
+{
+    const char* data = buffer.data.constData();
+    while (buffer.begin < buffer.end)
+    {
+        const char* lineStart = data + buffer.begin;
+        const char* newline = static_cast<const char*>( std::memchr( lineStart, '\n', buffer.end - buffer.begin ) );
+        if (!newline && !flush)
+        {
+            break;
+        }
+
+        int length = newline ? int( newline - lineStart ) : buffer.end - buffer.begin;
+        buffer.begin += newline ? length + 1 : length;
+        if (length > 0 && lineStart[length - 1] == '\r')
+        {
+            --length;
+        }
+
+        if (handler)
+        {
+            handler->handleLine( channel, QByteArray::fromRawData( lineStart, length ) );
+        }
+    }
+
+    if (buffer.begin == buffer.end)
+    {
+        buffer.begin = 0;
+        buffer.end = 0;
+    }
+}
+
+void CargoOutputReader::processFinished( int exitCode, QProcess::ExitStatus exitStatus )
+{
+    // Pick up anything that arrived after the last readyRead, including a last line without a newline
+    readChannel( QProcess::StandardOutput, standardOutput );
+    readChannel( QProcess::StandardError, standardError );
+    splitLines( QProcess::StandardOutput, standardOutput, true );
+    splitLines( QProcess::StandardError, standardError, true );
+    emit linesRead();
+
+    if (exitStatus == QProcess::CrashExit)
+    {
+        emit failed( QProcess::Crashed );
+    }
+    else
+    {
+        emit finished( exitCode );
+    }
+}
+
+void CargoOutputReader::processError( QProcess::ProcessError error )
+{
+    // Other errors are followed by finished(), which reports them
+    if (error == QProcess::FailedToStart)
+    {
+        emit failed( error );
+    }
+}
@@ -0,0 +1,106 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOOUTPUTREADER_H
+#define CARGOOUTPUTREADER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QByteArray>
+#include <QStringList>
+#include <QVector>
+
+class CargoProcess;
+
+/**
+ * Receives the lines read by CargoOutputReader.
+ */
+class CargoLineHandler
+{
+public:
+    virtual ~CargoLineHandler();
+
+    /**
+     * Called for every complete line, without the line terminator.
+     *
+     * @p line points directly into the read buffer of the reader,
+     * so it is only valid for the duration of the call.
+     */
+    virtual void handleLine(QProcess::ProcessChannel channel, const QByteArray& line) = 0;
+};
+
+/**
+ * Runs a process and splits its output into lines.
+ *
+ * Output is read straight into one buffer per channel that is reused for the whole run,
+ * and lines are handed to the handler as views into that buffer.
+ * No strings are created here, that is left to the handler for the lines it actually shows.
+ */
+class CargoOutputReader : public QObject
+{
+Q_OBJECT
+public:
+    explicit CargoOutputReader( QObject* parent = nullptr );
+    ~CargoOutputReader() override;
+
+    void setHandler( CargoLineHandler* handler ) { this->handler = handler; }
+    void setProgram( const QString& program, const QStringList& arguments );
+    void setWorkingDirectory( const QString& directory );
+    void setEnvironment( const QProcessEnvironment& environment );
+    void setInheritedDescriptors( const QVector<int>& descriptors );
+
+public slots:
+    void start();
+    void kill();
+
+signals:
+    /**
+     * Emitted after a chunk of output was passed to the handler.
+     */
+    void linesRead();
+    void finished( int exitCode );
+    void failed( QProcess::ProcessError error );
+
+private slots:
+    void readStandardOutput();
+    void readStandardError();
+    void processFinished( int exitCode, QProcess::ExitStatus exitStatus );
+    void processError( QProcess::ProcessError error );
+
+private:
+    struct Buffer
+    {
+        QByteArray data;
+        int begin = 0;
+        int end = 0;
+    };
+
+    void readChannel( QProcess::ProcessChannel channel, Buffer& buffer );
+    void splitLines( QProcess::ProcessChannel channel, Buffer& buffer, bool flush );
+
+    CargoProcess* process;
+    CargoLineHandler* handler;
+    Buffer standardOutput;
+    Buffer standardError;
+};
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargooutputworker.h"
+#include "cargooutputreader.h"
+#include "cargofilterstrategy.h"
+#include "debug.h"
+
+#include <QTimer>
+
+CargoOutputWorker::CargoOutputWorker( const QUrl& buildDir, const QString& program, const QStringList& arguments,
+                                      const QString& workingDirectory, const QProcessEnvironment& environment,
+                                      bool jsonMessages )
+    : filter( new CargoFilterStrategy( buildDir ) )
+    , reader( new CargoOutputReader( this ) )
+    , batchTimer( new QTimer( this ) )
+{
+    qRegisterMetaType<QVector<KDevelop::FilteredItem>>();
+    qRegisterMetaType<QVector<CargoMessage>>();
+
+    filter->setJsonMessages( jsonMessages );
+
+    reader->setHandler( filter );
+    reader->setProgram( program, arguments );
+    reader->setWorkingDirectory( workingDirectory );
+    reader->setEnvironment( environment );
+
+    batchTimer->setSingleShot( true );
+    batchTimer->setInterval( 1000 / MaxBatchesPerSecond );
+
+    connect( reader, &CargoOutputReader::linesRead, this, &CargoOutputWorker::linesRead );
+    connect( reader, &CargoOutputReader::finished, this, &CargoOutputWorker::readerFinished );
+    connect( reader, &CargoOutputReader::failed, this, &CargoOutputWorker::readerFailed );
+    connect( batchTimer, &QTimer::timeout, this, &CargoOutputWorker::flush );
+}
+
+CargoOutputWorker::~CargoOutputWorker()
+{
+    // The reader hands lines to the filter until its process is gone
+    delete reader;
+    delete filter;
+}
+
+void CargoOutputWorker::setShowItems( bool showItems )
+{
+    filter->setShowItems( showItems );
+}
+
+void CargoOutputWorker::setInheritedDescriptors( const QVector<int>& descriptors )
+{
+    reader->setInheritedDescriptors( descriptors );
+}
+
+void CargoOutputWorker::start()
+{
+    elapsed.start();
+    reader->start();
+}
+
+void CargoOutputWorker::kill()
+{
+    reader->kill();
+}
+
+void CargoOutputWorker::linesRead()
+{
+    if (!batchTimer->isActive())
+    {
+        batchTimer->start();
+    }
+}
+
+void CargoOutputWorker::flush()
+{
+    batchTimer->stop();
+
+    const QVector<KDevelop::FilteredItem> items = filter->takeItems();
+    if (!items.isEmpty())
+    {
+        emit itemsReady( items );
+    }
+
+    const QVector<CargoMessage> messages = filter->takeMessages();
+    if (!messages.isEmpty())
+    {
+        emit messagesReady( messages );
+    }
+}
+
+void CargoOutputWorker::readerFinished( int exitCode )
+{
+    flush();
+    logThroughput();
+    emit finished( exitCode );
+}
+
+/*
+ * Logged so the output path can be measured on recorded logs,
+ * by pointing the CARGO environment variable to a script that replays them.
+ */
+void CargoOutputWorker::logThroughput()
+{
+    const qint64 ms = qMax<qint64>( elapsed.elapsed(), 1 );
+    qCDebug(CUSTOMBUILDSYSTEM) << "Filtered" << filter->lineCount() << "lines," << filter->byteCount() << "bytes in"
+                               << ms << "ms:" << qint64( filter->lineCount() ) * 1000 / ms << "lines/s";
+}
+
+void CargoOutputWorker::readerFailed( QProcess::ProcessError error )
+{
+    flush();
+    emit failed( error );
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOOUTPUTWORKER_H
+#define CARGOOUTPUTWORKER_H
+
+#include <outputview/filtereditem.h>
+
+#include "cargomessage.h"
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QProcess>
+#include <QVector>
+
+class QTimer;
+class CargoOutputReader;
+class CargoFilterStrategy;
+
+/**
+ * Runs cargo and filters its output away from the GUI thread.
+ *
+ * The worker is moved to its own thread, where it reads the output,
+ * splits it into lines and classifies them. Filtered items are delivered
+ * in batches, at most MaxBatchesPerSecond times per second,
+ * so the view is not flooded with row insertions during large builds.
+ *
+ * Lines are filtered in a single thread because classification depends on the previous lines,
+ * and all signals are emitted from that thread, so batches arrive in order and
+ * always before finished() or failed().
+ */
+class CargoOutputWorker : public QObject
+{
+Q_OBJECT
+public:
+    static const int MaxBatchesPerSecond = 30;
+
+    CargoOutputWorker( const QUrl& buildDir, const QString& program, const QStringList& arguments,
+                       const QString& workingDirectory, const QProcessEnvironment& environment, bool jsonMessages );
+    ~CargoOutputWorker() override;
+
+    /**
+     * Only messages are delivered when items are not shown, see CargoFilterStrategy::setShowItems().
+     * Has to be called before the worker is started.
+     */
+    void setShowItems( bool showItems );
+
+    /**
+     * Lets cargo inherit @p descriptors, see CargoProcess. Has to be called before the worker is started.
+     */
+    void setInheritedDescriptors( const QVector<int>& descriptors );
+
+public slots:
+    void start();
+    void kill();
+
+signals:
+    void itemsReady( const QVector<KDevelop::FilteredItem>& items );
+    void messagesReady( const QVector<CargoMessage>& messages );
+    void finished( int exitCode );
+    void failed( QProcess::ProcessError error );
+
+private slots:
+    void linesRead();
+    void flush();
+    void readerFinished( int exitCode );
+    void readerFailed( QProcess::ProcessError error );
+
+private:
+    void logThroughput();
+
+    CargoFilterStrategy* filter;
+    CargoOutputReader* reader;
+    QTimer* batchTimer;
+    QElapsedTimer elapsed;
+};
+
+#endif
@@ -25,20 +25,43 @@
 #include <KPluginFactory>
 #include <KLocalizedString>
 #include <KConfigGroup>
+#include <KSharedConfig>
 #include <KShell>
 #include <QDebug>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSet>
+#include <QSharedPointer>
+#include <QTimer>
+
+#include <algorithm>
 
 #include <project/projectmodel.h>
 #include <interfaces/iproject.h>
 #include <interfaces/icore.h>
+#include <interfaces/idocument.h>
+#include <interfaces/idocumentcontroller.h>
+#include <interfaces/iprojectcontroller.h>
 #include <interfaces/iruncontroller.h>
+#include <interfaces/itestcontroller.h>
 #include <interfaces/ilaunchconfiguration.h>
+#include <util/executecompositejob.h>
+#include <serialization/indexedstring.h>
 
+#include "cargobuildcoordinator.h"
+#include "cargobuildinfo.h"
 #include "cargobuildjob.h"
+#include "cargoconfigpage.h"
 #include "cargoexecutionconfig.h"
+#include "cargomanifestwatcher.h"
+#include "cargoimportfilter.h"
+#include "cargoproblemreporter.h"
+#include "cargotestsuite.h"
+#include "debug.h"
 
 using KDevelop::ProjectTargetItem;
 using KDevelop::ProjectFolderItem;
+using KDevelop::ProjectLibraryTargetItem;
 using KDevelop::ProjectBuildFolderItem;
 using KDevelop::ProjectBaseItem;
 using KDevelop::ProjectFileItem;
@@ -55,13 +78,30 @@ K_PLUGIN_FACTORY_WITH_JSON(CargoFactory, "kdevcargo.json", registerPlugin<CargoP
 CargoPlugin::CargoPlugin( QObject *parent, const QVariantList & )
     : AbstractFileManagerPlugin( QStringLiteral("kdevcargo"), parent )
 {
-    m_configType = new CargoExecutionConfigType();
+    m_configType = new CargoExecutionConfigType( this );
     m_configType->addLauncher( new CargoLauncher( this ) );
     core()->runController()->addConfigurationType( m_configType );
+
+    m_benchMode = new CargoBenchLaunchMode();
+    core()->runController()->addLaunchMode( m_benchMode );
+
+    m_problemReporter = new CargoProblemReporter( this );
+    m_buildCoordinator = new CargoBuildCoordinator( this );
+
+    m_saveTimer = new QTimer( this );
+    m_saveTimer->setSingleShot( true );
+    m_saveTimer->setInterval( SaveCheckDelay );
+    connect( m_saveTimer, &QTimer::timeout, this, &CargoPlugin::checkSavedPackages );
+
+    connect( core()->projectController(), &KDevelop::IProjectController::projectClosing,
+             this, &CargoPlugin::projectClosing );
+    connect( core()->documentController(), &KDevelop::IDocumentController::documentSaved,
+             this, &CargoPlugin::documentSaved );
 }
 
 CargoPlugin::~CargoPlugin()
 {
+    qDeleteAll( m_importFilters );
 }
 
 void CargoPlugin::unload()
@@ -69,6 +109,10 @@ void CargoPlugin::unload()
     core()->runController()->removeConfigurationType( m_configType );
     delete m_configType;
     m_configType = nullptr;
+
+    core()->runController()->removeLaunchMode( m_benchMode );
+    delete m_benchMode;
+    m_benchMode = nullptr;
 }
 
 bool CargoPlugin::addFilesToTarget( const QList<ProjectFileItem*>&, ProjectTargetItem* )
@@ -76,19 +120,160 @@ bool CargoPlugin::addFilesToTarget( const QList<ProjectFileItem*>&, ProjectTarge
     return false;
 }
 
-bool CargoPlugin::hasBuildInfo( ProjectBaseItem* ) const
+bool CargoPlugin::hasBuildInfo( ProjectBaseItem* item ) const
 {
-    return false;
+    const QSharedPointer<CargoBuildInfo> info = buildInfo( item->project() );
+    return info && info->containsPath( itemPath( item ) );
 }
 
 KJob* CargoPlugin::build( ProjectBaseItem* dom )
 {
-    return new CargoBuildJob( this, dom, QStringLiteral("build") );
+    const QStringList packages = packagesForItem( dom );
+
+    /*
+     * When several items are built together, build() is called for each of them before any job starts.
+     * Their packages are then collected into one cargo invocation, where cargo builds independent crates
+     * in parallel, within the limits of its own jobserver. The remaining calls get a job that only waits for it.
+     *
+     * Very large selections are split into invocations of at most MaxPackagesPerBuild packages.
+     * Those run one after another, queued by the build coordinator on their shared target directory.
+     * Builds of different projects run together, sharing the jobserver of the coordinator.
+     */
+    if (m_pendingBuild && !m_pendingBuild->isStarted() && m_pendingBuild->project() == dom->project()
+        && m_pendingBuild->selectedPackages().size() + packages.size() <= MaxPackagesPerBuild)
+    {
+        m_pendingBuild->addPackages( packages );
+        return new CargoMergedBuildJob( m_pendingBuild );
+    }
+
+    auto job = new CargoBuildJob( this, dom, QStringLiteral("build") );
+    job->setJsonMessages(true);
+    job->setPackages( packages );
+    m_problemReporter->watch( job, workspaceRoot( dom->project() ) );
+    watchBuildInfo( job, dom->project() );
+
+    KConfigGroup group = dom->project()->projectConfiguration()->group( "Cargo" );
+    if (group.readEntry( "CollectTimings", false ))
+    {
+        job->setTimingsDirectory( Path( cacheDirectory( dom->project() ), QStringLiteral("timings") ).toLocalFile() );
+    }
+    if (group.readEntry( "CacheStats", false ))
+    {
+        job->setCacheStatsFile( Path( cacheDirectory( dom->project() ), QStringLiteral("cachestats.json") ).toLocalFile() );
+    }
+
+    m_pendingBuild = job;
+    QTimer::singleShot( 0, this, [this]() {
+        m_pendingBuild.clear();
+    });
+    return job;
+}
+
+Path CargoPlugin::itemPath( ProjectBaseItem* item )
+{
+    // Targets do not have a path of their own
+    Path path = item->path();
+    for (ProjectBaseItem* parent = item->parent(); !path.isValid() && parent; parent = parent->parent())
+    {
+        path = parent->path();
+    }
+    return path;
+}
+
+const CargoPackage* CargoPlugin::packageForItem( ProjectBaseItem* item ) const
+{
+    const CargoMetadata* data = metadata( item->project() );
+    return data ? data->packageForPath( itemPath( item ) ) : nullptr;
+}
+
+QStringList CargoPlugin::packagesForItem( ProjectBaseItem* item ) const
+{
+    const CargoMetadata* data = metadata( item->project() );
+    if (!data || item == item->project()->projectItem())
+    {
+        return {};
+    }
+
+    const CargoPackage* package = packageForItem( item );
+    if (!package || package->directory() == Path( data->workspaceRoot ))
+    {
+        return {};
+    }
+    return { package->name };
+}
+
+QSharedPointer<CargoBuildInfo> CargoPlugin::buildInfo( IProject* project ) const
+{
+    QMutexLocker lock( &m_buildInfoMutex );
+    return m_buildInfo.value( project );
+}
+
+/*
+ * Called on the GUI thread when the metadata is loaded, the build information is only read from other threads.
+ * It gets a copy of the metadata, which language support can use while m_metadata changes.
+ * The configuration of the host is read in the background, until it arrives packages have no cfg flags of the host.
+ */
+void CargoPlugin::updateBuildInfo( IProject* project )
+{
+    QSharedPointer<CargoBuildInfo> info;
+    {
+        QMutexLocker lock( &m_buildInfoMutex );
+        QSharedPointer<CargoBuildInfo>& existing = m_buildInfo[project];
+        if (!existing)
+        {
+            existing.reset( new CargoBuildInfo( workspaceRoot( project ) ) );
+        }
+        info = existing;
+    }
+    if (const CargoMetadata* data = metadata( project ))
+    {
+        info->setMetadata( *data );
+    }
+
+    // Run in the workspace, so that rustup picks the toolchain of the project
+    const QProcessEnvironment environment = cargoEnvironment( project );
+    auto rustc = new QProcess( this );
+    rustc->setProcessEnvironment( environment );
+    rustc->setWorkingDirectory( workspaceRoot( project ).toLocalFile() );
+
+    QWeakPointer<CargoBuildInfo> weakInfo = info;
+    connect( rustc, static_cast<void(QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+             this, [rustc, weakInfo]( int exitCode, QProcess::ExitStatus exitStatus ) {
+        rustc->deleteLater();
+        if (exitStatus != QProcess::NormalExit || exitCode != 0)
+        {
+            qCWarning(CUSTOMBUILDSYSTEM) << "Could not read the configuration of the host from rustc:" << rustc->readAllStandardError();
+            return;
+        }
+        if (const QSharedPointer<CargoBuildInfo> info = weakInfo.toStrongRef())
+        {
+            info->setHostConfiguration( rustc->readAllStandardOutput() );
+        }
+    });
+    connect( rustc, &QProcess::errorOccurred, this, [rustc]( QProcess::ProcessError error ) {
+        if (error == QProcess::FailedToStart)
+        {
+            qCWarning(CUSTOMBUILDSYSTEM) << "Could not start" << rustc->program() << rustc->errorString();
+            rustc->deleteLater();
+        }
+    });
+    rustc->start( environment.value( QStringLiteral("RUSTC"), QStringLiteral("rustc") ), { QStringLiteral("--print"), QStringLiteral("cfg") } );
+}
+
+void CargoPlugin::watchBuildInfo( CargoBuildJob* job, IProject* project )
+{
+    // Checks run build scripts and report features as well, so both kinds of jobs keep the information current
+    connect( job, &CargoBuildJob::messagesReceived, this, [this, project]( const QVector<CargoMessage>& messages ) {
+        if (const QSharedPointer<CargoBuildInfo> info = buildInfo( project ))
+        {
+            info->addMessages( messages );
+        }
+    });
 }
 
 Path CargoPlugin::buildDirectory( ProjectBaseItem*  item ) const
 {
-    return item->project()->path();
+    return targetDirectory( item->project() );
 }
 
 IProjectBuilder* CargoPlugin::builder() const
@@ -111,9 +296,10 @@ ProjectTargetItem* CargoPlugin::createTarget( const QString&, ProjectFolderItem*
     return nullptr;
 }
 
-QHash<QString, QString> CargoPlugin::defines( ProjectBaseItem* ) const
+QHash<QString, QString> CargoPlugin::defines( ProjectBaseItem* item ) const
 {
-    return {};
+    const QSharedPointer<CargoBuildInfo> info = buildInfo( item->project() );
+    return info ? info->packageForPath( itemPath( item ) ).defines : QHash<QString, QString>();
 }
 
 IProjectFileManager::Features CargoPlugin::features() const
@@ -124,12 +310,675 @@ IProjectFileManager::Features CargoPlugin::features() const
 ProjectFolderItem* CargoPlugin::createFolderItem( IProject* project,
                     const Path& path, ProjectBaseItem* parent )
 {
-    return new ProjectBuildFolderItem( project, path, parent );
+    countImported( project, &ImportStatistics::folders );
+
+    auto folder = new ProjectBuildFolderItem( project, path, parent );
+    updateTargets( folder );
+    return folder;
+}
+
+ProjectFileItem* CargoPlugin::createFileItem( IProject* project, const Path& path, ProjectBaseItem* parent )
+{
+    countImported( project, &ImportStatistics::files );
+
+    return AbstractFileManagerPlugin::createFileItem( project, path, parent );
 }
 
-Path::List CargoPlugin::includeDirectories( ProjectBaseItem* ) const
+bool CargoPlugin::isValid( const Path& path, const bool isFolder, IProject* project ) const
 {
-    return {};
+    CargoImportFilter* filter = importFilter( project );
+    if (filter && filter->isExcluded( path, isFolder ))
+    {
+        countImported( project, &ImportStatistics::excluded );
+        return false;
+    }
+
+    return AbstractFileManagerPlugin::isValid( path, isFolder, project );
+}
+
+CargoImportFilter* CargoPlugin::importFilter( IProject* project ) const
+{
+    QMutexLocker lock( &m_importMutex );
+    return m_importFilters.value( project );
+}
+
+void CargoPlugin::countImported( IProject* project, int ImportStatistics::* counter ) const
+{
+    QMutexLocker lock( &m_importMutex );
+    auto it = m_importStatistics.find( project );
+    if (it != m_importStatistics.end())
+    {
+        ++((*it).*counter);
+    }
+}
+
+KJob* CargoPlugin::createImportJob( ProjectFolderItem* item )
+{
+    KJob* importJob = AbstractFileManagerPlugin::createImportJob( item );
+    if (item->parent())
+    {
+        return importJob;
+    }
+
+    /*
+     * The metadata is read before the folders are imported,
+     * so targets can be added as soon as the folder of their package is created.
+     * Only the root folder exists already at this point.
+     */
+    IProject* project = item->project();
+
+    {
+        QMutexLocker lock( &m_importMutex );
+        CargoImportFilter*& filter = m_importFilters[project];
+        if (!filter)
+        {
+            filter = new CargoImportFilter( project->path(), configuredTargetDirectory( project ) );
+        }
+
+        m_importStatistics[project] = ImportStatistics();
+        m_importStatistics[project].timer.start();
+    }
+
+    // Diagnostics of the previous session are shown while the project is imported and checked again
+    m_problemReporter->restore( project, diagnosticsIndexFile( project ) );
+
+    auto metadataJob = new CargoMetadataJob( project, metadataCacheFile( project ), this );
+    metadataJob->setEnvironment( cargoEnvironment( project ) );
+    QPointer<IProject> projectPointer( project );
+    connect( metadataJob, &KJob::result, this, [this, project, projectPointer, item, metadataJob]() {
+        // projectClosing() deletes the filter, the project and its items may be gone if it was closed meanwhile
+        CargoImportFilter* filter = projectPointer ? importFilter( project ) : nullptr;
+        if (!filter)
+        {
+            return;
+        }
+
+        m_metadata.insert( project, metadataJob->metadata() );
+        filter->setTargetDirectory( targetDirectory( project ) );
+        updateBuildInfo( project );
+        updateTargets( item );
+
+        CargoManifestWatcher*& watcher = m_manifestWatchers[project];
+        if (!watcher)
+        {
+            watcher = new CargoManifestWatcher( this );
+            connect( watcher, &CargoManifestWatcher::changed, this, [this, project](const QStringList& files) {
+                manifestsChanged( project, files );
+            });
+        }
+        updateWatchedFiles( project );
+    });
+
+    auto job = new KDevelop::ExecuteCompositeJob( this, { metadataJob, importJob } );
+    connect( job, &KJob::result, this, [this, project]() {
+        {
+            QMutexLocker lock( &m_importMutex );
+            auto it = m_importStatistics.find( project );
+            if (it == m_importStatistics.end())
+            {
+                return;
+            }
+            qCInfo(CUSTOMBUILDSYSTEM) << "Imported" << project->name() << "in" << it->timer.elapsed() << "ms:"
+                                      << it->folders << "folders," << it->files << "files,"
+                                      << it->excluded << "paths excluded";
+            m_importStatistics.erase( it );
+        }
+
+        // The .gitignore files that were read during the import are known now
+        updateWatchedFiles( project );
+
+        // Tests of harnesses that were not rebuilt since the last session are known without running anything
+        QVector<CargoTestBinary> cached;
+        for (const CargoTestBinary& binary : CargoTestCache::load( testCacheFile( project ) ).binaries())
+        {
+            if (binary.isUpToDate())
+            {
+                cached << binary;
+            }
+        }
+        setTestSuites( project, cached );
+
+        KJob* check = startCheck( project );
+
+        /*
+         * Otherwise tests are only discovered when they are run, which builds their harnesses anyway.
+         * A project without any known tests has nothing to run them from, so it is discovered once,
+         * after the check, which already compiles most of the dependencies.
+         */
+        if (cached.isEmpty())
+        {
+            connect( check, &KJob::result, this, [this, project]() {
+                discoverTests( project );
+            });
+        }
+    });
+    return job;
+}
+
+void CargoPlugin::updateTargets( ProjectFolderItem* folder )
+{
+    auto it = m_metadata.constFind( folder->project() );
+    if (it == m_metadata.constEnd())
+    {
+        return;
+    }
+
+    for (ProjectTargetItem* target : folder->targetList())
+    {
+        folder->removeRow( target->row() );
+    }
+
+    const CargoPackage* package = it->packageInDirectory( folder->path() );
+    if (!package)
+    {
+        return;
+    }
+
+    IProject* project = folder->project();
+    const Path targetDir = targetDirectory( project );
+    for (const CargoTarget& target : package->targets)
+    {
+        ProjectTargetItem* targetItem = nullptr;
+        if (target.isLibrary())
+        {
+            targetItem = new ProjectLibraryTargetItem( project, target.name, folder );
+        }
+        else if (!target.isBuildScript())
+        {
+            targetItem = new CargoTargetItem( project, target, targetDir, folder );
+        }
+
+        if (targetItem)
+        {
+            new ProjectFileItem( project, Path( target.srcPath ), targetItem );
+        }
+    }
+}
+
+void CargoPlugin::manifestsChanged( IProject* project, const QStringList& files )
+{
+    auto it = m_metadata.find( project );
+    if (it == m_metadata.end())
+    {
+        return;
+    }
+
+    QStringList ignoreFiles;
+    QStringList otherFiles;
+    for (const QString& file : files)
+    {
+        (file.endsWith( QLatin1String("/.gitignore") ) ? ignoreFiles : otherFiles) << file;
+    }
+    if (!ignoreFiles.isEmpty())
+    {
+        ignoreFilesChanged( project, ignoreFiles );
+    }
+    if (otherFiles.isEmpty())
+    {
+        return;
+    }
+
+    const QStringList manifests = it->manifestFiles();
+    bool manifestChanged = false;
+    bool lockChanged = false;
+    bool directoryChanged = false;
+    for (const QString& file : qAsConst(otherFiles))
+    {
+        if (!manifests.contains( file ))
+        {
+            // Any change in a member directory is reported, but only new or removed members matter
+            directoryChanged = true;
+        }
+        else if (file.endsWith( QLatin1String("Cargo.lock") ))
+        {
+            lockChanged = true;
+        }
+        else
+        {
+            manifestChanged = true;
+        }
+    }
+
+    if (!manifestChanged && !(directoryChanged && it->membersMayHaveChanged()))
+    {
+        // Members and targets do not depend on the lock file, only the cache key does
+        if (lockChanged)
+        {
+            it->save( metadataCacheFile( project ) );
+        }
+        return;
+    }
+
+    reloadMetadata( project );
+}
+
+void CargoPlugin::ignoreFilesChanged( IProject* project, const QStringList& files )
+{
+    CargoImportFilter* filter = importFilter( project );
+    if (!filter)
+    {
+        return;
+    }
+
+    // Folders are listed again with the new rules, which adds and removes their items
+    for (const QString& file : files)
+    {
+        const Path directory = Path( file ).parent();
+        filter->reloadRules( directory );
+        const auto folders = project->foldersForPath( KDevelop::IndexedString( directory.pathOrUrl() ) );
+        for (ProjectFolderItem* folder : folders)
+        {
+            reload( folder );
+        }
+    }
+}
+
+void CargoPlugin::updateWatchedFiles( IProject* project )
+{
+    CargoManifestWatcher* watcher = m_manifestWatchers.value( project );
+    const CargoMetadata* data = metadata( project );
+    if (!watcher || !data)
+    {
+        return;
+    }
+
+    QStringList files = data->manifestFiles();
+    if (CargoImportFilter* filter = importFilter( project ))
+    {
+        files << filter->ignoreFiles();
+    }
+    watcher->setFiles( files );
+    watcher->setDirectories( data->memberDirectories() );
+}
+
+void CargoPlugin::reloadMetadata( IProject* project )
+{
+    auto job = new CargoMetadataJob( project, metadataCacheFile( project ), this );
+    job->setEnvironment( cargoEnvironment( project ) );
+    connect( job, &KJob::result, this, [this, project, job]() {
+        if (m_metadata.contains( project ))
+        {
+            applyMetadata( project, job->metadata() );
+        }
+    });
+    core()->runController()->registerJob( job );
+}
+
+void CargoPlugin::settingsChanged( IProject* project )
+{
+    // The metadata is cached in the target directory, so a new one is read from cargo
+    if (m_metadata.contains( project ))
+    {
+        reloadMetadata( project );
+    }
+}
+
+void CargoPlugin::applyMetadata( IProject* project, const CargoMetadata& metadata )
+{
+    if (!metadata.isValid())
+    {
+        return;
+    }
+
+    const CargoMetadata previous = m_metadata.value( project );
+    m_metadata.insert( project, metadata );
+    updateBuildInfo( project );
+
+    // Only the folders of packages that were added, removed or changed get new targets
+    const bool targetDirectoryChanged = previous.targetDirectory != metadata.targetDirectory;
+    if (targetDirectoryChanged)
+    {
+        if (CargoImportFilter* filter = importFilter( project ))
+        {
+            filter->setTargetDirectory( targetDirectory( project ) );
+        }
+    }
+
+    QSet<Path> changedDirectories;
+    for (const CargoPackage& package : metadata.packages)
+    {
+        const CargoPackage* old = previous.packageInDirectory( package.directory() );
+        if (!old || *old != package || targetDirectoryChanged)
+        {
+            changedDirectories.insert( package.directory() );
+        }
+    }
+    for (const CargoPackage& package : previous.packages)
+    {
+        if (!metadata.packageInDirectory( package.directory() ))
+        {
+            changedDirectories.insert( package.directory() );
+        }
+    }
+
+    for (const Path& directory : qAsConst(changedDirectories))
+    {
+        const auto folders = project->foldersForPath( KDevelop::IndexedString( directory.pathOrUrl() ) );
+        for (ProjectFolderItem* folder : folders)
+        {
+            updateTargets( folder );
+        }
+    }
+
+    updateWatchedFiles( project );
+}
+
+const CargoMetadata* CargoPlugin::metadata( IProject* project ) const
+{
+    auto it = m_metadata.constFind( project );
+    return it == m_metadata.constEnd() || !it->isValid() ? nullptr : &it.value();
+}
+
+Path CargoPlugin::targetDirectory( IProject* project ) const
+{
+    if (const CargoMetadata* data = metadata( project ))
+    {
+        if (!data->targetDirectory.isEmpty())
+        {
+            return Path( data->targetDirectory );
+        }
+    }
+    return configuredTargetDirectory( project );
+}
+
+Path CargoPlugin::configuredTargetDirectory( IProject* project ) const
+{
+    const QString configured = project->projectConfiguration()->group( "Cargo" ).readEntry( "TargetDirectory", QString() );
+    if (!configured.isEmpty())
+    {
+        return Path( project->path(), configured );
+    }
+
+    const QString env = qEnvironmentVariable( "CARGO_TARGET_DIR" );
+    if (!env.isEmpty())
+    {
+        return Path( project->path(), env );
+    }
+    return Path( project->path(), QStringLiteral("target") );
+}
+
+Path CargoPlugin::cacheDirectory( IProject* project ) const
+{
+    return Path( configuredTargetDirectory( project ), QStringLiteral("kdevcargo") );
+}
+
+QProcessEnvironment CargoPlugin::cargoEnvironment( IProject* project ) const
+{
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    const KConfigGroup group = project->projectConfiguration()->group( "Cargo" );
+
+    if (!group.readEntry( "TargetDirectory", QString() ).isEmpty())
+    {
+        environment.insert( QStringLiteral("CARGO_TARGET_DIR"), configuredTargetDirectory( project ).toLocalFile() );
+    }
+
+    const QString wrapper = group.readEntry( "RustcWrapper", QString() );
+    if (!wrapper.isEmpty())
+    {
+        environment.insert( QStringLiteral("RUSTC_WRAPPER"), wrapper );
+    }
+
+    // RUSTFLAGS already replaces the flags of the cargo configuration, so the linker is simply added to it
+    const QString linker = group.readEntry( "Linker", QString() );
+    if (!linker.isEmpty() && environment.contains( QStringLiteral("RUSTFLAGS") ))
+    {
+        const QString flags = environment.value( QStringLiteral("RUSTFLAGS") )
+                            + QLatin1String(" -C link-arg=-fuse-ld=") + linker;
+        environment.insert( QStringLiteral("RUSTFLAGS"), flags.trimmed() );
+    }
+
+    const int jobs = group.readEntry( "Jobs", 0 );
+    if (jobs > 0)
+    {
+        environment.insert( QStringLiteral("CARGO_BUILD_JOBS"), QString::number( jobs ) );
+    }
+    return environment;
+}
+
+/*
+ * rustc links through the C compiler, which selects lld, mold or gold with -fuse-ld.
+ * Arrays given with --config are appended to the ones of the configuration files,
+ * so the build.rustflags of the project are kept, unlike with RUSTFLAGS.
+ */
+QStringList CargoPlugin::cargoConfigArguments( IProject* project ) const
+{
+    const KConfigGroup group = project->projectConfiguration()->group( "Cargo" );
+    QString linker = group.readEntry( "Linker", QString() );
+    if (linker.isEmpty() || QProcessEnvironment::systemEnvironment().contains( QStringLiteral("RUSTFLAGS") ))
+    {
+        return {};
+    }
+
+    linker.replace( QLatin1Char('\\'), QLatin1String("\\\\") ).replace( QLatin1Char('"'), QLatin1String("\\\"") );
+    return { QStringLiteral("--config"), QStringLiteral("build.rustflags=[\"-C\", \"link-arg=-fuse-ld=%1\"]").arg( linker ) };
+}
+
+QString CargoPlugin::metadataCacheFile( IProject* project ) const
+{
+    return Path( cacheDirectory( project ), QStringLiteral("metadata") ).toLocalFile();
+}
+
+QString CargoPlugin::cargoExecutable()
+{
+    const QString env = qEnvironmentVariable( "CARGO" );
+    return env.isEmpty() ? QStringLiteral("cargo") : env;
+}
+
+QString CargoPlugin::diagnosticsIndexFile( IProject* project ) const
+{
+    return Path( cacheDirectory( project ), QStringLiteral("diagnostics") ).toLocalFile();
+}
+
+Path CargoPlugin::workspaceRoot( IProject* project ) const
+{
+    // File names in compiler messages are relative to the workspace root
+    const CargoMetadata* data = metadata( project );
+    return data ? Path( data->workspaceRoot ) : project->path();
+}
+
+KJob* CargoPlugin::startCheck( IProject* project, QStringList packages )
+{
+    // A newer check replaces the running one, so it also has to cover the packages that one did not finish
+    QPointer<CargoBuildJob>& running = m_checks[project];
+    if (running)
+    {
+        const QStringList previous = running->selectedPackages();
+        if (previous.isEmpty() || packages.isEmpty())
+        {
+            packages.clear();
+        }
+        else
+        {
+            for (const QString& package : previous)
+            {
+                if (!packages.contains( package ))
+                {
+                    packages << package;
+                }
+            }
+        }
+        running->kill( KJob::EmitResult );
+    }
+
+    auto job = new CargoBuildJob( this, project->projectItem(), QStringLiteral("check") );
+    job->setJsonMessages( true );
+    job->setBackground( true );
+    job->setPackages( packages );
+    m_problemReporter->watch( job, workspaceRoot( project ) );
+    watchBuildInfo( job, project );
+    core()->runController()->registerJob( job );
+
+    running = job;
+    return job;
+}
+
+KJob* CargoPlugin::discoverTests( IProject* project )
+{
+    QPointer<CargoTestDiscoveryJob>& running = m_testDiscoveries[project];
+    if (running)
+    {
+        return running;
+    }
+
+    KConfigGroup group = project->projectConfiguration()->group( "Cargo" );
+    const CargoMetadata* data = metadata( project );
+    if (!data || !group.readEntry( "DiscoverTests", true ))
+    {
+        return nullptr;
+    }
+
+    auto job = new CargoTestDiscoveryJob( project, *data, testCacheFile( project ), this );
+    job->setEnvironment( cargoEnvironment( project ) );
+    job->setConfigArguments( cargoConfigArguments( project ) );
+    job->setCoordinator( m_buildCoordinator, targetDirectory( project ).toLocalFile() );
+    connect( job, &KJob::result, this, [this, project, job]() {
+        // The project may have been closed in the meantime, and a failed build leaves the known tests alone
+        if (m_metadata.contains( project ) && !job->error())
+        {
+            setTestSuites( project, job->binaries() );
+        }
+    });
+    core()->runController()->registerJob( job );
+
+    running = job;
+    return job;
+}
+
+bool CargoPlugin::hasTestSuite( CargoTestSuite* suite ) const
+{
+    // The suite may have been deleted already, so it is only compared
+    for (const QList<CargoTestSuite*>& suites : m_testSuites)
+    {
+        if (suites.contains( suite ))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CargoPlugin::setTestSuites( IProject* project, const QVector<CargoTestBinary>& binaries )
+{
+    // Suites of harnesses that still exist are kept, as test jobs may be waiting to run them
+    QList<CargoTestSuite*> previous = m_testSuites.take( project );
+    QList<CargoTestSuite*>& suites = m_testSuites[project];
+    for (const CargoTestBinary& binary : binaries)
+    {
+        if (binary.cases.isEmpty())
+        {
+            continue;
+        }
+
+        auto it = std::find_if( previous.begin(), previous.end(), [&binary]( CargoTestSuite* suite ) {
+            return suite->name() == binary.name;
+        });
+        if (it == previous.end())
+        {
+            auto suite = new CargoTestSuite( project, binary );
+            core()->testController()->addTestSuite( suite );
+            suites << suite;
+            continue;
+        }
+
+        CargoTestSuite* suite = *it;
+        previous.erase( it );
+        if (suite->cases() != binary.cases)
+        {
+            // The test view only reads the cases of a suite when it is added
+            core()->testController()->removeTestSuite( suite );
+            suite->setBinary( binary );
+            core()->testController()->addTestSuite( suite );
+        }
+        else
+        {
+            suite->setBinary( binary );
+        }
+        suites << suite;
+    }
+
+    for (CargoTestSuite* suite : qAsConst( previous ))
+    {
+        core()->testController()->removeTestSuite( suite );
+        delete suite;
+    }
+}
+
+QString CargoPlugin::testCacheFile( IProject* project ) const
+{
+    return Path( cacheDirectory( project ), QStringLiteral("tests") ).toLocalFile();
+}
+
+void CargoPlugin::removeTestSuites( IProject* project )
+{
+    const QList<CargoTestSuite*> suites = m_testSuites.take( project );
+    for (CargoTestSuite* suite : suites)
+    {
+        core()->testController()->removeTestSuite( suite );
+        delete suite;
+    }
+}
+
+void CargoPlugin::documentSaved( KDevelop::IDocument* document )
+{
+    const Path path( document->url() );
+    IProject* project = core()->projectController()->findProjectForUrl( document->url() );
+    if (!project || project->projectFileManager() != this)
+    {
+        return;
+    }
+
+    KConfigGroup group = project->projectConfiguration()->group( "Cargo" );
+    const CargoMetadata* data = metadata( project );
+    if (!group.readEntry( "CheckOnSave", true ) || !data || targetDirectory( project ).isParentOf( path ))
+    {
+        return;
+    }
+
+    if (const CargoPackage* package = data->packageForPath( path ))
+    {
+        m_savedPackages[project].insert( package->name );
+        m_saveTimer->start();
+    }
+}
+
+void CargoPlugin::checkSavedPackages()
+{
+    const auto saved = m_savedPackages;
+    m_savedPackages.clear();
+
+    for (auto it = saved.constBegin(); it != saved.constEnd(); ++it)
+    {
+        startCheck( it.key(), QStringList( it.value().begin(), it.value().end() ) );
+    }
+}
+
+void CargoPlugin::projectClosing( IProject* project )
+{
+    if (CargoBuildJob* check = m_checks.take( project ))
+    {
+        check->kill( KJob::EmitResult );
+    }
+    m_savedPackages.remove( project );
+    m_launchArtifacts.remove( project );
+    {
+        QMutexLocker lock( &m_buildInfoMutex );
+        m_buildInfo.remove( project );
+    }
+    m_problemReporter->removeProject( project );
+    removeTestSuites( project );
+    m_metadata.remove( project );
+    {
+        QMutexLocker lock( &m_importMutex );
+        m_importStatistics.remove( project );
+        delete m_importFilters.take( project );
+    }
+    delete m_manifestWatchers.take( project );
+}
+
+Path::List CargoPlugin::includeDirectories( ProjectBaseItem* item ) const
+{
+    const QSharedPointer<CargoBuildInfo> info = buildInfo( item->project() );
+    return info ? info->packageForPath( itemPath( item ) ).includeDirectories : Path::List();
 }
 
 Path::List CargoPlugin::frameworkDirectories( ProjectBaseItem* ) const
@@ -159,51 +1008,288 @@ bool CargoPlugin::removeTarget( ProjectTargetItem* )
     return false;
 }
 
-QList<ProjectTargetItem*> CargoPlugin::targets( ProjectFolderItem* ) const
+QList<ProjectTargetItem*> CargoPlugin::targets( ProjectFolderItem* folder ) const
 {
-    return QList<ProjectTargetItem*>();
+    return folder->targetList();
 }
 
 int CargoPlugin::perProjectConfigPages() const
 {
-    return 0;
+    return 1;
 }
 
 KDevelop::ConfigPage* CargoPlugin::perProjectConfigPage(int number, const KDevelop::ProjectConfigOptions& options, QWidget* parent)
 {
-    Q_UNUSED(number);
-    Q_UNUSED(options);
-    Q_UNUSED(parent);
-    return nullptr;
+    if (number != 0)
+    {
+        return nullptr;
+    }
+    return new CargoConfigPage(this, options.project, parent);
 }
 
-QUrl CargoPlugin::executable(KDevelop::ILaunchConfiguration* config, QString& /*error*/) const
+/*
+ * Debuggers run the executable themselves, after the dependencyJob() that builds it,
+ * so this is the artifact of that build. Before the first build, the path is predicted
+ * from the target directory, which is not possible for tests, as their file names contain a hash.
+ */
+QUrl CargoPlugin::executable(KDevelop::ILaunchConfiguration* config, QString& error) const
 {
-    Q_UNUSED(config);
-    return QUrl::fromLocalFile(QStandardPaths::findExecutable("cargo"));
+    QString executable = launchExecutable( config );
+    if (executable.isEmpty())
+    {
+        executable = predictedExecutable( config );
+    }
+    if (executable.isEmpty())
+    {
+        error = i18n( "The executable of %1 is not known before it is built. "
+                      "Run it once, or set the executable name if the project has more than one.", config->name() );
+        return QUrl();
+    }
+    return QUrl::fromLocalFile( executable );
 }
 
-QStringList CargoPlugin::arguments(KDevelop::ILaunchConfiguration* config, QString& /*error*/) const
+QStringList CargoPlugin::arguments(KDevelop::ILaunchConfiguration* config, QString& error) const
 {
-    QStringList ret = {QStringLiteral("run")};
-    qWarning() << "Config:" << config->config().entryMap();
-    QString id = config->config().readEntry( "CargoIdentifier" );
-    if (!id.isEmpty())
+    Q_UNUSED(error);
+    return KShell::splitArgs( config->config().readEntry( "CargoArguments", "" ) );
+}
+
+QString CargoPlugin::predictedExecutable( KDevelop::ILaunchConfiguration* config ) const
+{
+    const CargoMetadata* metadata = this->metadata( config->project() );
+    if (!metadata)
+    {
+        return QString();
+    }
+
+    const KConfigGroup group = config->config();
+    QString identifier = group.readEntry( "CargoIdentifier", "" );
+    const CargoTarget* executableTarget = nullptr;
+    int binaries = 0;
+    for (const CargoPackage& package : metadata->packages)
+    {
+        for (const CargoTarget& target : package.targets)
+        {
+            if (identifier.isEmpty() ? target.isBinary() : (target.name == identifier && !target.isLibrary()))
+            {
+                executableTarget = &target;
+                ++binaries;
+            }
+        }
+    }
+    if (!executableTarget || binaries > 1 || !(executableTarget->isBinary() || executableTarget->isExample()))
     {
-        ret << QStringLiteral("--bin") << id;
+        return QString();
     }
-    QString arguments = config->config().readEntry( "CargoArguments" );
-    if (!arguments.isEmpty())
+
+    // Profiles inheriting from dev or release still have directories of their own
+    const QString profile = group.readEntry( "CargoProfile", "" );
+    QString profileDirectory = profile;
+    if (profile.isEmpty() || profile == QLatin1String("dev") || profile == QLatin1String("test"))
+    {
+        profileDirectory = QStringLiteral("debug");
+    }
+    else if (profile == QLatin1String("bench"))
+    {
+        profileDirectory = QStringLiteral("release");
+    }
+
+    Path path = targetDirectory( config->project() );
+    const QString triple = group.readEntry( "CargoTargetTriple", "" ).trimmed();
+    if (!triple.isEmpty())
     {
-        ret << QStringLiteral("--") << KShell::splitArgs(arguments);
+        path.addPath( triple );
+    }
+    path.addPath( profileDirectory );
+    if (executableTarget->isExample())
+    {
+        path.addPath( QStringLiteral("examples") );
+    }
+    path.addPath( executableTarget->name );
+    return path.toLocalFile();
+}
+
+QStringList CargoPlugin::profileArguments( KDevelop::ILaunchConfiguration* config, QString& error ) const
+{
+    const KConfigGroup group = config->config();
+    const QString profile = group.readEntry( "CargoProfile", "" );
+    const QStringList features = group.readEntry( "CargoFeatures", "" ).split( QRegularExpression( QStringLiteral("[\\s,]+") ), Qt::SkipEmptyParts );
+    const QString triple = group.readEntry( "CargoTargetTriple", "" ).trimmed();
+
+    QStringList ret;
+    if (const CargoMetadata* metadata = this->metadata( config->project() ))
+    {
+        if (!profile.isEmpty() && !metadata->profiles().contains( profile ))
+        {
+            error = i18n( "The profile %1 is not defined in the manifest of %2", profile, config->project()->name() );
+            return {};
+        }
+
+        // Features are checked against the package of the launched target, if there is one
+        const QString identifier = group.readEntry( "CargoIdentifier", "" );
+        const CargoPackage* targetPackage = nullptr;
+        for (const CargoPackage& package : metadata->packages)
+        {
+            for (const CargoTarget& target : package.targets)
+            {
+                if (!identifier.isEmpty() && target.name == identifier && !target.isLibrary())
+                {
+                    targetPackage = &package;
+                }
+            }
+        }
+
+        const QStringList unknown = metadata->unknownFeatures( features, targetPackage );
+        if (!unknown.isEmpty())
+        {
+            error = i18np( "Unknown feature: %2", "Unknown features: %2", unknown.size(), unknown.join( QStringLiteral(", ") ) );
+            return {};
+        }
+    }
+
+    if (profile == QLatin1String("release"))
+    {
+        ret << QStringLiteral("--release");
+    }
+    else if (!profile.isEmpty() && profile != QLatin1String("dev"))
+    {
+        ret << QStringLiteral("--profile") << profile;
+    }
+
+    if (!features.isEmpty())
+    {
+        ret << QStringLiteral("--features") << features.join( QLatin1Char(',') );
+    }
+    if (group.readEntry( "CargoNoDefaultFeatures", false ))
+    {
+        ret << QStringLiteral("--no-default-features");
+    }
+
+    if (triple.contains( QRegularExpression( QStringLiteral("\\s") ) ))
+    {
+        error = i18n( "Invalid target triple: %1", triple );
+        return {};
+    }
+    if (!triple.isEmpty())
+    {
+        ret << QStringLiteral("--target") << triple;
     }
     return ret;
 }
 
+QStringList CargoPlugin::targetArguments( KDevelop::ILaunchConfiguration* config ) const
+{
+    const QString identifier = config->config().readEntry( "CargoIdentifier", "" );
+    if (identifier.isEmpty())
+    {
+        return {};
+    }
+
+    if (const CargoMetadata* metadata = this->metadata( config->project() ))
+    {
+        for (const CargoPackage& package : metadata->packages)
+        {
+            for (const CargoTarget& target : package.targets)
+            {
+                if (target.isExample() && target.name == identifier)
+                {
+                    return { QStringLiteral("--example"), identifier };
+                }
+                if (target.isTest() && target.name == identifier)
+                {
+                    return { QStringLiteral("--test"), identifier };
+                }
+                if (target.isBench() && target.name == identifier)
+                {
+                    return { QStringLiteral("--bench"), identifier };
+                }
+            }
+        }
+    }
+    return { QStringLiteral("--bin"), identifier };
+}
+
+QString CargoPlugin::launchExecutable( KDevelop::ILaunchConfiguration* config ) const
+{
+    const LaunchArtifact artifact = m_launchArtifacts.value( config->project() ).value( config->config().name() );
+    if (artifact.executable.isEmpty())
+    {
+        return QString();
+    }
+
+    // The configuration may have changed since, selecting a different target, profile or triple
+    QString error;
+    const QStringList arguments = targetArguments( config ) + profileArguments( config, error );
+    if (!error.isEmpty() || arguments != artifact.arguments || !QFileInfo::exists( artifact.executable ))
+    {
+        qCDebug(CUSTOMBUILDSYSTEM) << "Not using" << artifact.executable << "built for other arguments" << artifact.arguments;
+        return QString();
+    }
+    return artifact.executable;
+}
+
+/*
+ * The executable is built by a cargo build of its own, and then run directly by the launcher,
+ * without cargo run and the output filter in between.
+ *
+ * The build always runs, as only cargo knows whether files changed outside of the editor.
+ * When nothing did, it only checks the fingerprints and reports the artifact as fresh.
+ */
 KJob* CargoPlugin::dependencyJob(KDevelop::ILaunchConfiguration* config) const
 {
-    Q_UNUSED(config);
-    return nullptr;
+    IProject* project = config->project();
+    QString error;
+    const QStringList arguments = targetArguments( config ) + profileArguments( config, error );
+    if (!error.isEmpty())
+    {
+        return nullptr;
+    }
+
+    const QString key = config->config().name();
+    auto job = new CargoBuildJob( const_cast<CargoPlugin*>( this ), project->projectItem(), QStringLiteral("build") );
+    job->setJsonMessages( true );
+    job->setRunArguments( arguments );
+
+    // Without an identifier, cargo run only works with a single executable in the workspace
+    const QString identifier = config->config().readEntry( "CargoIdentifier", "" );
+    auto executables = QSharedPointer<QStringList>::create();
+    auto fresh = QSharedPointer<bool>::create( true );
+    connect( job, &CargoBuildJob::messagesReceived, job, [executables, fresh, identifier]( const QVector<CargoMessage>& messages ) {
+        for (const CargoMessage& message : messages)
+        {
+            if (message.reason == CargoMessage::CompilerArtifact && !message.fresh)
+            {
+                *fresh = false;
+            }
+            if (message.reason == CargoMessage::CompilerArtifact && !message.executable.isEmpty()
+                && (identifier.isEmpty() || message.targetName == identifier)
+                && (message.targetKinds.contains( QStringLiteral("bin") ) || message.targetKinds.contains( QStringLiteral("example") )
+                    || message.targetKinds.contains( QStringLiteral("test") ) || message.targetKinds.contains( QStringLiteral("bench") ))
+                && !executables->contains( message.executable ))
+            {
+                *executables << message.executable;
+            }
+        }
+    });
+
+    QPointer<IProject> projectPointer( project );
+    connect( job, &KJob::result, this, [this, job, projectPointer, key, arguments, executables, fresh]() {
+        if (job->error() || !projectPointer || !m_metadata.contains( projectPointer ) || executables->size() != 1)
+        {
+            return;
+        }
+
+        if (*fresh)
+        {
+            qCDebug(CUSTOMBUILDSYSTEM) << "Launching" << executables->first() << "without changes since the last build";
+        }
+
+        LaunchArtifact built;
+        built.executable = executables->first();
+        built.arguments = arguments;
+        m_launchArtifacts[projectPointer].insert( key, built );
+    });
+    return job;
 }
 
 QUrl CargoPlugin::workingDirectory(KDevelop::ILaunchConfiguration* config) const
@@ -217,8 +1303,7 @@ QString CargoPlugin::environmentProfileName(KDevelop::ILaunchConfiguration* conf
 QString CargoPlugin::environmentGroup(KDevelop::ILaunchConfiguration* config) const
 #endif
 {
-    Q_UNUSED(config);
-    return QString();
+    return config->config().readEntry( "EnvironmentGroup", QString() );
 }
 
 QString CargoPlugin::nativeAppConfigTypeId() const
@@ -241,8 +1326,8 @@ QString CargoPlugin::terminal(KDevelop::ILaunchConfiguration* config) const
 #if KDEVPLATFORM_VERSION >= VERSION_5_2
 QString CargoPlugin::extraArguments(KDevelop::ProjectBaseItem* item) const
 {
-    Q_UNUSED(item);
-    return QString();
+    const QSharedPointer<CargoBuildInfo> info = buildInfo( item->project() );
+    return info ? info->packageForPath( itemPath( item ) ).extraArguments : QString();
 }
 #endif
 
@@ -30,16 +30,37 @@
 #include <execute/iexecuteplugin.h>
 #include <kdevplatform_version.h>
 
+#include "cargometadata.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QPointer>
+#include <QProcessEnvironment>
+#include <QSet>
+#include <QSharedPointer>
+
 #define VERSION_5_2 ((5<<16)|(2<<8)|(0))
 
+class QTimer;
 class KConfigGroup;
 class KDialogBase;
 class CargoExecutionConfigType;
+class CargoBenchLaunchMode;
+class CargoBuildCoordinator;
+class CargoBuildInfo;
+class CargoBuildJob;
+class CargoManifestWatcher;
+class CargoImportFilter;
+class CargoProblemReporter;
+class CargoTestSuite;
+class CargoTestDiscoveryJob;
+struct CargoTestBinary;
 
 namespace KDevelop
 {
 class ProjectBaseItem;
 class IProject;
+class IDocument;
 }
 
 class CargoPlugin : public KDevelop::AbstractFileManagerPlugin, public KDevelop::IProjectBuilder, public KDevelop::IBuildSystemManager, public IExecutePlugin
@@ -50,6 +71,18 @@ class CargoPlugin : public KDevelop::AbstractFileManagerPlugin, public KDevelop:
     Q_INTERFACES( KDevelop::IBuildSystemManager )
     Q_INTERFACES( IExecutePlugin )
 public:
+    /**
+     * Largest number of packages built by a single cargo invocation,
+     * bigger selections are split into several invocations.
+     */
+    static const int MaxPackagesPerBuild = 64;
+
+    /**
+     * Time in milliseconds to wait after a document is saved before checking its package,
+     * so that a burst of saves results in a single cargo check.
+     */
+    static const int SaveCheckDelay = 500;
+
     explicit CargoPlugin( QObject *parent = nullptr, const QVariantList &args = QVariantList() );
     virtual ~CargoPlugin();
 
@@ -74,6 +107,10 @@ public:
     Features features() const override;
     virtual KDevelop::ProjectFolderItem* createFolderItem( KDevelop::IProject* project, 
                     const KDevelop::Path& path, KDevelop::ProjectBaseItem* parent = nullptr ) override;
+    KDevelop::ProjectFileItem* createFileItem( KDevelop::IProject* project,
+                    const KDevelop::Path& path, KDevelop::ProjectBaseItem* parent ) override;
+    KJob* createImportJob( KDevelop::ProjectFolderItem* item ) override;
+    bool isValid( const KDevelop::Path& path, const bool isFolder, KDevelop::IProject* project ) const override;
 
 // BuildSystemManager API
 public:
@@ -119,8 +156,165 @@ public:
 // IPlugin API
     void unload() override;
 
+// Cargo specific
+    /**
+     * @return the cargo executable to run, taken from the CARGO environment variable
+     * the same way cargo subcommands find it, so a stand-in can replay recorded output.
+     */
+    static QString cargoExecutable();
+
+    /**
+     * @return the metadata of @p project, or nullptr if it is not known (yet)
+     *
+     * The metadata is replaced when it is read again, so this is only for the GUI thread.
+     */
+    const CargoMetadata* metadata( KDevelop::IProject* project ) const;
+
+    /**
+     * @return the directory where cargo puts build artifacts of @p project
+     */
+    KDevelop::Path targetDirectory( KDevelop::IProject* project ) const;
+
+    /**
+     * @return the directory for files the plugin keeps about @p project,
+     * inside the target directory so that cargo clean removes them as well.
+     *
+     * Unlike targetDirectory(), this does not depend on the metadata,
+     * as the metadata itself is cached there.
+     */
+    KDevelop::Path cacheDirectory( KDevelop::IProject* project ) const;
+
+    /**
+     * @return the environment for running cargo in @p project, with the target directory,
+     * compiler wrapper and number of jobs of the project configuration.
+     * The linker is only added here if RUSTFLAGS is set, otherwise see cargoConfigArguments().
+     */
+    QProcessEnvironment cargoEnvironment( KDevelop::IProject* project ) const;
+
+    /**
+     * @return the --config arguments for cargo commands that compile @p project,
+     * with the linker of the project configuration
+     */
+    QStringList cargoConfigArguments( KDevelop::IProject* project ) const;
+
+    /**
+     * @return the coordinator shared by the builds of all projects
+     */
+    CargoBuildCoordinator* buildCoordinator() const { return m_buildCoordinator; }
+
+    /**
+     * Applies changed settings of @p project, called by its configuration page.
+     */
+    void settingsChanged( KDevelop::IProject* project );
+
+    /**
+     * @return the name of the package containing @p item, in a list for passing to CargoBuildJob::setPackages(),
+     * or an empty list if the item is not in a package or is the root of the workspace.
+     */
+    QStringList packagesForItem( KDevelop::ProjectBaseItem* item ) const;
+
+    /**
+     * @return the cargo arguments selecting the profile, features and target triple of a launch configuration,
+     * or an empty list with @p error set if they do not match the metadata of the project
+     */
+    QStringList profileArguments( KDevelop::ILaunchConfiguration* config, QString& error ) const;
+
+    /**
+     * @return the cargo arguments selecting the executable of a launch configuration, --bin, --example, --test or --bench,
+     * or an empty list if it does not name one
+     */
+    QStringList targetArguments( KDevelop::ILaunchConfiguration* config ) const;
+
+    /**
+     * @return the executable built for @p config by its dependencyJob(), or an empty string if it was not built yet,
+     * or was built before the configuration changed
+     */
+    QString launchExecutable( KDevelop::ILaunchConfiguration* config ) const;
+
+    /**
+     * @return where cargo puts the executable of @p config when it is built,
+     * or an empty string if that cannot be known before building it
+     */
+    QString predictedExecutable( KDevelop::ILaunchConfiguration* config ) const;
+
+    /**
+     * Builds the test harnesses of @p project and lists the tests of those that changed,
+     * updating the test suites when it finishes. Called before running tests.
+     *
+     * @return the running discovery, which is shared by all callers until it finishes,
+     * or nullptr if test discovery is disabled for the project
+     */
+    KJob* discoverTests( KDevelop::IProject* project );
+
+    /**
+     * @return whether @p suite is still one of the test suites of an open project, @p suite may already be deleted
+     */
+    bool hasTestSuite( CargoTestSuite* suite ) const;
+
+private slots:
+    void projectClosing( KDevelop::IProject* project );
+    void documentSaved( KDevelop::IDocument* document );
+    void checkSavedPackages();
+
 private:
+    KDevelop::Path configuredTargetDirectory( KDevelop::IProject* project ) const;
+    QString metadataCacheFile( KDevelop::IProject* project ) const;
+    QString diagnosticsIndexFile( KDevelop::IProject* project ) const;
+    KDevelop::Path workspaceRoot( KDevelop::IProject* project ) const;
+    KJob* startCheck( KDevelop::IProject* project, QStringList packages = QStringList() );
+    static KDevelop::Path itemPath( KDevelop::ProjectBaseItem* item );
+    /// Only for the GUI thread, language support uses the metadata in the CargoBuildInfo
+    const CargoPackage* packageForItem( KDevelop::ProjectBaseItem* item ) const;
+    QSharedPointer<CargoBuildInfo> buildInfo( KDevelop::IProject* project ) const;
+    void updateBuildInfo( KDevelop::IProject* project );
+    void watchBuildInfo( CargoBuildJob* job, KDevelop::IProject* project );
+    QString testCacheFile( KDevelop::IProject* project ) const;
+    void setTestSuites( KDevelop::IProject* project, const QVector<CargoTestBinary>& binaries );
+    void removeTestSuites( KDevelop::IProject* project );
+    void updateTargets( KDevelop::ProjectFolderItem* folder );
+    void applyMetadata( KDevelop::IProject* project, const CargoMetadata& metadata );
+    void reloadMetadata( KDevelop::IProject* project );
+    void manifestsChanged( KDevelop::IProject* project, const QStringList& files );
+    void ignoreFilesChanged( KDevelop::IProject* project, const QStringList& files );
+    void updateWatchedFiles( KDevelop::IProject* project );
+    CargoImportFilter* importFilter( KDevelop::IProject* project ) const;
+
+    struct ImportStatistics
+    {
+        QElapsedTimer timer;
+        int folders = 0;
+        int files = 0;
+        int excluded = 0;
+    };
+
+    void countImported( KDevelop::IProject* project, int ImportStatistics::* counter ) const;
+
+    struct LaunchArtifact
+    {
+        QString executable;
+        QStringList arguments;
+    };
+
     CargoExecutionConfigType* m_configType;
+    CargoBenchLaunchMode* m_benchMode;
+    QHash<KDevelop::IProject*, CargoMetadata> m_metadata;
+    /// Guards the import filters and statistics, used by the threads importing projects
+    mutable QMutex m_importMutex;
+    QHash<KDevelop::IProject*, CargoImportFilter*> m_importFilters;
+    QHash<KDevelop::IProject*, ImportStatistics> m_importStatistics;
+    QHash<KDevelop::IProject*, CargoManifestWatcher*> m_manifestWatchers;
+    QPointer<CargoBuildJob> m_pendingBuild;
+    CargoProblemReporter* m_problemReporter;
+    CargoBuildCoordinator* m_buildCoordinator;
+    QHash<KDevelop::IProject*, QPointer<CargoBuildJob>> m_checks;
+    QHash<KDevelop::IProject*, QSet<QString>> m_savedPackages;
+    QTimer* m_saveTimer;
+    QHash<KDevelop::IProject*, QList<CargoTestSuite*>> m_testSuites;
+    QHash<KDevelop::IProject*, QPointer<CargoTestDiscoveryJob>> m_testDiscoveries;
+    mutable QHash<KDevelop::IProject*, QHash<QString, LaunchArtifact>> m_launchArtifacts;
+    /// Guards the build information, which language support reads from its own threads
+    mutable QMutex m_buildInfoMutex;
+    QHash<KDevelop::IProject*, QSharedPointer<CargoBuildInfo>> m_buildInfo;
 };
 
 #endif
@@ -0,0 +1,210 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargoproblemreporter.h"
+#include "cargobuildjob.h"
+#include "debug.h"
+
+#include <KLocalizedString>
+#include <KTextEditor/Range>
+
+#include <QTimer>
+
+#include <interfaces/icore.h>
+#include <interfaces/ilanguagecontroller.h>
+#include <language/editor/documentrange.h>
+#include <serialization/indexedstring.h>
+#include <shell/problem.h>
+#include <shell/problemmodel.h>
+#include <shell/problemmodelset.h>
+
+using namespace KDevelop;
+
+static const char ProblemModelId[] = "Cargo";
+
+/// Delay for collecting more messages before the problem reporter is updated
+static const int PublishDelay = 200;
+
+CargoProblemReporter::CargoProblemReporter( QObject* parent )
+    : QObject( parent )
+    , model( new ProblemModel( this ) )
+    , publishTimer( new QTimer( this ) )
+{
+    model->setFeatures( ProblemModel::ScopeFilter | ProblemModel::SeverityFilter
+                        | ProblemModel::Grouping | ProblemModel::CanByPassScopeFilter );
+    ICore::self()->languageController()->problemModelSet()->addModel( QLatin1String(ProblemModelId), i18n( "Cargo" ), model );
+
+    publishTimer->setSingleShot( true );
+    publishTimer->setInterval( PublishDelay );
+    connect( publishTimer, &QTimer::timeout, this, &CargoProblemReporter::publish );
+}
+
+CargoProblemReporter::~CargoProblemReporter()
+{
+    ICore::self()->languageController()->problemModelSet()->removeModel( QLatin1String(ProblemModelId) );
+}
+
+void CargoProblemReporter::restore( IProject* project, const QString& indexFile )
+{
+    ProjectDiagnostics& diagnostics = projects[project];
+    diagnostics.indexFile = indexFile;
+    diagnostics.index.load( indexFile );
+    publish();
+}
+
+void CargoProblemReporter::watch( CargoBuildJob* job, const Path& root )
+{
+    runs.insert( job, Run{ job->project(), root, {} } );
+    connect( job, &CargoBuildJob::messagesReceived, this, [this, job](const QVector<CargoMessage>& messages) {
+        addMessages( job, messages );
+    });
+    connect( job, &KJob::result, this, &CargoProblemReporter::jobFinished );
+}
+
+void CargoProblemReporter::removeProject( IProject* project )
+{
+    projects.remove( project );
+    for (auto it = runs.begin(); it != runs.end(); ++it)
+    {
+        if (it->project == project)
+        {
+            it->project = nullptr;
+        }
+    }
+    publish();
+}
+
+void CargoProblemReporter::addMessages( CargoBuildJob* job, const QVector<CargoMessage>& messages )
+{
+    auto run = runs.find( job );
+    if (run == runs.end() || !projects.contains( run->project ))
+    {
+        return;
+    }
+
+    CargoDiagnosticsIndex& index = projects[run->project].index;
+    for (const CargoMessage& message : messages)
+    {
+        if (message.packageName.isEmpty()
+            || (message.reason != CargoMessage::CompilerMessage && message.reason != CargoMessage::CompilerArtifact))
+        {
+            continue;
+        }
+
+        // The first message about a package replaces what was known about it before
+        if (!run->packages.contains( message.packageName ))
+        {
+            run->packages.insert( message.packageName );
+            index.clearPackage( message.packageName );
+        }
+
+        const CargoSpan* span = message.primarySpan();
+        if (message.reason != CargoMessage::CompilerMessage || !span)
+        {
+            continue;
+        }
+
+        CargoDiagnostic diagnostic;
+        diagnostic.package = message.packageName;
+        diagnostic.fileName = Path( run->root, span->fileName ).toLocalFile();
+        diagnostic.text = message.text;
+        diagnostic.rendered = message.rendered;
+        diagnostic.code = message.code;
+        diagnostic.line = span->lineStart;
+        diagnostic.column = span->columnStart;
+        diagnostic.lineEnd = span->lineEnd;
+        diagnostic.columnEnd = span->columnEnd;
+        if (message.level.startsWith( QLatin1String("error") ))
+        {
+            diagnostic.severity = CargoDiagnostic::Error;
+        }
+        else if (message.level == QLatin1String("warning"))
+        {
+            diagnostic.severity = CargoDiagnostic::Warning;
+        }
+        else
+        {
+            diagnostic.severity = CargoDiagnostic::Hint;
+        }
+        index.addDiagnostic( diagnostic );
+    }
+
+    if (!publishTimer->isActive())
+    {
+        publishTimer->start();
+    }
+}
+
+void CargoProblemReporter::jobFinished( KJob* job )
+{
+    const Run run = runs.take( job );
+    auto it = projects.constFind( run.project );
+    if (it == projects.constEnd() || run.packages.isEmpty())
+    {
+        return;
+    }
+
+    publish();
+    if (!it->indexFile.isEmpty() && !it->index.save( it->indexFile ))
+    {
+        qCWarning(CUSTOMBUILDSYSTEM) << "Could not store diagnostics in" << it->indexFile;
+    }
+}
+
+void CargoProblemReporter::publish()
+{
+    publishTimer->stop();
+
+    QVector<IProblem::Ptr> problems;
+    for (const ProjectDiagnostics& diagnostics : qAsConst( projects ))
+    {
+        const QVector<CargoDiagnostic> all = diagnostics.index.allDiagnostics();
+        for (const CargoDiagnostic& diagnostic : all)
+        {
+            IProblem::Ptr problem( new DetectedProblem() );
+            problem->setSource( IProblem::Plugin );
+            problem->setDescription( diagnostic.code.isEmpty() ? diagnostic.text
+                                     : i18nc("<code>: <message>", "%1: %2", diagnostic.code, diagnostic.text) );
+            problem->setExplanation( diagnostic.rendered );
+
+            switch (diagnostic.severity)
+            {
+                case CargoDiagnostic::Error:
+                    problem->setSeverity( IProblem::Error );
+                    break;
+                case CargoDiagnostic::Warning:
+                    problem->setSeverity( IProblem::Warning );
+                    break;
+                case CargoDiagnostic::Hint:
+                    problem->setSeverity( IProblem::Hint );
+                    break;
+            }
+
+            // Cargo counts lines and columns from 1, KDevelop from 0
+            const KTextEditor::Range range( qMax( diagnostic.line - 1, 0 ), qMax( diagnostic.column - 1, 0 ),
+                                            qMax( diagnostic.lineEnd - 1, 0 ), qMax( diagnostic.columnEnd - 1, 0 ) );
+            problem->setFinalLocation( DocumentRange( IndexedString( diagnostic.fileName ), range ) );
+            problems << problem;
+        }
+    }
+    model->setProblems( problems );
+}
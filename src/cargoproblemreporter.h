@@ -0,0 +1,99 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOPROBLEMREPORTER_H
+#define CARGOPROBLEMREPORTER_H
+
+#include <util/path.h>
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+
+#include "cargodiagnosticsindex.h"
+#include "cargomessage.h"
+
+class KJob;
+class QTimer;
+class CargoBuildJob;
+
+namespace KDevelop
+{
+class IProject;
+class ProblemModel;
+}
+
+/**
+ * Shows the diagnostics of cargo jobs in the problem reporter.
+ *
+ * Diagnostics of each project are kept in a CargoDiagnosticsIndex, which is restored when the project is opened,
+ * so the problems are shown right away, before any cargo command runs.
+ *
+ * Every watched job refreshes the diagnostics incrementally: a package is replaced as soon as the job
+ * reports anything about it, and packages the job did not touch keep their previous diagnostics.
+ */
+class CargoProblemReporter : public QObject
+{
+Q_OBJECT
+public:
+    explicit CargoProblemReporter( QObject* parent = nullptr );
+    ~CargoProblemReporter() override;
+
+    /**
+     * Loads the diagnostics of @p project from @p indexFile, where they are stored again after each job.
+     */
+    void restore( KDevelop::IProject* project, const QString& indexFile );
+
+    /**
+     * Takes diagnostics from the messages of @p job, with file names relative to @p root.
+     */
+    void watch( CargoBuildJob* job, const KDevelop::Path& root );
+
+    void removeProject( KDevelop::IProject* project );
+
+private slots:
+    void jobFinished( KJob* job );
+    void publish();
+
+private:
+    void addMessages( CargoBuildJob* job, const QVector<CargoMessage>& messages );
+
+    struct ProjectDiagnostics
+    {
+        CargoDiagnosticsIndex index;
+        QString indexFile;
+    };
+
+    struct Run
+    {
+        KDevelop::IProject* project;
+        KDevelop::Path root;
+        QSet<QString> packages;
+    };
+
+    KDevelop::ProblemModel* model;
+    QTimer* publishTimer;
+    QHash<KDevelop::IProject*, ProjectDiagnostics> projects;
+    QHash<KJob*, Run> runs;
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargoprocess.h"
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#endif
+
+CargoProcess::CargoProcess( QObject* parent )
+    : QProcess( parent )
+{
+}
+
+CargoProcess::~CargoProcess()
+{
+}
+
+void CargoProcess::setInheritedDescriptors( const QVector<int>& descriptors )
+{
+    this->descriptors = descriptors;
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    setChildProcessModifier( [this]() { inheritDescriptors(); } );
+#endif
+}
+
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+void CargoProcess::setupChildProcess()
+{
+    inheritDescriptors();
+}
+#endif
+
+/**
+ * Runs in the forked child, so it only makes async-signal-safe calls.
+ */
+void CargoProcess::inheritDescriptors() const
+{
+#ifdef Q_OS_UNIX
+    for (int descriptor : descriptors)
+    {
+        const int flags = fcntl( descriptor, F_GETFD );
+        if (flags >= 0)
+        {
+            fcntl( descriptor, F_SETFD, flags & ~FD_CLOEXEC );
+        }
+    }
+#endif
+}
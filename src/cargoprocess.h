@@ -0,0 +1,59 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOPROCESS_H
+#define CARGOPROCESS_H
+
+#include <QProcess>
+#include <QVector>
+
+/**
+ * A process that inherits some descriptors of the plugin, such as the pipe of the jobserver.
+ *
+ * Descriptors of the plugin are opened close-on-exec, so that the processes it starts
+ * do not inherit them by accident. The ones set here are made inheritable in the child only,
+ * after it was forked and before it executes the program.
+ */
+class CargoProcess : public QProcess
+{
+Q_OBJECT
+public:
+    explicit CargoProcess( QObject* parent = nullptr );
+    ~CargoProcess() override;
+
+    /**
+     * Has to be called before the process is started.
+     */
+    void setInheritedDescriptors( const QVector<int>& descriptors );
+
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+protected:
+    void setupChildProcess() override;
+#endif
+
+private:
+    void inheritDescriptors() const;
+
+    QVector<int> descriptors;
+};
+
+#endif
@@ -0,0 +1,516 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargoprofilejob.h"
+#include "cargobuildjob.h"
+#include "cargooutputmodel.h"
+#include "cargoplugin.h"
+
+#include <KConfigGroup>
+#include <KLocalizedString>
+#include <KShell>
+
+#include <QDir>
+#include <QFile>
+#include <QRegularExpression>
+#include <QSet>
+#include <QStandardPaths>
+#include <QThread>
+
+#include <interfaces/ilaunchconfiguration.h>
+#include <interfaces/iproject.h>
+#include <outputview/outputdelegate.h>
+#include <project/projectmodel.h>
+#include <util/path.h>
+
+#include <algorithm>
+
+using namespace KDevelop;
+
+void CargoStackFolder::handleLine(QProcess::ProcessChannel channel, const QByteArray& line)
+{
+    // Frames look like "    55d0c1a2b3c4 crate::module::function+0x14 (/path/to/binary)"
+    static const QRegularExpression frameLine(QStringLiteral("^\\s+([0-9a-f]+)\\s+(.+?)\\s+\\((.*)\\)$"));
+
+    if (channel != QProcess::StandardOutput)
+    {
+        return;
+    }
+
+    if (line.trimmed().isEmpty())
+    {
+        finishSample();
+        return;
+    }
+
+    if (line.at(0) != ' ' && line.at(0) != '\t')
+    {
+        // The header of a sample, with the command, thread and event
+        finishSample();
+        return;
+    }
+
+    const QString text = QString::fromUtf8(line);
+    const QRegularExpressionMatch match = frameLine.match(text);
+    if (match.hasMatch())
+    {
+        Frame frame;
+        frame.name = match.captured(2);
+        const int offset = frame.name.lastIndexOf(QLatin1String("+0x"));
+        if (offset > 0)
+        {
+            frame.name.truncate(offset);
+        }
+        stack << frame;
+        return;
+    }
+
+    // With the srcline field, the source location of a frame follows it on its own line as file:line
+    const QString location = text.trimmed();
+    const int colon = location.lastIndexOf(QLatin1Char(':'));
+    if (!stack.isEmpty() && stack.last().fileName.isEmpty() && colon > 0)
+    {
+        bool ok = false;
+        const int lineNo = location.midRef(colon + 1).toInt(&ok);
+        const QString fileName = location.left(colon);
+        if (ok && lineNo > 0 && fileName != QLatin1String("??"))
+        {
+            stack.last().fileName = fileName;
+            stack.last().line = lineNo;
+        }
+    }
+}
+
+void CargoStackFolder::finish()
+{
+    finishSample();
+}
+
+void CargoStackFolder::finishSample()
+{
+    if (stack.isEmpty())
+    {
+        return;
+    }
+
+    ++sampleCount;
+
+    // perf lists the frames from the innermost function outwards
+    QStringList names;
+    names.reserve(stack.size());
+    QSet<QString> counted;
+    for (int i = stack.size() - 1; i >= 0; --i)
+    {
+        const Frame& frame = stack.at(i);
+        names << frame.name;
+
+        Function& function = functions[frame.name];
+        if (function.name.isEmpty())
+        {
+            function.name = frame.name;
+        }
+        if (function.fileName.isEmpty() && !frame.fileName.isEmpty())
+        {
+            function.fileName = frame.fileName;
+            function.line = frame.line;
+        }
+
+        // Recursive functions are only counted once per sample
+        if (!counted.contains(frame.name))
+        {
+            counted.insert(frame.name);
+            ++function.total;
+        }
+    }
+
+    ++functions[stack.first().name].self;
+    ++stacks[names.join(QLatin1Char(';'))];
+    stack.clear();
+}
+
+QVector<CargoStackFolder::Function> CargoStackFolder::hotFunctions(int count) const
+{
+    QVector<Function> ret;
+    ret.reserve(functions.size());
+    for (const Function& function : functions)
+    {
+        if (function.self > 0)
+        {
+            ret << function;
+        }
+    }
+
+    std::sort(ret.begin(), ret.end(), [](const Function& a, const Function& b) {
+        return a.self != b.self ? a.self > b.self : a.total > b.total;
+    });
+    if (ret.size() > count)
+    {
+        ret.resize(count);
+    }
+    return ret;
+}
+
+QVector<QPair<QString, int>> CargoStackFolder::hotStacks(int count) const
+{
+    QVector<QPair<QString, int>> ret;
+    ret.reserve(stacks.size());
+    for (auto it = stacks.constBegin(); it != stacks.constEnd(); ++it)
+    {
+        ret << qMakePair(it.key(), it.value());
+    }
+
+    std::sort(ret.begin(), ret.end(), [](const QPair<QString, int>& a, const QPair<QString, int>& b) {
+        return a.second > b.second;
+    });
+    if (ret.size() > count)
+    {
+        ret.resize(count);
+    }
+    return ret;
+}
+
+CargoProfileJob::CargoProfileJob( CargoPlugin* plugin, ILaunchConfiguration* config )
+    : OutputJob( nullptr, OutputJob::Verbose )
+    , plugin( plugin )
+    , project( config->project() )
+    , reader( nullptr )
+    , thread( nullptr )
+    , killed( false )
+{
+    setCapabilities( Killable );
+    setTitle( config->name() );
+    setObjectName( title() );
+    setDelegate( new KDevelop::OutputDelegate );
+
+    const KConfigGroup group = config->config();
+    programArguments = KShell::splitArgs( group.readEntry( "CargoArguments", "" ) );
+    buildArguments = plugin->targetArguments( config );
+    if (!buildArguments.isEmpty())
+    {
+        target = buildArguments.last();
+    }
+    buildArguments << plugin->profileArguments( config, argumentsError );
+}
+
+CargoProfileJob::~CargoProfileJob()
+{
+    if (thread)
+    {
+        // The reader is deleted in its own thread once the event loop quits
+        thread->quit();
+        thread->wait();
+    }
+}
+
+void CargoProfileJob::start()
+{
+    setStandardToolView( KDevelop::IOutputView::RunView );
+    setBehaviours( KDevelop::IOutputView::AllowUserClose | KDevelop::IOutputView::AutoScroll );
+    setModel( new CargoOutputModel( project->path().toUrl() ) );
+    startOutput();
+
+    perf = QStandardPaths::findExecutable( QStringLiteral("perf") );
+    if (perf.isEmpty())
+    {
+        fail( PerfNotFound, i18n( "Profiling needs perf, which was not found in PATH" ) );
+        return;
+    }
+
+    const QDir directory( Path( plugin->cacheDirectory( project ), QStringLiteral("profile") ).toLocalFile() );
+    directory.mkpath( QStringLiteral(".") );
+    dataFile = directory.filePath( QStringLiteral("perf.data") );
+
+    if (!argumentsError.isEmpty())
+    {
+        fail( BuildFailed, argumentsError );
+        return;
+    }
+
+    build = new CargoBuildJob( plugin, project->projectItem(), QStringLiteral("build") );
+    build->setJsonMessages( true );
+    build->setBackground( true );
+
+    // Symbols and source lines need debug info, also in release builds
+    build->setEnvironmentVariable( QStringLiteral("CARGO_PROFILE_DEV_DEBUG"), QStringLiteral("true") );
+    build->setEnvironmentVariable( QStringLiteral("CARGO_PROFILE_RELEASE_DEBUG"), QStringLiteral("true") );
+    build->setRunArguments( buildArguments );
+
+    connect( build.data(), &CargoBuildJob::messagesReceived, this, &CargoProfileJob::buildMessages );
+    connect( build.data(), &KJob::result, this, &CargoProfileJob::buildFinished );
+
+    model()->appendLine( i18n( "Building with debug info..." ) );
+    build->start();
+}
+
+bool CargoProfileJob::doKill()
+{
+    killed = true;
+    if (build)
+    {
+        build->kill( KJob::Quietly );
+    }
+    if (reader)
+    {
+        // Queued if the reader runs in its own thread
+        QMetaObject::invokeMethod( reader, "kill" );
+    }
+    return true;
+}
+
+CargoOutputModel* CargoProfileJob::model()
+{
+    return qobject_cast<CargoOutputModel*>( OutputJob::model() );
+}
+
+void CargoProfileJob::handleLine( QProcess::ProcessChannel channel, const QByteArray& line )
+{
+    Q_UNUSED( channel );
+    pending << FilteredItem( QString::fromUtf8( line ), FilteredItem::StandardItem );
+}
+
+void CargoProfileJob::buildMessages( const QVector<CargoMessage>& messages )
+{
+    for (const CargoMessage& message : messages)
+    {
+        if (message.reason == CargoMessage::CompilerMessage && message.level.startsWith( QLatin1String("error") ))
+        {
+            // The build runs in the background, so only its errors are shown here
+            for (const QString& line : message.rendered.trimmed().split( QLatin1Char('\n') ))
+            {
+                pending << FilteredItem( line, FilteredItem::ErrorItem );
+            }
+        }
+        else if (message.reason == CargoMessage::CompilerArtifact && !message.executable.isEmpty()
+                 && (message.targetKinds.contains( QStringLiteral("bin") ) || message.targetKinds.contains( QStringLiteral("example") )
+                     || message.targetKinds.contains( QStringLiteral("test") ) || message.targetKinds.contains( QStringLiteral("bench") ))
+                 && (target.isEmpty() ? executable.isEmpty() : message.targetName == target))
+        {
+            executable = message.executable;
+        }
+    }
+    flush();
+}
+
+void CargoProfileJob::buildFinished( KJob* job )
+{
+    if (killed)
+    {
+        return;
+    }
+
+    if (job->error())
+    {
+        fail( BuildFailed, i18n( "Building the executable failed" ) );
+        return;
+    }
+
+    if (executable.isEmpty())
+    {
+        fail( NoExecutable, i18n( "The build did not produce an executable to profile" ) );
+        return;
+    }
+
+    // perf keeps an existing file as perf.data.old, which must not be mistaken for this recording
+    QFile::remove( dataFile + QLatin1String(".old") );
+    if (QFile::exists( dataFile ) && !QFile::remove( dataFile ))
+    {
+        fail( RecordFailed, i18n( "Could not remove the previous profile %1", dataFile ) );
+        return;
+    }
+
+    const QStringList arguments = QStringList{ QStringLiteral("record"), QStringLiteral("-g"), QStringLiteral("-o"), dataFile,
+                                               QStringLiteral("--"), executable } + programArguments;
+    model()->appendLine( QStringLiteral("%1> %2 %3").arg( project->path().toLocalFile() ).arg( perf ).arg( KShell::joinArgs( arguments ) ) );
+
+    reader = new CargoOutputReader( this );
+    reader->setHandler( this );
+    reader->setProgram( perf, arguments );
+    reader->setWorkingDirectory( project->path().toLocalFile() );
+    connect( reader, &CargoOutputReader::linesRead, this, &CargoProfileJob::flush );
+    connect( reader, &CargoOutputReader::finished, this, &CargoProfileJob::recordFinished );
+    connect( reader, &CargoOutputReader::failed, this, &CargoProfileJob::readerFailed );
+    reader->start();
+}
+
+void CargoProfileJob::flush()
+{
+    if (pending.isEmpty())
+    {
+        return;
+    }
+
+    if (CargoOutputModel* model = this->model())
+    {
+        model->appendItems( pending );
+    }
+    pending.clear();
+}
+
+void CargoProfileJob::releaseReader()
+{
+    if (thread)
+    {
+        // The reader is deleted in its own thread once the event loop quits
+        thread->quit();
+    }
+    else if (reader)
+    {
+        reader->deleteLater();
+    }
+    reader = nullptr;
+}
+
+void CargoProfileJob::recordFinished( int exitCode )
+{
+    flush();
+    releaseReader();
+    if (killed)
+    {
+        return;
+    }
+
+    /*
+     * The exit code of perf record is the one of the program,
+     * which may well fail after running long enough to be profiled.
+     */
+    if (!QFile::exists( dataFile ))
+    {
+        fail( RecordFailed, i18n( "perf record did not write any samples" ) );
+        return;
+    }
+    if (exitCode != 0)
+    {
+        pending << FilteredItem( i18n( "The program exited with code %1", exitCode ), FilteredItem::WarningItem );
+    }
+
+    pending << FilteredItem( i18n( "Resolving call stacks..." ), FilteredItem::ActionItem );
+    flush();
+
+    // The folder is only used by the thread until finished() is delivered here
+    reader = new CargoOutputReader;
+    reader->setHandler( &folder );
+    reader->setProgram( perf, { QStringLiteral("script"), QStringLiteral("-F"), QStringLiteral("+srcline"),
+                                QStringLiteral("-i"), dataFile } );
+    reader->setWorkingDirectory( project->path().toLocalFile() );
+    thread = new QThread( this );
+    reader->moveToThread( thread );
+
+    connect( thread, &QThread::finished, reader, &QObject::deleteLater );
+    connect( reader, &CargoOutputReader::finished, this, &CargoProfileJob::scriptFinished );
+    connect( reader, &CargoOutputReader::failed, this, &CargoProfileJob::readerFailed );
+    thread->start();
+    QMetaObject::invokeMethod( reader, "start", Qt::QueuedConnection );
+}
+
+void CargoProfileJob::scriptFinished( int exitCode )
+{
+    releaseReader();
+    if (killed)
+    {
+        return;
+    }
+
+    if (exitCode != 0)
+    {
+        fail( RecordFailed, i18n( "perf script could not read %1", dataFile ) );
+        return;
+    }
+
+    folder.finish();
+    report();
+    emitResult();
+}
+
+void CargoProfileJob::readerFailed( QProcess::ProcessError error )
+{
+    flush();
+    releaseReader();
+    if (killed)
+    {
+        return;
+    }
+
+    if (error == QProcess::FailedToStart)
+    {
+        fail( RecordFailed, i18n( "Could not start %1", perf ) );
+    }
+    else
+    {
+        fail( RecordFailed, i18n( "perf crashed" ) );
+    }
+}
+
+void CargoProfileJob::fail( int error, const QString& text )
+{
+    flush();
+    if (CargoOutputModel* model = this->model())
+    {
+        model->appendItems( { FilteredItem( text, FilteredItem::ErrorItem ) } );
+    }
+    setError( error );
+    setErrorText( text );
+    emitResult();
+}
+
+void CargoProfileJob::report()
+{
+    const int samples = folder.samples();
+    if (samples == 0)
+    {
+        pending << FilteredItem( i18n( "No samples were recorded" ), FilteredItem::WarningItem );
+        flush();
+        return;
+    }
+
+    pending << FilteredItem( i18np( "Hot functions in %1 sample:", "Hot functions in %1 samples:", samples ), FilteredItem::ActionItem );
+    pending << FilteredItem( i18nc( "column headers of the profile", "  Self   Total  Function" ), FilteredItem::InformationItem );
+
+    for (const CargoStackFolder::Function& function : folder.hotFunctions( ReportedEntries ))
+    {
+        FilteredItem item( QStringLiteral("%1% %2%  %3")
+                               .arg( 100.0 * function.self / samples, 5, 'f', 1 )
+                               .arg( 100.0 * function.total / samples, 5, 'f', 1 )
+                               .arg( function.name ),
+                           FilteredItem::InformationItem );
+        if (!function.fileName.isEmpty())
+        {
+            // Like the compiler, perf counts lines from 1, see CargoFilterStrategy::errorInLine()
+            item.isActivatable = true;
+            item.url = Path( project->path(), function.fileName ).toUrl();
+            item.lineNo = function.line - 1;
+            item.columnNo = 0;
+            item.originalLine += QStringLiteral(" (%1:%2)").arg( function.fileName ).arg( function.line );
+        }
+        pending << item;
+    }
+
+    // The stacks are folded like the input of flame graphs, from the outermost function inwards
+    pending << FilteredItem( i18n( "Hottest call stacks:" ), FilteredItem::ActionItem );
+    for (const auto& stack : folder.hotStacks( ReportedEntries ))
+    {
+        pending << FilteredItem( QStringLiteral("%1% %2").arg( 100.0 * stack.second / samples, 5, 'f', 1 ).arg( stack.first ),
+                                 FilteredItem::StandardItem );
+    }
+
+    pending << FilteredItem( i18n( "Recorded profile: %1", dataFile ), FilteredItem::InformationItem );
+    flush();
+}
@@ -0,0 +1,162 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOPROFILEJOB_H
+#define CARGOPROFILEJOB_H
+
+#include <outputview/filtereditem.h>
+#include <outputview/outputjob.h>
+
+#include <QHash>
+#include <QPointer>
+#include <QProcess>
+#include <QVector>
+
+#include "cargomessage.h"
+#include "cargooutputreader.h"
+
+class CargoPlugin;
+class CargoBuildJob;
+class CargoOutputModel;
+class QThread;
+
+namespace KDevelop
+{
+class ILaunchConfiguration;
+class IProject;
+}
+
+/**
+ * Folds the call stacks printed by perf script into the time spent in each function and each stack.
+ */
+class CargoStackFolder : public CargoLineHandler
+{
+public:
+    struct Function
+    {
+        QString name;
+        QString fileName;
+        int line = -1;
+        int self = 0;
+        int total = 0;
+    };
+
+    void handleLine(QProcess::ProcessChannel channel, const QByteArray& line) override;
+
+    /**
+     * Completes the last sample, must be called after the last line
+     */
+    void finish();
+
+    int samples() const { return sampleCount; }
+
+    /**
+     * @return the functions with the most samples of their own, at most @p count of them
+     */
+    QVector<Function> hotFunctions(int count) const;
+
+    /**
+     * @return the stacks with the most samples, from the outermost function to the innermost,
+     * joined with semicolons like in the input of flame graphs
+     */
+    QVector<QPair<QString, int>> hotStacks(int count) const;
+
+private:
+    struct Frame
+    {
+        QString name;
+        QString fileName;
+        int line = -1;
+    };
+
+    void finishSample();
+
+    QVector<Frame> stack;
+    QHash<QString, Function> functions;
+    QHash<QString, int> stacks;
+    int sampleCount = 0;
+};
+
+/**
+ * Profiles an executable of the project with perf.
+ *
+ * The executable is built with debug info, then run under perf record -g,
+ * and the recorded call stacks are folded into a table of hot functions and stacks
+ * that is shown in the output, with functions linked to their source lines.
+ * The output of perf script is read and folded in its own thread, as that can be millions of lines.
+ */
+class CargoProfileJob : public KDevelop::OutputJob, public CargoLineHandler
+{
+Q_OBJECT
+public:
+    enum ErrorType {
+        PerfNotFound = UserDefinedError,
+        BuildFailed,
+        NoExecutable,
+        RecordFailed
+    };
+
+    /// Number of functions and stacks shown after profiling
+    static const int ReportedEntries = 20;
+
+    CargoProfileJob( CargoPlugin* plugin, KDevelop::ILaunchConfiguration* config );
+    ~CargoProfileJob() override;
+
+    void start() override;
+
+    void handleLine( QProcess::ProcessChannel channel, const QByteArray& line ) override;
+
+protected:
+    bool doKill() override;
+
+private slots:
+    void buildMessages( const QVector<CargoMessage>& messages );
+    void buildFinished( KJob* job );
+    void flush();
+    void recordFinished( int exitCode );
+    void scriptFinished( int exitCode );
+    void readerFailed( QProcess::ProcessError error );
+
+private:
+    CargoOutputModel* model();
+    void releaseReader();
+    void fail( int error, const QString& text );
+    void report();
+
+    CargoPlugin* plugin;
+    KDevelop::IProject* project;
+    QString target;
+    QStringList buildArguments;
+    QString argumentsError;
+    QStringList programArguments;
+    QString perf;
+    QString dataFile;
+    QString executable;
+    QPointer<CargoBuildJob> build;
+    CargoOutputReader* reader;
+    QThread* thread;
+    CargoStackFolder folder;
+    QVector<KDevelop::FilteredItem> pending;
+    bool killed;
+};
+
+#endif
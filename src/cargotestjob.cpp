@@ -0,0 +1,509 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargotestjob.h"
+#include "cargobuildcoordinator.h"
+#include "cargotestsuite.h"
+#include "cargooutputmodel.h"
+#include "cargoplugin.h"
+
+#include <KLocalizedString>
+#include <KShell>
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+
+#include <interfaces/icore.h>
+#include <interfaces/iproject.h>
+#include <outputview/outputdelegate.h>
+
+using namespace KDevelop;
+
+CargoTestJob::CargoTestJob( CargoTestSuite* suite, const QStringList& cases, ITestSuite::TestJobVerbosity verbosity )
+    : OutputJob( nullptr, verbosity == ITestSuite::Verbose ? OutputJob::Verbose : OutputJob::Silent )
+    , suite( suite )
+    , suiteName( suite->name() )
+    , coordinator( nullptr )
+    , jobs( 0 )
+    , cases( cases )
+    , allCases( false )
+    , shards( 1 )
+    , running( 0 )
+    , killed( false )
+    , failed( false )
+{
+    setCapabilities( Killable );
+    setTitle( i18n( "Cargo test %1", suite->name() ) );
+    setObjectName( title() );
+    setDelegate( new KDevelop::OutputDelegate );
+}
+
+CargoTestJob::~CargoTestJob()
+{
+}
+
+void CargoTestJob::start()
+{
+    setStandardToolView( KDevelop::IOutputView::TestView );
+    setBehaviours( KDevelop::IOutputView::AllowUserClose | KDevelop::IOutputView::AutoScroll );
+    CargoOutputModel* model = new CargoOutputModel( suite->workingDirectory().toUrl() );
+    setModel( model );
+    startOutput();
+
+    // Discovery rebuilds the harness if its sources changed, and is shared with the other suites of the project
+    plugin = dynamic_cast<CargoPlugin*>( suite->project()->buildSystemManager() );
+    if (plugin)
+    {
+        coordinator = plugin->buildCoordinator();
+        targetDirectory = plugin->targetDirectory( suite->project() ).toLocalFile();
+        jobs = plugin->cargoEnvironment( suite->project() ).value( QStringLiteral("CARGO_BUILD_JOBS") ).toInt();
+        connect( this, &KJob::finished, coordinator, [this]() {
+            coordinator->release( this );
+        });
+    }
+
+    discovery = plugin ? plugin->discoverTests( suite->project() ) : nullptr;
+    if (discovery)
+    {
+        model->appendLine( i18n( "Building the tests of %1", suite->project()->name() ) );
+        connect( discovery.data(), &KJob::result, this, &CargoTestJob::discoveryFinished );
+    }
+    else
+    {
+        acquireDirectory();
+    }
+}
+
+void CargoTestJob::discoveryFinished()
+{
+    if (killed)
+    {
+        return;
+    }
+
+    // The suites are updated by the plugin before this, and the harness may be gone
+    if (!hasSuite())
+    {
+        suiteRemoved();
+        return;
+    }
+
+    if (discovery->error())
+    {
+        ICore::self()->testController()->notifyTestRunStarted( suite, cases );
+        pending << FilteredItem( discovery->errorText(), FilteredItem::ErrorItem );
+        flush();
+        failed = true;
+        reportResults();
+        setError( FailedShownError );
+        emitResult();
+        return;
+    }
+
+    if (allCases)
+    {
+        cases = suite->cases();
+    }
+    acquireDirectory();
+}
+
+/**
+ * The plugin deletes suites whose harness is gone, and all suites of a closed project,
+ * so the suite is only used while it is still known to the plugin.
+ */
+bool CargoTestJob::hasSuite() const
+{
+    return plugin && plugin->hasTestSuite( suite );
+}
+
+void CargoTestJob::suiteRemoved()
+{
+    pending << FilteredItem( i18n( "The test harness %1 no longer exists", suiteName ), FilteredItem::ErrorItem );
+    flush();
+    setError( FailedShownError );
+    emitResult();
+}
+
+void CargoTestJob::acquireDirectory()
+{
+    if (!coordinator)
+    {
+        startHarness();
+    }
+    else if (!coordinator->acquire( targetDirectory, this, [this]() { startHarness(); }, jobs ))
+    {
+        emit infoMessage( this, i18n( "Waiting for another build in %1", targetDirectory ) );
+    }
+}
+
+/**
+ * Upper bound for the length of the test names passed to one run of a harness,
+ * below the limit on the command line on every platform.
+ */
+static const int MaxBatchLength = 24 * 1024;
+
+void CargoTestJob::startHarness()
+{
+    // The suite can be removed while the run waits for the directory, the harness is run from copies
+    if (!hasSuite())
+    {
+        suiteRemoved();
+        return;
+    }
+    executable = suite->executable();
+    workingDirectory = suite->workingDirectory();
+
+    ICore::self()->testController()->notifyTestRunStarted( suite, cases );
+
+    const int count = (allCases && shards == 1) ? 1 : qMin( shards, cases.size() );
+    if (count == 0)
+    {
+        reportResults();
+        emitResult();
+        return;
+    }
+
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert( QStringLiteral("RUSTC_BOOTSTRAP"), QStringLiteral("1") );
+
+    // Tests that build something themselves, for example with cargo, share the jobserver of the run
+    const QString makeFlags = coordinator ? coordinator->makeFlags( this ) : QString();
+    const bool useJobserver = !makeFlags.isEmpty() && !environment.contains( QStringLiteral("CARGO_MAKEFLAGS") );
+    if (useJobserver)
+    {
+        environment.insert( QStringLiteral("CARGO_MAKEFLAGS"), makeFlags );
+    }
+
+    runs.resize( count );
+    for (int i = 0; i < count; ++i)
+    {
+        Shard& shard = runs[i];
+        if (allCases && count == 1)
+        {
+            shard.batches << QStringList();
+        }
+        else
+        {
+            QStringList batch;
+            int length = 0;
+            for (int j = i; j < cases.size(); j += count)
+            {
+                if (!batch.isEmpty() && length + cases.at( j ).size() > MaxBatchLength)
+                {
+                    shard.batches << batch;
+                    batch.clear();
+                    length = 0;
+                }
+                batch << cases.at( j );
+                length += cases.at( j ).size() + 1;
+            }
+            shard.batches << batch;
+        }
+
+        shard.reader = new CargoOutputReader( this );
+        shard.reader->setHandler( this );
+        shard.reader->setProgram( executable.toLocalFile(), harnessArguments( shard.batches.first() ) );
+        shard.reader->setWorkingDirectory( workingDirectory.toLocalFile() );
+        shard.reader->setEnvironment( environment );
+        if (useJobserver)
+        {
+            shard.reader->setInheritedDescriptors( coordinator->descriptors( this ) );
+        }
+        connect( shard.reader, &CargoOutputReader::linesRead, this, &CargoTestJob::flush );
+        connect( shard.reader, &CargoOutputReader::finished, this, &CargoTestJob::shardFinished );
+        connect( shard.reader, &CargoOutputReader::failed, this, &CargoTestJob::shardFailed );
+    }
+
+    CargoOutputModel* model = qobject_cast<CargoOutputModel*>( OutputJob::model() );
+    if (count == 1 && runs.first().batches.size() == 1)
+    {
+        model->appendLine( QStringLiteral("%1> %2 %3").arg( workingDirectory.toLocalFile() )
+                           .arg( executable.toLocalFile() )
+                           .arg( KShell::joinArgs( harnessArguments( runs.first().batches.first() ) ) ) );
+    }
+    else
+    {
+        // The command lines list every test, which is too long to show
+        model->appendLine( i18n( "Running %1 tests of %2 in %3 processes", cases.size(),
+                                 executable.toLocalFile(), count ) );
+    }
+
+    running = runs.size();
+    for (const Shard& shard : qAsConst( runs ))
+    {
+        shard.reader->start();
+    }
+}
+
+QStringList CargoTestJob::harnessArguments( const QStringList& batch ) const
+{
+    QStringList arguments = { QStringLiteral("-Z"), QStringLiteral("unstable-options"), QStringLiteral("--format=json") };
+    if (runs.size() > 1)
+    {
+        // The shards already run in parallel, so each gets a share of the threads
+        const int threads = qMax( QThread::idealThreadCount() / runs.size(), 1 );
+        arguments << QStringLiteral("--test-threads") << QString::number( threads );
+    }
+
+    if (!batch.isEmpty())
+    {
+        arguments << QStringLiteral("--exact") << batch;
+    }
+    return arguments;
+}
+
+bool CargoTestJob::doKill()
+{
+    killed = true;
+    if (discovery)
+    {
+        // Other test jobs may be waiting for the same discovery, so it is left running
+        discovery->disconnect( this );
+    }
+    for (const Shard& shard : qAsConst( runs ))
+    {
+        shard.reader->kill();
+    }
+    reportResults();
+    return true;
+}
+
+void CargoTestJob::handleLine( QProcess::ProcessChannel channel, const QByteArray& line )
+{
+    if (channel == QProcess::StandardOutput && line.startsWith( '{' ))
+    {
+        const QJsonObject object = QJsonDocument::fromJson( line ).object();
+        if (object.value( QStringLiteral("type") ).toString() == QLatin1String("test"))
+        {
+            testFinished( object.value( QStringLiteral("name") ).toString(),
+                          object.value( QStringLiteral("event") ).toString(),
+                          object.value( QStringLiteral("stdout") ).toString() );
+            return;
+        }
+
+        if (!object.isEmpty())
+        {
+            // Suite events are summarized when all the shards finish
+            return;
+        }
+    }
+
+    pending << FilteredItem( QString::fromUtf8( line ), FilteredItem::StandardItem );
+}
+
+void CargoTestJob::testFinished( const QString& name, const QString& event, const QString& output )
+{
+    TestResult::TestCaseResult caseResult;
+    FilteredItem::FilteredOutputItemType type = FilteredItem::StandardItem;
+    if (event == QLatin1String("ok"))
+    {
+        caseResult = TestResult::Passed;
+    }
+    else if (event == QLatin1String("failed"))
+    {
+        caseResult = TestResult::Failed;
+        type = FilteredItem::ErrorItem;
+    }
+    else if (event == QLatin1String("ignored"))
+    {
+        caseResult = TestResult::Skipped;
+        type = FilteredItem::InformationItem;
+    }
+    else
+    {
+        // Tests that started, or are taking long
+        return;
+    }
+
+    result.testCaseResults[name] = caseResult;
+    pending << FilteredItem( QStringLiteral("test %1 ... %2").arg( name, event ), type );
+
+    QStringList lines = output.split( QLatin1Char('\n') );
+    while (!lines.isEmpty() && lines.last().isEmpty())
+    {
+        lines.removeLast();
+    }
+    for (const QString& line : qAsConst( lines ))
+    {
+        pending << FilteredItem( line, FilteredItem::StandardItem );
+    }
+}
+
+void CargoTestJob::flush()
+{
+    if (pending.isEmpty())
+    {
+        return;
+    }
+
+    if (CargoOutputModel* model = qobject_cast<CargoOutputModel*>( OutputJob::model() ))
+    {
+        model->appendItems( pending );
+    }
+    pending.clear();
+}
+
+CargoTestJob::Shard* CargoTestJob::shardOf( QObject* reader )
+{
+    for (Shard& shard : runs)
+    {
+        if (shard.reader == reader)
+        {
+            return &shard;
+        }
+    }
+    return nullptr;
+}
+
+bool CargoTestJob::hasFailures( const QStringList& batch ) const
+{
+    for (auto it = result.testCaseResults.constBegin(); it != result.testCaseResults.constEnd(); ++it)
+    {
+        if (it.value() == TestResult::Failed && (batch.isEmpty() || batch.contains( it.key() )))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CargoTestJob::shardFinished( int exitCode )
+{
+    Shard* shard = shardOf( sender() );
+    if (!shard || killed)
+    {
+        finishShard();
+        return;
+    }
+
+    // The harness exits with 101 when tests fail, which is reported per test, anything else is an error
+    if (exitCode != 0 && !hasFailures( shard->batches.at( shard->current ) ))
+    {
+        failed = true;
+        pending << FilteredItem( i18n( "Test harness exited with code %1", exitCode ), FilteredItem::ErrorItem );
+    }
+
+    if (++shard->current < shard->batches.size())
+    {
+        shard->reader->setProgram( executable.toLocalFile(), harnessArguments( shard->batches.at( shard->current ) ) );
+        shard->reader->start();
+        return;
+    }
+    finishShard();
+}
+
+void CargoTestJob::shardFailed( QProcess::ProcessError error )
+{
+    if (!killed)
+    {
+        failed = true;
+        if (error == QProcess::FailedToStart)
+        {
+            pending << FilteredItem( i18n( "Could not start %1", executable.toLocalFile() ), FilteredItem::ErrorItem );
+        }
+        else
+        {
+            pending << FilteredItem( i18n( "Test harness crashed" ), FilteredItem::ErrorItem );
+        }
+    }
+    finishShard();
+}
+
+void CargoTestJob::finishShard()
+{
+    if (--running > 0 || killed)
+    {
+        return;
+    }
+
+    flush();
+    reportResults();
+
+    int passed = 0, failures = 0, skipped = 0;
+    for (auto it = result.testCaseResults.constBegin(); it != result.testCaseResults.constEnd(); ++it)
+    {
+        switch (it.value())
+        {
+            case TestResult::Passed:
+                ++passed;
+                break;
+            case TestResult::Skipped:
+                ++skipped;
+                break;
+            case TestResult::NotRun:
+                break;
+            default:
+                ++failures;
+                break;
+        }
+    }
+
+    if (CargoOutputModel* model = qobject_cast<CargoOutputModel*>( OutputJob::model() ))
+    {
+        model->appendLine( i18n( "%1 passed, %2 failed, %3 ignored", passed, failures, skipped ) );
+    }
+
+    if (result.suiteResult != TestResult::Passed)
+    {
+        setError( FailedShownError );
+    }
+    emitResult();
+}
+
+void CargoTestJob::reportResults()
+{
+    // Tests without a result did not run, because the harness crashed or was killed
+    for (const QString& testCase : qAsConst( cases ))
+    {
+        if (!result.testCaseResults.contains( testCase ))
+        {
+            result.testCaseResults[testCase] = failed ? TestResult::Error : TestResult::NotRun;
+        }
+    }
+
+    result.suiteResult = TestResult::Passed;
+    if (failed)
+    {
+        result.suiteResult = TestResult::Error;
+    }
+    else if (killed)
+    {
+        result.suiteResult = TestResult::NotRun;
+    }
+    else
+    {
+        for (auto it = result.testCaseResults.constBegin(); it != result.testCaseResults.constEnd(); ++it)
+        {
+            if (it.value() == TestResult::Failed)
+            {
+                result.suiteResult = TestResult::Failed;
+                break;
+            }
+        }
+    }
+
+    if (hasSuite())
+    {
+        ICore::self()->testController()->notifyTestRunFinished( suite, result );
+    }
+}
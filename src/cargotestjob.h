@@ -0,0 +1,127 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOTESTJOB_H
+#define CARGOTESTJOB_H
+
+#include <interfaces/itestcontroller.h>
+#include <interfaces/itestsuite.h>
+#include <outputview/filtereditem.h>
+#include <outputview/outputjob.h>
+#include <util/path.h>
+
+#include <QHash>
+#include <QPointer>
+#include <QProcess>
+#include <QVector>
+
+#include "cargooutputreader.h"
+
+class CargoBuildCoordinator;
+class CargoOutputModel;
+class CargoPlugin;
+class CargoTestSuite;
+
+/**
+ * Runs tests of a CargoTestSuite and reports their results to the test controller.
+ *
+ * The harness is run with libtest's JSON output, which needs -Z unstable-options
+ * and is allowed on stable toolchains with RUSTC_BOOTSTRAP=1.
+ * Results are shown in the output view as soon as each test finishes.
+ *
+ * The tests are discovered first, which rebuilds the harness if its sources changed.
+ * The harness then holds the target directory in the CargoBuildCoordinator, so that no build replaces it
+ * while it runs, and tests that start cargo or make themselves use the jobserver of the run.
+ *
+ * With more than one shard, the tests are partitioned between that many processes of the harness,
+ * each running its share of the tests selected by exact name.
+ * Long lists of names are split into batches that are run one after another by the same shard,
+ * to stay below the limit on the length of a command line.
+ */
+class CargoTestJob : public KDevelop::OutputJob, public CargoLineHandler
+{
+Q_OBJECT
+public:
+    CargoTestJob( CargoTestSuite* suite, const QStringList& cases, KDevelop::ITestSuite::TestJobVerbosity verbosity );
+    ~CargoTestJob() override;
+
+    /**
+     * Runs the whole harness instead of selecting the cases by name, if there is only one shard
+     */
+    void setAllCases( bool allCases ) { this->allCases = allCases; }
+    void setShards( int shards ) { this->shards = qMax( shards, 1 ); }
+
+    void start() override;
+
+    void handleLine( QProcess::ProcessChannel channel, const QByteArray& line ) override;
+
+protected:
+    bool doKill() override;
+
+private slots:
+    void discoveryFinished();
+    void flush();
+    void shardFinished( int exitCode );
+    void shardFailed( QProcess::ProcessError error );
+
+private:
+    struct Shard
+    {
+        CargoOutputReader* reader = nullptr;
+        /// The cases passed to each run of the harness, an empty batch runs all of them
+        QVector<QStringList> batches;
+        int current = 0;
+    };
+
+    bool hasSuite() const;
+    void suiteRemoved();
+    void acquireDirectory();
+    void startHarness();
+    QStringList harnessArguments( const QStringList& batch ) const;
+    bool hasFailures( const QStringList& batch ) const;
+    Shard* shardOf( QObject* reader );
+    void finishShard();
+    void reportResults();
+    void testFinished( const QString& name, const QString& event, const QString& output );
+
+    CargoTestSuite* suite;
+    QString suiteName;
+    QPointer<CargoPlugin> plugin;
+    KDevelop::Path executable;
+    KDevelop::Path workingDirectory;
+    QPointer<KJob> discovery;
+    CargoBuildCoordinator* coordinator;
+    QString targetDirectory;
+    /// The parallel jobs configured for the project, which limit the jobserver of the run
+    int jobs;
+    QStringList cases;
+    bool allCases;
+    int shards;
+    int running;
+    bool killed;
+    bool failed;
+    QVector<Shard> runs;
+    QVector<KDevelop::FilteredItem> pending;
+    KDevelop::TestResult result;
+};
+
+#endif
@@ -0,0 +1,432 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cargotestsuite.h"
+#include "cargobuildcoordinator.h"
+#include "cargotestjob.h"
+#include "cargomessage.h"
+#include "cargoplugin.h"
+#include "cargoprocess.h"
+#include "debug.h"
+
+#include <KLocalizedString>
+#include <KConfigGroup>
+#include <KSharedConfig>
+
+#include <interfaces/iproject.h>
+#include <language/duchain/indexeddeclaration.h>
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTimer>
+
+using namespace KDevelop;
+
+static const quint32 CacheMagic = 0x4b444374;
+
+/**
+ * Must be increased whenever the layout of the cache file changes.
+ */
+static const quint32 CacheVersion = 1;
+
+void CargoTestBinary::updateFingerprint()
+{
+    const QFileInfo info( executable.toLocalFile() );
+    modified = info.lastModified().toMSecsSinceEpoch();
+    size = info.size();
+}
+
+bool CargoTestBinary::isUpToDate() const
+{
+    const QFileInfo info( executable.toLocalFile() );
+    return info.exists() && info.lastModified().toMSecsSinceEpoch() == modified && info.size() == size;
+}
+
+const CargoTestBinary* CargoTestCache::find( const CargoTestBinary& binary ) const
+{
+    for (const CargoTestBinary& cached : m_binaries)
+    {
+        if (cached.executable == binary.executable)
+        {
+            return (cached.modified == binary.modified && cached.size == binary.size) ? &cached : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+CargoTestCache CargoTestCache::load( const QString& fileName )
+{
+    CargoTestCache cache;
+    QFile file( fileName );
+    if (!file.open( QIODevice::ReadOnly ))
+    {
+        return cache;
+    }
+
+    QDataStream stream( &file );
+    stream.setVersion( QDataStream::Qt_5_6 );
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+    if (magic != CacheMagic || version != CacheVersion)
+    {
+        return cache;
+    }
+
+    QVector<CargoTestBinary> binaries;
+    stream >> binaries;
+    if (stream.status() == QDataStream::Ok)
+    {
+        cache.m_binaries = binaries;
+    }
+    return cache;
+}
+
+bool CargoTestCache::save( const QString& fileName ) const
+{
+    QDir().mkpath( QFileInfo( fileName ).absolutePath() );
+
+    QSaveFile file( fileName );
+    if (!file.open( QIODevice::WriteOnly ))
+    {
+        return false;
+    }
+
+    QDataStream stream( &file );
+    stream.setVersion( QDataStream::Qt_5_6 );
+    stream << CacheMagic << CacheVersion << m_binaries;
+    return file.commit();
+}
+
+QDataStream& operator<<( QDataStream& stream, const CargoTestBinary& binary )
+{
+    return stream << binary.name << binary.executable.toLocalFile() << binary.workingDirectory.toLocalFile()
+                  << binary.cases << binary.modified << binary.size;
+}
+
+QDataStream& operator>>( QDataStream& stream, CargoTestBinary& binary )
+{
+    QString executable, workingDirectory;
+    stream >> binary.name >> executable >> workingDirectory >> binary.cases >> binary.modified >> binary.size;
+    binary.executable = Path( executable );
+    binary.workingDirectory = Path( workingDirectory );
+    return stream;
+}
+
+CargoTestSuite::CargoTestSuite( IProject* project, const CargoTestBinary& binary )
+    : m_project( project )
+    , binary( binary )
+{
+}
+
+CargoTestSuite::~CargoTestSuite()
+{
+}
+
+QString CargoTestSuite::name() const
+{
+    return binary.name;
+}
+
+QStringList CargoTestSuite::cases() const
+{
+    return binary.cases;
+}
+
+IProject* CargoTestSuite::project() const
+{
+    return m_project;
+}
+
+KJob* CargoTestSuite::launchAllCases( TestJobVerbosity verbosity )
+{
+    return launch( binary.cases, true, verbosity );
+}
+
+KJob* CargoTestSuite::launchCases( const QStringList& testCases, TestJobVerbosity verbosity )
+{
+    return launch( testCases, false, verbosity );
+}
+
+KJob* CargoTestSuite::launchCase( const QString& testCase, TestJobVerbosity verbosity )
+{
+    return launch( { testCase }, false, verbosity );
+}
+
+KJob* CargoTestSuite::launch( const QStringList& testCases, bool allCases, TestJobVerbosity verbosity )
+{
+    KConfigGroup group = m_project->projectConfiguration()->group( "Cargo" );
+    auto job = new CargoTestJob( this, testCases, verbosity );
+    job->setAllCases( allCases );
+    job->setShards( group.readEntry( "TestShards", 1 ) );
+    return job;
+}
+
+IndexedDeclaration CargoTestSuite::declaration() const
+{
+    return IndexedDeclaration();
+}
+
+IndexedDeclaration CargoTestSuite::caseDeclaration( const QString& testCase ) const
+{
+    Q_UNUSED( testCase );
+    return IndexedDeclaration();
+}
+
+CargoTestDiscoveryJob::CargoTestDiscoveryJob( IProject* project, const CargoMetadata& metadata,
+                                              const QString& cacheFile, QObject* parent )
+    : KJob( parent )
+    , m_project( project )
+    , m_coordinator( nullptr )
+    , m_metadata( metadata )
+    , m_cacheFile( cacheFile )
+    , m_current( 0 )
+    , m_environment( QProcessEnvironment::systemEnvironment() )
+{
+    setObjectName( i18n( "Discovering tests of %1", project->name() ) );
+    setCapabilities( Killable );
+}
+
+CargoTestDiscoveryJob::~CargoTestDiscoveryJob()
+{
+}
+
+void CargoTestDiscoveryJob::setCoordinator( CargoBuildCoordinator* coordinator, const QString& targetDirectory )
+{
+    m_coordinator = coordinator;
+    m_targetDirectory = targetDirectory;
+
+    connect( this, &KJob::finished, coordinator, [this, coordinator]() {
+        coordinator->release( this );
+    });
+}
+
+void CargoTestDiscoveryJob::start()
+{
+    if (!m_project)
+    {
+        QTimer::singleShot( 0, this, &CargoTestDiscoveryJob::emitResult );
+        return;
+    }
+
+    if (!m_coordinator)
+    {
+        startBuild();
+    }
+    else if (!m_coordinator->acquire( m_targetDirectory, this, [this]() { startBuild(); },
+                                      m_environment.value( QStringLiteral("CARGO_BUILD_JOBS") ).toInt() ))
+    {
+        emit infoMessage( this, i18n( "Waiting for another build in %1", m_targetDirectory ) );
+    }
+}
+
+void CargoTestDiscoveryJob::startBuild()
+{
+    if (!m_project)
+    {
+        emitResult();
+        return;
+    }
+
+    auto process = new CargoProcess( this );
+    const QString makeFlags = m_coordinator ? m_coordinator->makeFlags( this ) : QString();
+    if (!makeFlags.isEmpty() && !m_environment.contains( QStringLiteral("CARGO_MAKEFLAGS") ))
+    {
+        m_environment.insert( QStringLiteral("CARGO_MAKEFLAGS"), makeFlags );
+        process->setInheritedDescriptors( m_coordinator->descriptors( this ) );
+    }
+    m_process = process;
+    m_process->setWorkingDirectory( m_project->path().toLocalFile() );
+    m_process->setProcessEnvironment( m_environment );
+    connect( m_process, static_cast<void(QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+             this, &CargoTestDiscoveryJob::buildFinished );
+    connect( m_process, &QProcess::errorOccurred, this, &CargoTestDiscoveryJob::procError );
+
+    m_process->start( CargoPlugin::cargoExecutable(), QStringList{
+        QStringLiteral("test"),
+        QStringLiteral("--no-run"),
+        QStringLiteral("--message-format=json")
+    } + m_configArguments );
+}
+
+bool CargoTestDiscoveryJob::doKill()
+{
+    if (m_process)
+    {
+        m_process->disconnect( this );
+        m_process->kill();
+    }
+    return true;
+}
+
+/*
+ * Like with the metadata, failures to list the tests of a harness are only logged.
+ * The harness simply has no tests until the next successful discovery.
+ * A failed build is an error, so the tests that are already known are kept.
+ */
+
+void CargoTestDiscoveryJob::buildFinished( int exitCode, QProcess::ExitStatus exitStatus )
+{
+    if (exitStatus != QProcess::NormalExit || exitCode != 0)
+    {
+        qCWarning(CUSTOMBUILDSYSTEM) << "Building tests failed:" << m_process->readAllStandardError();
+        setError( UserDefinedError );
+        setErrorText( i18n( "Could not build the tests of %1", m_project ? m_project->name() : QString() ) );
+        emitResult();
+        return;
+    }
+
+    const QList<QByteArray> lines = m_process->readAllStandardOutput().split( '\n' );
+    m_process->deleteLater();
+
+    for (const QByteArray& line : lines)
+    {
+        const CargoMessage message = CargoMessageParser::parse( line );
+        if (message.reason != CargoMessage::CompilerArtifact || !message.test || message.executable.isEmpty())
+        {
+            continue;
+        }
+
+        CargoTestBinary binary;
+        binary.name = QStringLiteral("%1::%2 (%3)").arg( message.packageName, message.targetName,
+                                                          message.targetKinds.value( 0 ) );
+        binary.executable = Path( message.executable );
+
+        // Cargo runs tests in the directory of their package
+        binary.workingDirectory = m_project->path();
+        for (const CargoPackage& package : qAsConst( m_metadata.packages ))
+        {
+            if (package.id == message.packageId)
+            {
+                binary.workingDirectory = package.directory();
+                break;
+            }
+        }
+        binary.updateFingerprint();
+        m_binaries << binary;
+    }
+
+    // The cache is only needed once the harnesses are known
+    const CargoTestCache cache = CargoTestCache::load( m_cacheFile );
+    for (int i = 0; i < m_binaries.size(); ++i)
+    {
+        if (const CargoTestBinary* cached = cache.find( m_binaries.at( i ) ))
+        {
+            m_binaries[i].cases = cached->cases;
+        }
+        else
+        {
+            m_pending << i;
+        }
+    }
+
+    listNext();
+}
+
+void CargoTestDiscoveryJob::finish()
+{
+    CargoTestCache cache;
+    cache.setBinaries( m_binaries );
+    if (!cache.save( m_cacheFile ))
+    {
+        qCWarning(CUSTOMBUILDSYSTEM) << "Could not write the test cache" << m_cacheFile;
+    }
+    emitResult();
+}
+
+void CargoTestDiscoveryJob::listNext()
+{
+    if (m_current >= m_pending.size())
+    {
+        finish();
+        return;
+    }
+
+    const CargoTestBinary& binary = m_binaries.at( m_pending.at( m_current ) );
+    m_process = new QProcess( this );
+    m_process->setWorkingDirectory( binary.workingDirectory.toLocalFile() );
+    connect( m_process, static_cast<void(QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+             this, &CargoTestDiscoveryJob::listFinished );
+    connect( m_process, &QProcess::errorOccurred, this, &CargoTestDiscoveryJob::procError );
+
+    m_process->start( binary.executable.toLocalFile(), {
+        QStringLiteral("--list"),
+        QStringLiteral("--format=terse")
+    });
+}
+
+void CargoTestDiscoveryJob::listFinished( int exitCode, QProcess::ExitStatus exitStatus )
+{
+    CargoTestBinary& binary = m_binaries[m_pending.at( m_current )];
+    if (exitStatus != QProcess::NormalExit || exitCode != 0)
+    {
+        qCWarning(CUSTOMBUILDSYSTEM) << "Could not list the tests of" << binary.name << m_process->readAllStandardError();
+
+        // Listed again by the next discovery
+        binary.modified = 0;
+    }
+    else
+    {
+        // Each test is printed as "name: test", benchmarks as "name: bench"
+        const QByteArray suffix = ": test";
+        const QList<QByteArray> lines = m_process->readAllStandardOutput().split( '\n' );
+        for (const QByteArray& line : lines)
+        {
+            if (line.endsWith( suffix ))
+            {
+                binary.cases << QString::fromUtf8( line.left( line.size() - suffix.size() ) );
+            }
+        }
+    }
+
+    m_process->deleteLater();
+    ++m_current;
+    listNext();
+}
+
+void CargoTestDiscoveryJob::procError( QProcess::ProcessError error )
+{
+    // Other errors are followed by finished()
+    if (error != QProcess::FailedToStart)
+    {
+        return;
+    }
+
+    qCWarning(CUSTOMBUILDSYSTEM) << "Could not start" << m_process->program() << m_process->errorString();
+    m_process->deleteLater();
+    if (m_current < m_pending.size())
+    {
+        m_binaries[m_pending.at( m_current )].modified = 0;
+        ++m_current;
+        listNext();
+    }
+    else
+    {
+        setError( UserDefinedError );
+        setErrorText( i18n( "Could not start %1", m_process->program() ) );
+        emitResult();
+    }
+}
@@ -0,0 +1,184 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARGOTESTSUITE_H
+#define CARGOTESTSUITE_H
+
+#include <KJob>
+
+#include <interfaces/itestsuite.h>
+#include <util/path.h>
+
+#include <QDataStream>
+#include <QPointer>
+#include <QProcess>
+#include <QStringList>
+#include <QVector>
+
+#include "cargometadata.h"
+
+class CargoBuildCoordinator;
+class CargoPlugin;
+
+/**
+ * A test harness built by cargo, with the names of the tests it contains.
+ */
+struct CargoTestBinary
+{
+    QString name;
+    KDevelop::Path executable;
+    KDevelop::Path workingDirectory;
+    QStringList cases;
+
+    // Fingerprint of the executable when its tests were listed
+    qint64 modified = 0;
+    qint64 size = 0;
+
+    /**
+     * Records the current modification time and size of the executable.
+     */
+    void updateFingerprint();
+
+    /**
+     * @return whether the executable still exists and did not change since updateFingerprint()
+     */
+    bool isUpToDate() const;
+};
+
+/**
+ * Remembers the tests of each harness, so only harnesses that changed since the last discovery are listed again.
+ */
+class CargoTestCache
+{
+public:
+    /**
+     * @return the cached harness with the same executable as @p binary, if it is still up to date
+     */
+    const CargoTestBinary* find( const CargoTestBinary& binary ) const;
+
+    QVector<CargoTestBinary> binaries() const { return m_binaries; }
+    void setBinaries( const QVector<CargoTestBinary>& binaries ) { m_binaries = binaries; }
+
+    static CargoTestCache load( const QString& fileName );
+    bool save( const QString& fileName ) const;
+
+private:
+    QVector<CargoTestBinary> m_binaries;
+};
+
+QDataStream& operator<<( QDataStream& stream, const CargoTestBinary& binary );
+QDataStream& operator>>( QDataStream& stream, CargoTestBinary& binary );
+
+/**
+ * The tests of a single test harness: the unit tests of a target, or an integration test.
+ *
+ * Tests are run directly from the harness, without going through cargo.
+ */
+class CargoTestSuite : public KDevelop::ITestSuite
+{
+public:
+    CargoTestSuite( KDevelop::IProject* project, const CargoTestBinary& binary );
+    ~CargoTestSuite() override;
+
+    QString name() const override;
+    QStringList cases() const override;
+    KDevelop::IProject* project() const override;
+
+    KJob* launchAllCases( TestJobVerbosity verbosity ) override;
+    KJob* launchCases( const QStringList& testCases, TestJobVerbosity verbosity ) override;
+    KJob* launchCase( const QString& testCase, TestJobVerbosity verbosity ) override;
+
+    KDevelop::IndexedDeclaration declaration() const override;
+    KDevelop::IndexedDeclaration caseDeclaration( const QString& testCase ) const override;
+
+    KDevelop::Path executable() const { return binary.executable; }
+    KDevelop::Path workingDirectory() const { return binary.workingDirectory; }
+
+    /**
+     * Replaces the harness with the one found by a newer discovery.
+     */
+    void setBinary( const CargoTestBinary& binary ) { this->binary = binary; }
+
+private:
+    KJob* launch( const QStringList& testCases, bool allCases, TestJobVerbosity verbosity );
+
+    KDevelop::IProject* m_project;
+    CargoTestBinary binary;
+};
+
+/**
+ * Finds the tests of a project.
+ *
+ * The test harnesses are built with cargo test --no-run, and their executables are taken
+ * from the artifact messages. Each harness then lists its tests with --list,
+ * unless it did not change since its tests were stored in the cache.
+ *
+ * The job fails if the harnesses could not be built.
+ */
+class CargoTestDiscoveryJob : public KJob
+{
+Q_OBJECT
+public:
+    CargoTestDiscoveryJob( KDevelop::IProject* project, const CargoMetadata& metadata,
+                           const QString& cacheFile, QObject* parent = nullptr );
+    ~CargoTestDiscoveryJob() override;
+
+    void start() override;
+
+    void setEnvironment( const QProcessEnvironment& environment ) { m_environment = environment; }
+    void setConfigArguments( const QStringList& arguments ) { m_configArguments = arguments; }
+
+    /**
+     * Makes cargo wait for the builds in @p targetDirectory and share the jobserver of @p coordinator.
+     */
+    void setCoordinator( CargoBuildCoordinator* coordinator, const QString& targetDirectory );
+
+    QVector<CargoTestBinary> binaries() const { return m_binaries; }
+
+protected:
+    bool doKill() override;
+
+private slots:
+    void buildFinished( int exitCode, QProcess::ExitStatus exitStatus );
+    void listFinished( int exitCode, QProcess::ExitStatus exitStatus );
+    void procError( QProcess::ProcessError error );
+
+private:
+    void startBuild();
+    void listNext();
+    void finish();
+
+    QPointer<KDevelop::IProject> m_project;
+    CargoBuildCoordinator* m_coordinator;
+    QString m_targetDirectory;
+    CargoMetadata m_metadata;
+    QString m_cacheFile;
+    QPointer<QProcess> m_process;
+    QVector<CargoTestBinary> m_binaries;
+    /// Indices of the binaries whose tests have to be listed
+    QVector<int> m_pending;
+    int m_current;
+    QProcessEnvironment m_environment;
+    QStringList m_configArguments;
+};
+
+#endif
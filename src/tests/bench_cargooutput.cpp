@@ -0,0 +1,424 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench_cargooutput.h"
+
+#include "../cargofilterstrategy.h"
+#include "../cargooutputmodel.h"
+#include "../cargooutputworker.h"
+
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QProcessEnvironment>
+#include <QTest>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+QTEST_GUILESS_MAIN(BenchCargoOutput)
+
+using KDevelop::FilteredItem;
+
+/// Recorded logs are replayed until they have at least this many lines
+static const int LogLines = 50000;
+/// Items reach the model in batches of about this size, as the worker sends them during a large build
+static const int BatchItems = 1000;
+
+static std::atomic<qint64> allocations( 0 );
+
+#ifdef __GLIBC__
+/*
+ * Every allocation of the process is counted, including the ones Qt containers make with malloc directly.
+ * The definitions here take precedence over the ones in the C library, which does the actual work.
+ */
+extern "C" {
+void* __libc_malloc( size_t size );
+void* __libc_calloc( size_t count, size_t size );
+void* __libc_realloc( void* pointer, size_t size );
+void __libc_free( void* pointer );
+
+void* malloc( size_t size ) noexcept
+{
+    allocations.fetch_add( 1, std::memory_order_relaxed );
+    return __libc_malloc( size );
+}
+
+void* calloc( size_t count, size_t size ) noexcept
+{
+    allocations.fetch_add( 1, std::memory_order_relaxed );
+    return __libc_calloc( count, size );
+}
+
+void* realloc( void* pointer, size_t size ) noexcept
+{
+    allocations.fetch_add( 1, std::memory_order_relaxed );
+    return __libc_realloc( pointer, size );
+}
+
+void free( void* pointer ) noexcept
+{
+    __libc_free( pointer );
+}
+}
+static const bool countsAllocations = true;
+#else
+static const bool countsAllocations = false;
+#endif
+
+/**
+ * Resets the peak memory of the process, where the system allows it.
+ */
+static void resetPeakMemory()
+{
+#ifdef Q_OS_LINUX
+    QFile clearRefs( QStringLiteral("/proc/self/clear_refs") );
+    if (clearRefs.open( QIODevice::WriteOnly ))
+    {
+        clearRefs.write( "5" );
+    }
+#endif
+}
+
+/**
+ * @return the peak resident memory of the process in KiB, or -1 if it is not known
+ */
+static qint64 peakMemory()
+{
+#ifdef Q_OS_LINUX
+    QFile status( QStringLiteral("/proc/self/status") );
+    if (status.open( QIODevice::ReadOnly ))
+    {
+        for (const QByteArray& line : status.readAll().split( '\n' ))
+        {
+            if (line.startsWith( "VmHWM:" ))
+            {
+                return line.mid( 6 ).trimmed().split( ' ' ).value( 0 ).toLongLong();
+            }
+        }
+    }
+#endif
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage( RUSAGE_SELF, &usage ) == 0)
+    {
+        return usage.ru_maxrss;
+    }
+#endif
+    return -1;
+}
+
+/**
+ * Measures the lines per second, allocations per line and peak memory of a benchmark,
+ * over all the iterations QBENCHMARK runs.
+ */
+class Measurement
+{
+public:
+    explicit Measurement( qint64 linesPerIteration )
+        : linesPerIteration( linesPerIteration )
+        , iterations( 0 )
+        , startAllocations( allocations.load() )
+    {
+        resetPeakMemory();
+        timer.start();
+    }
+
+    void iterationDone() { ++iterations; }
+
+    ~Measurement()
+    {
+        const qint64 ms = qMax<qint64>( timer.elapsed(), 1 );
+        const qint64 lines = qMax<qint64>( linesPerIteration * iterations, 1 );
+        const QString allocationsPerLine = countsAllocations
+            ? QString::number( double( allocations.load() - startAllocations ) / lines, 'f', 2 )
+            : QStringLiteral("?");
+        const qint64 peak = peakMemory();
+
+        qInfo().noquote() << QStringLiteral("%1: %2 lines/s, %3 allocations/line, peak memory %4 MiB")
+            .arg( QString::fromLatin1( QTest::currentDataTag() ) )
+            .arg( lines * 1000 / ms )
+            .arg( allocationsPerLine )
+            .arg( peak < 0 ? QStringLiteral("?") : QString::number( peak / 1024 ) );
+    }
+
+private:
+    qint64 linesPerIteration;
+    qint64 iterations;
+    qint64 startAllocations;
+    QElapsedTimer timer;
+};
+
+static QString dataFile( const QString& name )
+{
+    return QStringLiteral(CARGO_TEST_DATA "/") + name;
+}
+
+static QList<QByteArray> readLog( const QString& name )
+{
+    QFile file( dataFile( name ) );
+    if (!file.open( QIODevice::ReadOnly ))
+    {
+        qFatal( "Could not read the recorded log %s", qPrintable( file.fileName() ) );
+    }
+
+    QList<QByteArray> lines = file.readAll().split( '\n' );
+    if (!lines.isEmpty() && lines.last().isEmpty())
+    {
+        lines.removeLast();
+    }
+    return lines;
+}
+
+/**
+ * @return how many times a log of @p lines lines is replayed to reach LogLines lines
+ */
+static int replays( int lines )
+{
+    return (LogLines + lines - 1) / qMax( lines, 1 );
+}
+
+static QList<QByteArray> replayLog( const QString& name )
+{
+    const QList<QByteArray> lines = readLog( name );
+    QList<QByteArray> replayed;
+    for (int i = replays( lines.size() ); i > 0; --i)
+    {
+        replayed << lines;
+    }
+    return replayed;
+}
+
+static QVector<FilteredItem> filterLines( const QList<QByteArray>& lines )
+{
+    CargoFilterStrategy filter( QUrl::fromLocalFile( QStringLiteral("/home/dev/workspace") ) );
+    for (const QByteArray& line : lines)
+    {
+        filter.handleLine( QProcess::StandardError, line );
+    }
+    return filter.takeItems();
+}
+
+void BenchCargoOutput::initTestCase()
+{
+    QVERIFY( QFile::exists( QStringLiteral(FAKE_CARGO) ) );
+    QVERIFY( QFile::exists( dataFile( QStringLiteral("build.txt") ) ) );
+}
+
+void BenchCargoOutput::benchFilter_data()
+{
+    QTest::addColumn<QString>( "log" );
+
+    QTest::newRow( "clean build" ) << QStringLiteral("build.txt");
+    QTest::newRow( "error storm" ) << QStringLiteral("errors.txt");
+    QTest::newRow( "cargo test" ) << QStringLiteral("test.txt");
+}
+
+void BenchCargoOutput::benchFilter()
+{
+    QFETCH( QString, log );
+
+    const QList<QByteArray> lines = replayLog( log );
+    QVector<FilteredItem> items;
+
+    Measurement measurement( lines.size() );
+    QBENCHMARK
+    {
+        items = filterLines( lines );
+        measurement.iterationDone();
+    }
+
+    QCOMPARE( items.size(), lines.size() );
+}
+
+void BenchCargoOutput::benchDiagnostics_data()
+{
+    QTest::addColumn<QString>( "log" );
+    QTest::addColumn<bool>( "jsonMessages" );
+    QTest::addColumn<int>( "problems" );
+
+    QTest::newRow( "clean build, text" ) << QStringLiteral("build") << false << 6;
+    QTest::newRow( "clean build, json" ) << QStringLiteral("build") << true << 6;
+    QTest::newRow( "error storm, text" ) << QStringLiteral("errors") << false << 81;
+    QTest::newRow( "error storm, json" ) << QStringLiteral("errors") << true << 81;
+}
+
+/*
+ * The same builds filtered from the human readable output, and from JSON messages
+ * together with the status lines cargo still prints as text.
+ * The text log is replayed to LogLines lines and the JSON log as many times,
+ * so the times of the two rows of a log are comparable, while their lines per second are not.
+ */
+void BenchCargoOutput::benchDiagnostics()
+{
+    QFETCH( QString, log );
+    QFETCH( bool, jsonMessages );
+    QFETCH( int, problems );
+
+    const int builds = replays( readLog( log + QStringLiteral(".txt") ).size() );
+    QVector<QPair<QProcess::ProcessChannel, QByteArray>> lines;
+    for (int i = 0; i < builds; ++i)
+    {
+        if (jsonMessages)
+        {
+            for (const QByteArray& line : readLog( log + QStringLiteral(".stderr") ))
+            {
+                lines << qMakePair( QProcess::StandardError, line );
+            }
+            for (const QByteArray& line : readLog( log + QStringLiteral(".json") ))
+            {
+                lines << qMakePair( QProcess::StandardOutput, line );
+            }
+        }
+        else
+        {
+            for (const QByteArray& line : readLog( log + QStringLiteral(".txt") ))
+            {
+                lines << qMakePair( QProcess::StandardError, line );
+            }
+        }
+    }
+
+    QVector<FilteredItem> items;
+    Measurement measurement( lines.size() );
+    QBENCHMARK
+    {
+        CargoFilterStrategy filter( QUrl::fromLocalFile( QStringLiteral("/home/dev/workspace") ) );
+        filter.setJsonMessages( jsonMessages );
+        for (const auto& line : qAsConst(lines))
+        {
+            filter.handleLine( line.first, line.second );
+        }
+        items = filter.takeItems();
+        measurement.iterationDone();
+    }
+
+    // Both paths find the same errors and warnings
+    const int found = std::count_if( items.constBegin(), items.constEnd(), []( const FilteredItem& item ) {
+        return item.type == FilteredItem::ErrorItem || item.type == FilteredItem::WarningItem;
+    });
+    QCOMPARE( found, problems * builds );
+}
+
+void BenchCargoOutput::benchModel_data()
+{
+    benchFilter_data();
+}
+
+void BenchCargoOutput::benchModel()
+{
+    QFETCH( QString, log );
+
+    const QVector<FilteredItem> items = filterLines( replayLog( log ) );
+    QVector<QVector<FilteredItem>> batches;
+    for (int i = 0; i < items.size(); i += BatchItems)
+    {
+        batches << items.mid( i, BatchItems );
+    }
+
+    Measurement measurement( items.size() );
+    QBENCHMARK
+    {
+        // Past CargoOutputModel::MaxWindowLines lines, this includes spilling to the temporary file
+        CargoOutputModel model( QUrl::fromLocalFile( QStringLiteral("/home/dev/workspace") ) );
+        for (const QVector<FilteredItem>& batch : qAsConst(batches))
+        {
+            model.appendItems( batch );
+        }
+        QCOMPARE( model.rowCount(), items.size() );
+        measurement.iterationDone();
+    }
+}
+
+void BenchCargoOutput::benchPipeline_data()
+{
+    QTest::addColumn<QString>( "standardOutput" );
+    QTest::addColumn<QString>( "standardError" );
+    QTest::addColumn<bool>( "jsonMessages" );
+
+    QTest::newRow( "clean build" ) << QString() << QStringLiteral("build.txt") << false;
+    QTest::newRow( "clean build, json" ) << QStringLiteral("build.json") << QStringLiteral("build.stderr") << true;
+    QTest::newRow( "error storm" ) << QString() << QStringLiteral("errors.txt") << false;
+    QTest::newRow( "error storm, json" ) << QStringLiteral("errors.json") << QStringLiteral("errors.stderr") << true;
+    QTest::newRow( "cargo test" ) << QString() << QStringLiteral("test.txt") << false;
+}
+
+/*
+ * The whole path of a build job: the fake cargo script writes the log in chunks to a pipe,
+ * the worker reads and filters it in its own thread and the model receives the batches.
+ */
+void BenchCargoOutput::benchPipeline()
+{
+    QFETCH( QString, standardOutput );
+    QFETCH( QString, standardError );
+    QFETCH( bool, jsonMessages );
+
+    const int outputLines = standardOutput.isEmpty() ? 0 : readLog( standardOutput ).size();
+    const int errorLines = readLog( standardError ).size();
+    const int repeat = replays( outputLines + errorLines );
+
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    if (!standardOutput.isEmpty())
+    {
+        environment.insert( QStringLiteral("FAKE_CARGO_STDOUT"), dataFile( standardOutput ) );
+    }
+    environment.insert( QStringLiteral("FAKE_CARGO_STDERR"), dataFile( standardError ) );
+    environment.insert( QStringLiteral("FAKE_CARGO_REPEAT"), QString::number( repeat ) );
+
+    const QUrl buildDir = QUrl::fromLocalFile( QStringLiteral("/home/dev/workspace") );
+
+    Measurement measurement( qint64( outputLines + errorLines ) * repeat );
+    QBENCHMARK
+    {
+        auto worker = new CargoOutputWorker( buildDir, QStringLiteral(FAKE_CARGO), { QStringLiteral("build") },
+                                             QString(), environment, jsonMessages );
+        QThread thread;
+        worker->moveToThread( &thread );
+        CargoOutputModel model( buildDir );
+
+        QEventLoop loop;
+        int exitCode = -1;
+        connect( &thread, &QThread::finished, worker, &QObject::deleteLater );
+        connect( worker, &CargoOutputWorker::itemsReady, &model, &CargoOutputModel::appendItems );
+        connect( worker, &CargoOutputWorker::finished, &loop, [&loop, &exitCode]( int code ) {
+            exitCode = code;
+            loop.quit();
+        });
+        connect( worker, &CargoOutputWorker::failed, &loop, &QEventLoop::quit );
+
+        thread.start();
+        QMetaObject::invokeMethod( worker, "start", Qt::QueuedConnection );
+        loop.exec();
+
+        thread.quit();
+        thread.wait();
+
+        QCOMPARE( exitCode, 0 );
+        QVERIFY( model.rowCount() > 0 );
+        measurement.iterationDone();
+    }
+}
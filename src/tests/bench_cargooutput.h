@@ -0,0 +1,51 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BENCH_CARGOOUTPUT_H
+#define BENCH_CARGOOUTPUT_H
+
+#include <QObject>
+
+/**
+ * Benchmarks of the path cargo output takes to the build view.
+ *
+ * Recorded cargo logs from the data directory are replayed until they add up to LogLines lines.
+ * Besides the time measured by QBENCHMARK, every case reports lines per second,
+ * allocations per line and the peak memory of the process.
+ */
+class BenchCargoOutput : public QObject
+{
+Q_OBJECT
+private slots:
+    void initTestCase();
+
+    void benchFilter_data();
+    void benchFilter();
+    void benchDiagnostics_data();
+    void benchDiagnostics();
+    void benchModel_data();
+    void benchModel();
+    void benchPipeline_data();
+    void benchPipeline();
+};
+
+#endif
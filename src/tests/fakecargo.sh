@@ -0,0 +1,28 @@
+#!/bin/sh
+#
+# Stands in for cargo when benchmarking the build output path, by pointing CARGO to it.
+# Instead of building, it replays recorded output, so no Rust toolchain is needed.
+# The arguments are ignored.
+#
+#   FAKE_CARGO_STDOUT  log replayed on standard output
+#   FAKE_CARGO_STDERR  log replayed on standard error
+#   FAKE_CARGO_REPEAT  number of times the logs are replayed, 1 by default
+#   FAKE_CARGO_CHUNK   size of each write in bytes, 4096 by default;
+#                      lines are split between writes, as they are when reading from a real pipe
+#   FAKE_CARGO_EXIT    exit code, 0 by default
+
+repeat=${FAKE_CARGO_REPEAT:-1}
+chunk=${FAKE_CARGO_CHUNK:-4096}
+
+i=0
+while [ "$i" -lt "$repeat" ]; do
+    if [ -n "$FAKE_CARGO_STDERR" ]; then
+        { dd if="$FAKE_CARGO_STDERR" bs="$chunk" 2>/dev/null; } >&2
+    fi
+    if [ -n "$FAKE_CARGO_STDOUT" ]; then
+        dd if="$FAKE_CARGO_STDOUT" bs="$chunk" 2>/dev/null
+    fi
+    i=$((i + 1))
+done
+
+exit "${FAKE_CARGO_EXIT:-0}"
@@ -0,0 +1,203 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test_cargobenchhistory.h"
+
+#include "../cargobenchhistory.h"
+
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <cmath>
+
+QTEST_GUILESS_MAIN(TestCargoBenchHistory)
+
+static CargoBenchResult result( double mean, double error, const QString& name = QStringLiteral("bench") )
+{
+    CargoBenchResult ret;
+    ret.name = name;
+    ret.mean = mean;
+    ret.error = error;
+    return ret;
+}
+
+void TestCargoBenchHistory::testLibtestLine_data()
+{
+    QTest::addColumn<QString>( "line" );
+    QTest::addColumn<QString>( "name" );
+    QTest::addColumn<double>( "mean" );
+    QTest::addColumn<double>( "range" );
+
+    QTest::newRow( "simple" ) << QStringLiteral("test bench_parse ... bench:       1,234 ns/iter (+/- 56)")
+                              << QStringLiteral("bench_parse") << 1234.0 << 56.0;
+    QTest::newRow( "module path" ) << QStringLiteral("test parser::tests::bench_big ... bench:   2,345,678 ns/iter (+/- 123,456)")
+                                   << QStringLiteral("parser::tests::bench_big") << 2345678.0 << 123456.0;
+    QTest::newRow( "fraction" ) << QStringLiteral("test tiny ... bench:           0.52 ns/iter (+/- 0.01)")
+                                << QStringLiteral("tiny") << 0.52 << 0.01;
+    QTest::newRow( "test result" ) << QStringLiteral("test parses_empty ... ok") << QString() << 0.0 << 0.0;
+    QTest::newRow( "ignored" ) << QStringLiteral("test bench_slow ... ignored") << QString() << 0.0 << 0.0;
+    QTest::newRow( "summary" ) << QStringLiteral("test result: ok. 0 passed; 0 failed; 1 ignored; 2 measured; 0 filtered out")
+                               << QString() << 0.0 << 0.0;
+    QTest::newRow( "other output" ) << QStringLiteral("running 2 tests") << QString() << 0.0 << 0.0;
+}
+
+void TestCargoBenchHistory::testLibtestLine()
+{
+    QFETCH( QString, line );
+    QFETCH( QString, name );
+    QFETCH( double, mean );
+    QFETCH( double, range );
+
+    const CargoBenchResult parsed = CargoBenchResult::fromLibtestLine( line );
+    QCOMPARE( parsed.name, name );
+    QCOMPARE( parsed.mean, mean );
+    QCOMPARE( parsed.error, CargoBenchResult::libtestStandardError( range ) );
+}
+
+void TestCargoBenchHistory::testLibtestStandardError()
+{
+    // A range of 4.5 standard deviations, and the standard error of the median of 50 samples
+    QVERIFY( qFuzzyCompare( CargoBenchResult::libtestStandardError( 450 ), 1.2533 * 100 / std::sqrt( 50.0 ) ) );
+    QCOMPARE( CargoBenchResult::libtestStandardError( 0 ), 0.0 );
+}
+
+void TestCargoBenchHistory::testCriterionEstimates_data()
+{
+    QTest::addColumn<QByteArray>( "json" );
+    QTest::addColumn<double>( "mean" );
+    QTest::addColumn<double>( "error" );
+
+    QTest::newRow( "estimates" ) << QByteArray( "{\"mean\":{\"confidence_interval\":{\"confidence_level\":0.95,"
+                                                "\"lower_bound\":1498.2,\"upper_bound\":1547.9},"
+                                                "\"point_estimate\":1523.4,\"standard_error\":12.5},"
+                                                "\"median\":{\"point_estimate\":1519.0,\"standard_error\":9.1}}" )
+                                 << 1523.4 << 12.5;
+    QTest::newRow( "without mean" ) << QByteArray( "{\"median\":{\"point_estimate\":1519.0,\"standard_error\":9.1}}" )
+                                    << 0.0 << 0.0;
+    QTest::newRow( "truncated" ) << QByteArray( "{\"mean\":{\"point_estimate\":15" ) << 0.0 << 0.0;
+    QTest::newRow( "empty" ) << QByteArray() << 0.0 << 0.0;
+}
+
+void TestCargoBenchHistory::testCriterionEstimates()
+{
+    QFETCH( QByteArray, json );
+    QFETCH( double, mean );
+    QFETCH( double, error );
+
+    const CargoBenchResult parsed = CargoBenchResult::fromCriterionEstimates( QStringLiteral("group/parse"), json );
+    QCOMPARE( parsed.name, QStringLiteral("group/parse") );
+    QCOMPARE( parsed.mean, mean );
+    QCOMPARE( parsed.error, error );
+}
+
+void TestCargoBenchHistory::testScore()
+{
+    // The errors add up like standard deviations, sqrt(3² + 4²) = 5
+    QCOMPARE( CargoBenchHistory::score( result( 1000, 3 ), result( 1008, 4 ) ), 1.6 );
+    QCOMPARE( CargoBenchHistory::score( result( 1008, 4 ), result( 1000, 3 ) ), -1.6 );
+    QCOMPARE( CargoBenchHistory::score( result( 1000, 0 ), result( 1000, 0 ) ), 0.0 );
+    QVERIFY( std::isinf( CargoBenchHistory::score( result( 1000, 0 ), result( 1001, 0 ) ) ) );
+}
+
+void TestCargoBenchHistory::testRegression_data()
+{
+    QTest::addColumn<double>( "beforeMean" );
+    QTest::addColumn<double>( "beforeError" );
+    QTest::addColumn<double>( "afterMean" );
+    QTest::addColumn<double>( "afterError" );
+    QTest::addColumn<bool>( "regression" );
+
+    QTest::newRow( "significant slowdown" ) << 1000.0 << 5.0 << 1100.0 << 5.0 << true;
+    QTest::newRow( "within the noise" ) << 1000.0 << 50.0 << 1050.0 << 50.0 << false;
+    QTest::newRow( "significant but small" ) << 1000.0 << 1.0 << 1010.0 << 1.0 << false;
+    QTest::newRow( "significant and large enough" ) << 1000.0 << 2.0 << 1030.0 << 2.0 << true;
+    // z = 2.5, just below 2.58
+    QTest::newRow( "just not significant" ) << 1000.0 << 6.0 << 1025.0 << 8.0 << false;
+    // z = 2.6, just above it
+    QTest::newRow( "just significant" ) << 1000.0 << 6.0 << 1026.0 << 8.0 << true;
+    QTest::newRow( "faster" ) << 1000.0 << 5.0 << 900.0 << 5.0 << false;
+    QTest::newRow( "without errors" ) << 1000.0 << 0.0 << 1030.0 << 0.0 << true;
+    QTest::newRow( "unchanged without errors" ) << 1000.0 << 0.0 << 1000.0 << 0.0 << false;
+    QTest::newRow( "no previous time" ) << 0.0 << 0.0 << 1000.0 << 5.0 << false;
+}
+
+void TestCargoBenchHistory::testRegression()
+{
+    QFETCH( double, beforeMean );
+    QFETCH( double, beforeError );
+    QFETCH( double, afterMean );
+    QFETCH( double, afterError );
+    QFETCH( bool, regression );
+
+    QCOMPARE( CargoBenchHistory::isRegression( result( beforeMean, beforeError ), result( afterMean, afterError ) ), regression );
+}
+
+void TestCargoBenchHistory::testHistoryLimit()
+{
+    CargoBenchHistory history;
+    QVERIFY( !history.latest( QStringLiteral("bench") ) );
+
+    const int count = CargoBenchHistory::MaxResultsPerBench + 5;
+    for (int i = 0; i < count; ++i)
+    {
+        history.add( result( i, 1 ) );
+    }
+    history.add( result( 42, 1, QStringLiteral("other") ) );
+
+    // The oldest results are dropped
+    const QVector<CargoBenchResult> kept = history.resultsOf( QStringLiteral("bench") );
+    QCOMPARE( kept.size(), int( CargoBenchHistory::MaxResultsPerBench ) );
+    QCOMPARE( kept.first().mean, 5.0 );
+    QCOMPARE( history.latest( QStringLiteral("bench") )->mean, double( count - 1 ) );
+    QCOMPARE( history.latest( QStringLiteral("other") )->mean, 42.0 );
+}
+
+void TestCargoBenchHistory::testSaveAndLoad()
+{
+    QTemporaryDir dir;
+    const QString fileName = dir.filePath( QStringLiteral("cache/benchmarks.json") );
+
+    CargoBenchResult first = result( 1523.4, 12.5, QStringLiteral("group/parse") );
+    first.commit = QStringLiteral("1a2b3c4");
+    first.time = QDateTime( QDate( 2024, 3, 1 ), QTime( 12, 30 ) );
+    CargoBenchResult second = first;
+    second.mean = 1490.0;
+    second.commit = QStringLiteral("5d6e7f8");
+
+    CargoBenchHistory history;
+    history.add( first );
+    history.add( second );
+    history.add( result( 12.25, 0.5, QStringLiteral("bench_small") ) );
+    QVERIFY( history.save( fileName ) );
+
+    const CargoBenchHistory loaded = CargoBenchHistory::load( fileName );
+    const QVector<CargoBenchResult> results = loaded.resultsOf( QStringLiteral("group/parse") );
+    QCOMPARE( results.size(), 2 );
+    QCOMPARE( results.at( 0 ).mean, 1523.4 );
+    QCOMPARE( results.at( 0 ).error, 12.5 );
+    QCOMPARE( results.at( 0 ).commit, QStringLiteral("1a2b3c4") );
+    QCOMPARE( results.at( 0 ).time, first.time );
+    QCOMPARE( results.at( 1 ).commit, QStringLiteral("5d6e7f8") );
+    QCOMPARE( loaded.latest( QStringLiteral("bench_small") )->mean, 12.25 );
+
+    QVERIFY( !CargoBenchHistory::load( dir.filePath( QStringLiteral("missing.json") ) ).latest( QStringLiteral("group/parse") ) );
+}
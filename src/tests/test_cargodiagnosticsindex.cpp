@@ -0,0 +1,254 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test_cargodiagnosticsindex.h"
+
+#include "../cargodiagnosticsindex.h"
+
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QtEndian>
+
+#include <algorithm>
+
+QTEST_GUILESS_MAIN(TestCargoDiagnosticsIndex)
+
+// The sizes of the file format, as documented in CargoDiagnosticsIndex
+static const int HeaderSize = 16;
+static const int RecordSize = 40;
+
+static CargoDiagnostic diagnostic( const QString& package, const QString& fileName, const QString& text, int line,
+                                   CargoDiagnostic::Severity severity = CargoDiagnostic::Warning )
+{
+    CargoDiagnostic ret;
+    ret.package = package;
+    ret.fileName = fileName;
+    ret.text = text;
+    ret.rendered = QStringLiteral("warning: ") + text;
+    ret.line = line;
+    ret.column = 5;
+    ret.lineEnd = line + 1;
+    ret.columnEnd = 12;
+    ret.severity = severity;
+    return ret;
+}
+
+static QVector<CargoDiagnostic> sorted( QVector<CargoDiagnostic> diagnostics )
+{
+    std::sort( diagnostics.begin(), diagnostics.end(), []( const CargoDiagnostic& a, const CargoDiagnostic& b ) {
+        return qMakePair( a.package, a.line ) < qMakePair( b.package, b.line );
+    });
+    return diagnostics;
+}
+
+static QByteArray readFile( const QString& fileName )
+{
+    QFile file( fileName );
+    if (!file.open( QIODevice::ReadOnly ))
+    {
+        qFatal( "Could not read %s", qPrintable( fileName ) );
+    }
+    return file.readAll();
+}
+
+static void writeFile( const QString& fileName, const QByteArray& contents )
+{
+    QFile file( fileName );
+    if (!file.open( QIODevice::WriteOnly | QIODevice::Truncate ))
+    {
+        qFatal( "Could not write %s", qPrintable( fileName ) );
+    }
+    file.write( contents );
+}
+
+/**
+ * @return a file with two diagnostics, so that every section of the format has contents
+ */
+static QByteArray validFile( const QString& fileName )
+{
+    CargoDiagnosticsIndex index;
+    index.addDiagnostic( diagnostic( QStringLiteral("core"), QStringLiteral("/ws/core/src/lib.rs"), QStringLiteral("unused variable"), 3 ) );
+    index.addDiagnostic( diagnostic( QStringLiteral("app"), QStringLiteral("/ws/app/src/main.rs"), QStringLiteral("dead code"), 8 ) );
+    if (!index.save( fileName ))
+    {
+        qFatal( "Could not save %s", qPrintable( fileName ) );
+    }
+    return readFile( fileName );
+}
+
+void TestCargoDiagnosticsIndex::testRoundTrip()
+{
+    QTemporaryDir dir;
+    const QString fileName = dir.filePath( QStringLiteral("nested/diagnostics.idx") );
+
+    CargoDiagnostic error = diagnostic( QStringLiteral("core"), QStringLiteral("/ws/core/src/lib.rs"),
+                                        QStringLiteral("mismatched types"), 14, CargoDiagnostic::Error );
+    error.code = QStringLiteral("E0308");
+    error.rendered = QStringLiteral("error[E0308]: mismatched types\n  --> core/src/lib.rs:14:5\n");
+    const CargoDiagnostic hint = diagnostic( QStringLiteral("app"), QStringLiteral("/ws/app/src/main.rs"),
+                                             QStringLiteral("consider borrowing here: `&\u00e9t\u00e9`"), 2, CargoDiagnostic::Hint );
+
+    CargoDiagnosticsIndex index;
+    index.addDiagnostic( error );
+    index.addDiagnostic( hint );
+    index.addDiagnostic( diagnostic( QStringLiteral("core"), QStringLiteral("/ws/core/src/store.rs"), QStringLiteral("unused import"), 1 ) );
+    QVERIFY( index.save( fileName ) );
+
+    CargoDiagnosticsIndex loaded;
+    QVERIFY( loaded.load( fileName ) );
+
+    const QVector<CargoDiagnostic> expected = sorted( index.allDiagnostics() );
+    const QVector<CargoDiagnostic> actual = sorted( loaded.allDiagnostics() );
+    QCOMPARE( actual.size(), 3 );
+    for (int i = 0; i < expected.size(); ++i)
+    {
+        QCOMPARE( actual.at( i ).package, expected.at( i ).package );
+        QCOMPARE( actual.at( i ).fileName, expected.at( i ).fileName );
+        QCOMPARE( actual.at( i ).text, expected.at( i ).text );
+        QCOMPARE( actual.at( i ).rendered, expected.at( i ).rendered );
+        QCOMPARE( actual.at( i ).code, expected.at( i ).code );
+        QCOMPARE( actual.at( i ).line, expected.at( i ).line );
+        QCOMPARE( actual.at( i ).column, expected.at( i ).column );
+        QCOMPARE( actual.at( i ).lineEnd, expected.at( i ).lineEnd );
+        QCOMPARE( actual.at( i ).columnEnd, expected.at( i ).columnEnd );
+        QCOMPARE( actual.at( i ).severity, expected.at( i ).severity );
+    }
+
+    // The packages are kept apart, so one can be replaced after a build
+    loaded.clearPackage( QStringLiteral("core") );
+    QCOMPARE( loaded.allDiagnostics().size(), 1 );
+    QCOMPARE( loaded.allDiagnostics().first().package, QStringLiteral("app") );
+}
+
+void TestCargoDiagnosticsIndex::testEmptyIndex()
+{
+    QTemporaryDir dir;
+    const QString fileName = dir.filePath( QStringLiteral("diagnostics.idx") );
+
+    QVERIFY( CargoDiagnosticsIndex().save( fileName ) );
+    // Only the header and the empty string at offset 0
+    QCOMPARE( readFile( fileName ).size(), HeaderSize + 1 );
+
+    CargoDiagnosticsIndex loaded;
+    QVERIFY( loaded.load( fileName ) );
+    QVERIFY( loaded.isEmpty() );
+}
+
+void TestCargoDiagnosticsIndex::testSharedStrings()
+{
+    QTemporaryDir dir;
+    const QString fileName = dir.filePath( QStringLiteral("diagnostics.idx") );
+
+    const QString package = QStringLiteral("core");
+    const QString file = QStringLiteral("/ws/core/src/lib.rs");
+    const QString text = QStringLiteral("unused variable");
+
+    CargoDiagnosticsIndex index;
+    for (int line = 1; line <= 10; ++line)
+    {
+        CargoDiagnostic repeated = diagnostic( package, file, text, line );
+        repeated.rendered = text;
+        index.addDiagnostic( repeated );
+    }
+    QVERIFY( index.save( fileName ) );
+
+    // The code is empty, which is the string at offset 0, the others are stored once
+    const int tableSize = 1 + (package.size() + 1) + (file.size() + 1) + (text.size() + 1);
+    const QByteArray contents = readFile( fileName );
+    QCOMPARE( contents.size(), HeaderSize + 10 * RecordSize + tableSize );
+    QCOMPARE( qFromLittleEndian<quint32>( contents.constData() + 12 ), quint32( tableSize ) );
+    QCOMPARE( contents.count( file.toUtf8() ), 1 );
+
+    CargoDiagnosticsIndex loaded;
+    QVERIFY( loaded.load( fileName ) );
+    const QVector<CargoDiagnostic> diagnostics = sorted( loaded.allDiagnostics() );
+    QCOMPARE( diagnostics.size(), 10 );
+    QCOMPARE( diagnostics.last().fileName, file );
+    QCOMPARE( diagnostics.last().rendered, text );
+    QCOMPARE( diagnostics.last().line, 10 );
+}
+
+void TestCargoDiagnosticsIndex::testInvalidFile_data()
+{
+    QTest::addColumn<int>( "offset" );
+    QTest::addColumn<QByteArray>( "replacement" );
+    QTest::addColumn<int>( "size" );
+
+    // A size of -1 keeps the size of the valid file and -2 removes its last byte,
+    // an offset of -1 appends the replacement and -2 puts it over the last byte
+    QTest::newRow( "empty" ) << 0 << QByteArray() << 0;
+    QTest::newRow( "truncated header" ) << 0 << QByteArray() << 8;
+    QTest::newRow( "truncated records" ) << 0 << QByteArray() << HeaderSize + RecordSize;
+    QTest::newRow( "truncated table" ) << 0 << QByteArray() << -2;
+    QTest::newRow( "trailing data" ) << -1 << QByteArray( "extra" ) << -1;
+    QTest::newRow( "bad magic" ) << 0 << QByteArray( "XXXX" ) << -1;
+    QTest::newRow( "newer version" ) << 4 << QByteArray( "\x02\0\0\0", 4 ) << -1;
+    QTest::newRow( "more records" ) << 8 << QByteArray( "\x03\0\0\0", 4 ) << -1;
+    QTest::newRow( "empty table" ) << 12 << QByteArray( "\0\0\0\0", 4 ) << -1;
+    QTest::newRow( "unterminated table" ) << -2 << QByteArray( "x" ) << -1;
+}
+
+void TestCargoDiagnosticsIndex::testInvalidFile()
+{
+    QFETCH( int, offset );
+    QFETCH( QByteArray, replacement );
+    QFETCH( int, size );
+
+    QTemporaryDir dir;
+    const QString fileName = dir.filePath( QStringLiteral("diagnostics.idx") );
+    QByteArray contents = validFile( fileName );
+
+    if (size == -2)
+    {
+        contents.chop( 1 );
+    }
+    else if (size >= 0)
+    {
+        contents.truncate( size );
+    }
+
+    if (offset == -1)
+    {
+        contents.append( replacement );
+    }
+    else if (!replacement.isEmpty())
+    {
+        contents.replace( offset >= 0 ? offset : contents.size() + offset + 1, replacement.size(), replacement );
+    }
+    writeFile( fileName, contents );
+
+    // An index that is not valid is left empty, also if it had contents before
+    CargoDiagnosticsIndex index;
+    index.addDiagnostic( diagnostic( QStringLiteral("core"), QStringLiteral("/ws/core/src/lib.rs"), QStringLiteral("stale"), 1 ) );
+    QVERIFY( !index.load( fileName ) );
+    QVERIFY( index.isEmpty() );
+}
+
+void TestCargoDiagnosticsIndex::testMissingFile()
+{
+    QTemporaryDir dir;
+
+    CargoDiagnosticsIndex index;
+    QVERIFY( !index.load( dir.filePath( QStringLiteral("missing.idx") ) ) );
+    QVERIFY( index.isEmpty() );
+}
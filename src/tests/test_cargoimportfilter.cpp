@@ -0,0 +1,136 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test_cargoimportfilter.h"
+
+#include "../cargoimportfilter.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QTest>
+
+QTEST_GUILESS_MAIN(TestCargoImportFilter)
+
+using KDevelop::Path;
+
+static void writeFile( const QString& fileName, const QString& contents )
+{
+    QDir().mkpath( QFileInfo( fileName ).absolutePath() );
+    QFile file( fileName );
+    if (!file.open( QIODevice::WriteOnly | QIODevice::Truncate ))
+    {
+        qFatal( "Could not write %s", qPrintable( fileName ) );
+    }
+    file.write( contents.toUtf8() );
+}
+
+void TestCargoImportFilter::testExcluded_data()
+{
+    QTest::addColumn<QString>( "rootIgnore" );
+    QTest::addColumn<QString>( "subIgnore" );
+    QTest::addColumn<QString>( "path" );
+    QTest::addColumn<bool>( "isFolder" );
+    QTest::addColumn<bool>( "excluded" );
+
+    // The .gitignore files of the project root and of its folder sub, paths are relative to the root
+    QTest::newRow( "name at any depth" ) << QStringLiteral("*.log") << QString() << QStringLiteral("a/b/debug.log") << false << true;
+    QTest::newRow( "name without wildcard" ) << QStringLiteral("notes") << QString() << QStringLiteral("a/notes") << true << true;
+    QTest::newRow( "negation" ) << QStringLiteral("*.log\n!keep.log") << QString() << QStringLiteral("a/keep.log") << false << false;
+    QTest::newRow( "negation before the rule" ) << QStringLiteral("!keep.log\n*.log") << QString() << QStringLiteral("keep.log") << false << true;
+    QTest::newRow( "directory only, file" ) << QStringLiteral("build/") << QString() << QStringLiteral("a/build") << false << false;
+    QTest::newRow( "directory only, folder" ) << QStringLiteral("build/") << QString() << QStringLiteral("a/build") << true << true;
+    QTest::newRow( "leading slash, top level" ) << QStringLiteral("/docs") << QString() << QStringLiteral("docs") << true << true;
+    QTest::newRow( "leading slash, nested" ) << QStringLiteral("/docs") << QString() << QStringLiteral("a/docs") << true << false;
+    QTest::newRow( "middle slash, top level" ) << QStringLiteral("doc/out") << QString() << QStringLiteral("doc/out") << true << true;
+    QTest::newRow( "middle slash, nested" ) << QStringLiteral("doc/out") << QString() << QStringLiteral("a/doc/out") << true << false;
+    QTest::newRow( "star does not cross directories" ) << QStringLiteral("src/*.rs") << QString() << QStringLiteral("src/bin/main.rs") << false << false;
+    QTest::newRow( "star in its directory" ) << QStringLiteral("src/*.rs") << QString() << QStringLiteral("src/lib.rs") << false << true;
+    QTest::newRow( "leading double star, nested" ) << QStringLiteral("**/gen/out") << QString() << QStringLiteral("x/y/gen/out") << true << true;
+    QTest::newRow( "leading double star, top level" ) << QStringLiteral("**/gen/out") << QString() << QStringLiteral("gen/out") << true << true;
+    QTest::newRow( "leading double star, other parent" ) << QStringLiteral("**/gen/out") << QString() << QStringLiteral("x/gen/other/out") << true << false;
+    QTest::newRow( "middle double star, no directory" ) << QStringLiteral("a/**/b") << QString() << QStringLiteral("a/b") << true << true;
+    QTest::newRow( "middle double star, directories" ) << QStringLiteral("a/**/b") << QString() << QStringLiteral("a/x/y/b") << true << true;
+    QTest::newRow( "middle double star, not anchored elsewhere" ) << QStringLiteral("a/**/b") << QString() << QStringLiteral("c/a/b") << true << false;
+    QTest::newRow( "trailing double star, contents" ) << QStringLiteral("logs/**") << QString() << QStringLiteral("logs/2024/today.txt") << false << true;
+    QTest::newRow( "trailing double star, directory itself" ) << QStringLiteral("logs/**") << QString() << QStringLiteral("logs") << true << false;
+    QTest::newRow( "double star inside a name" ) << QStringLiteral("a**z") << QString() << QStringLiteral("abcz") << false << true;
+    QTest::newRow( "double star inside a name, directories" ) << QStringLiteral("a**z") << QString() << QStringLiteral("a/z") << true << false;
+    QTest::newRow( "question mark" ) << QStringLiteral("file?.c") << QString() << QStringLiteral("file1.c") << false << true;
+    QTest::newRow( "question mark, one character" ) << QStringLiteral("file?.c") << QString() << QStringLiteral("file12.c") << false << false;
+    QTest::newRow( "character class" ) << QStringLiteral("*.[ch]") << QString() << QStringLiteral("main.h") << false << true;
+    QTest::newRow( "character class, other character" ) << QStringLiteral("*.[ch]") << QString() << QStringLiteral("main.o") << false << false;
+    QTest::newRow( "negated class" ) << QStringLiteral("[!a]*.txt") << QString() << QStringLiteral("b.txt") << false << true;
+    QTest::newRow( "negated class, excluded character" ) << QStringLiteral("[!a]*.txt") << QString() << QStringLiteral("a.txt") << false << false;
+    QTest::newRow( "comment" ) << QStringLiteral("# generated") << QString() << QStringLiteral("# generated") << false << false;
+    QTest::newRow( "escaped hash" ) << QStringLiteral("\\#backup") << QString() << QStringLiteral("#backup") << false << true;
+    QTest::newRow( "nested file, inside" ) << QString() << QStringLiteral("*.tmp") << QStringLiteral("sub/x.tmp") << false << true;
+    QTest::newRow( "nested file, outside" ) << QString() << QStringLiteral("*.tmp") << QStringLiteral("x.tmp") << false << false;
+    QTest::newRow( "nested negation overrides the root" ) << QStringLiteral("*.dat") << QStringLiteral("!keep.dat") << QStringLiteral("sub/keep.dat") << false << false;
+    QTest::newRow( "nested anchored, in its directory" ) << QString() << QStringLiteral("/only") << QStringLiteral("sub/only") << false << true;
+    QTest::newRow( "nested anchored, deeper" ) << QString() << QStringLiteral("/only") << QStringLiteral("sub/deeper/only") << false << false;
+    QTest::newRow( "target directory" ) << QString() << QString() << QStringLiteral("target") << true << true;
+    QTest::newRow( "target directory as a file" ) << QString() << QString() << QStringLiteral("target") << false << false;
+}
+
+void TestCargoImportFilter::testExcluded()
+{
+    QFETCH( QString, rootIgnore );
+    QFETCH( QString, subIgnore );
+    QFETCH( QString, path );
+    QFETCH( bool, isFolder );
+    QFETCH( bool, excluded );
+
+    QTemporaryDir dir;
+    const Path root( dir.path() );
+    if (!rootIgnore.isEmpty())
+    {
+        writeFile( Path( root, QStringLiteral(".gitignore") ).toLocalFile(), rootIgnore );
+    }
+    if (!subIgnore.isEmpty())
+    {
+        writeFile( Path( root, QStringLiteral("sub/.gitignore") ).toLocalFile(), subIgnore );
+    }
+
+    const CargoImportFilter filter( root, Path( root, QStringLiteral("target") ) );
+    QCOMPARE( filter.isExcluded( Path( root, path ), isFolder ), excluded );
+}
+
+void TestCargoImportFilter::testReloadRules()
+{
+    QTemporaryDir dir;
+    const Path root( dir.path() );
+    const QString ignoreFile = Path( root, QStringLiteral(".gitignore") ).toLocalFile();
+    writeFile( ignoreFile, QStringLiteral("*.log\n") );
+
+    CargoImportFilter filter( root, Path( root, QStringLiteral("target") ) );
+    const Path log( root, QStringLiteral("debug.log") );
+    QVERIFY( filter.isExcluded( log, false ) );
+    QVERIFY( filter.ignoreFiles().contains( ignoreFile ) );
+
+    // The rules are cached until they are reloaded
+    writeFile( ignoreFile, QStringLiteral("*.tmp\n") );
+    QVERIFY( filter.isExcluded( log, false ) );
+    filter.reloadRules( root );
+    QVERIFY( !filter.isExcluded( log, false ) );
+}
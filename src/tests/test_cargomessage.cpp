@@ -0,0 +1,234 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test_cargomessage.h"
+
+#include "../cargofilterstrategy.h"
+#include "../cargomessage.h"
+
+#include <QFile>
+#include <QTest>
+
+QTEST_GUILESS_MAIN(TestCargoMessage)
+
+using KDevelop::FilteredItem;
+
+/// Lines of data/messages.json
+enum RecordedMessage
+{
+    MovedValue,
+    StdMacro,
+    NestedMacro,
+    WorkspaceMacro,
+    NoSpans,
+    Artifact,
+    BuildScript,
+    ProgramOutput
+};
+
+static QByteArray recordedLine( RecordedMessage index )
+{
+    QFile file( QStringLiteral(CARGO_TEST_DATA "/messages.json") );
+    if (!file.open( QIODevice::ReadOnly ))
+    {
+        qFatal( "Could not read the recorded messages %s", qPrintable( file.fileName() ) );
+    }
+    return file.readAll().split( '\n' ).value( index );
+}
+
+static CargoMessage recordedMessage( RecordedMessage index )
+{
+    return CargoMessageParser::parse( recordedLine( index ) );
+}
+
+void TestCargoMessage::testPrimarySpan()
+{
+    const CargoMessage message = recordedMessage( MovedValue );
+    QCOMPARE( message.reason, CargoMessage::CompilerMessage );
+    QCOMPARE( message.level, QStringLiteral("error") );
+    QCOMPARE( message.code, QStringLiteral("E0382") );
+    QCOMPARE( message.packageName, QStringLiteral("core") );
+    QCOMPARE( message.spans.size(), 2 );
+
+    // The primary span comes second
+    const CargoSpan* span = message.primarySpan();
+    QVERIFY( span );
+    QCOMPARE( span, &message.spans.at( 1 ) );
+    QCOMPARE( span->fileName, QStringLiteral("core/src/store.rs") );
+    QCOMPARE( span->lineStart, 14 );
+    QCOMPARE( span->columnStart, 20 );
+    QCOMPARE( span->lineEnd, 14 );
+    QCOMPARE( span->columnEnd, 25 );
+    QVERIFY( span->macroName.isEmpty() );
+}
+
+void TestCargoMessage::testMacroExpansion_data()
+{
+    QTest::addColumn<int>( "index" );
+    QTest::addColumn<QString>( "fileName" );
+    QTest::addColumn<int>( "line" );
+    QTest::addColumn<int>( "column" );
+    QTest::addColumn<QString>( "macroName" );
+
+    QTest::newRow( "standard library" ) << int( StdMacro )
+        << QStringLiteral("core/src/eval.rs") << 311 << 9 << QStringLiteral("println!");
+    QTest::newRow( "nested" ) << int( NestedMacro )
+        << QStringLiteral("core/src/server.rs") << 88 << 13 << QStringLiteral("log::info!");
+    QTest::newRow( "workspace" ) << int( WorkspaceMacro )
+        << QStringLiteral("core/src/macros.rs") << 6 << 17 << QString();
+}
+
+void TestCargoMessage::testMacroExpansion()
+{
+    QFETCH( int, index );
+    QFETCH( QString, fileName );
+    QFETCH( int, line );
+    QFETCH( int, column );
+    QFETCH( QString, macroName );
+
+    const CargoMessage message = recordedMessage( RecordedMessage( index ) );
+    const CargoSpan* span = message.primarySpan();
+    QVERIFY( span );
+    QCOMPARE( span->fileName, fileName );
+    QCOMPARE( span->lineStart, line );
+    QCOMPARE( span->columnStart, column );
+    QCOMPARE( span->macroName, macroName );
+}
+
+void TestCargoMessage::testItemLocations()
+{
+    const QUrl buildDir = QUrl::fromLocalFile( QStringLiteral("/home/dev/workspace/") );
+    CargoFilterStrategy filter( buildDir );
+    const CargoMessage message = recordedMessage( MovedValue );
+    const QVector<FilteredItem> items = filter.itemsForMessage( message );
+
+    // One item for each line of the rendered text, without the empty lines at the end
+    QCOMPARE( items.size(), 8 );
+    QCOMPARE( items.first().originalLine, QStringLiteral("error[E0382]: borrow of moved value: `items`") );
+    QCOMPARE( items.first().type, FilteredItem::ErrorItem );
+
+    // KDevelop counts lines and columns from 0, cargo from 1
+    for (const FilteredItem& item : items)
+    {
+        QVERIFY( item.isActivatable );
+        QCOMPARE( item.url, QUrl::fromLocalFile( QStringLiteral("/home/dev/workspace/core/src/store.rs") ) );
+        QCOMPARE( item.lineNo, 14 - 1 );
+        QCOMPARE( item.columnNo, 20 - 1 );
+    }
+    for (int i = 1; i < items.size(); ++i)
+    {
+        QCOMPARE( items.at( i ).type, FilteredItem::InformationItem );
+    }
+
+    // Macros from outside the workspace lead to the call site
+    const QVector<FilteredItem> macroItems = filter.itemsForMessage( recordedMessage( StdMacro ) );
+    QVERIFY( !macroItems.isEmpty() );
+    QCOMPARE( macroItems.first().url, QUrl::fromLocalFile( QStringLiteral("/home/dev/workspace/core/src/eval.rs") ) );
+    QCOMPARE( macroItems.first().lineNo, 311 - 1 );
+    QCOMPARE( macroItems.first().columnNo, 9 - 1 );
+}
+
+void TestCargoMessage::testWithoutSpans()
+{
+    const CargoMessage message = recordedMessage( NoSpans );
+    QCOMPARE( message.reason, CargoMessage::CompilerMessage );
+    QVERIFY( !message.primarySpan() );
+
+    CargoFilterStrategy filter( QUrl::fromLocalFile( QStringLiteral("/home/dev/workspace/") ) );
+    const QVector<FilteredItem> items = filter.itemsForMessage( message );
+    QCOMPARE( items.size(), 1 );
+    QCOMPARE( items.first().type, FilteredItem::ErrorItem );
+    QVERIFY( !items.first().isActivatable );
+}
+
+void TestCargoMessage::testArtifact()
+{
+    const CargoMessage message = recordedMessage( Artifact );
+    QCOMPARE( message.reason, CargoMessage::CompilerArtifact );
+    QCOMPARE( message.packageName, QStringLiteral("serde") );
+    QCOMPARE( message.targetName, QStringLiteral("serde") );
+    QCOMPARE( message.targetKinds, QStringList{ QStringLiteral("lib") } );
+    QCOMPARE( message.features, QStringList({ QStringLiteral("default"), QStringLiteral("derive"), QStringLiteral("std") }) );
+    QVERIFY( message.sourcePath.endsWith( QLatin1String("/serde-1.0.197/src/lib.rs") ) );
+    QCOMPARE( message.filenames.size(), 1 );
+    QVERIFY( message.executable.isEmpty() );
+    QVERIFY( message.fresh );
+    QVERIFY( !message.test );
+}
+
+void TestCargoMessage::testBuildScript()
+{
+    const CargoMessage message = recordedMessage( BuildScript );
+    QCOMPARE( message.reason, CargoMessage::BuildScriptExecuted );
+    QCOMPARE( message.packageName, QStringLiteral("serde") );
+    QCOMPARE( message.outDir, QStringLiteral("/home/dev/workspace/target/debug/build/serde-9f8e7d6c5b4a3921/out") );
+}
+
+void TestCargoMessage::testProgramOutput()
+{
+    QCOMPARE( recordedMessage( ProgramOutput ).reason, CargoMessage::InvalidMessage );
+    QCOMPARE( CargoMessageParser::parse( "{ not json" ).reason, CargoMessage::InvalidMessage );
+
+    // The filter keeps it as a line of text
+    CargoFilterStrategy filter( QUrl::fromLocalFile( QStringLiteral("/home/dev/workspace/") ) );
+    filter.setJsonMessages( true );
+    filter.handleLine( QProcess::StandardOutput, recordedLine( ProgramOutput ) );
+    const QVector<CargoMessage> messages = filter.takeMessages();
+    QCOMPARE( messages.size(), 1 );
+    QCOMPARE( messages.first().reason, CargoMessage::ProgramOutput );
+    QCOMPARE( messages.first().text, QStringLiteral("Hello from the program") );
+    QCOMPARE( filter.takeItems().size(), 1 );
+
+    // Without a view, there are only messages
+    filter.setShowItems( false );
+    filter.handleLine( QProcess::StandardOutput, recordedLine( ProgramOutput ) );
+    filter.handleLine( QProcess::StandardOutput, recordedLine( MovedValue ) );
+    filter.handleLine( QProcess::StandardError, "   Compiling core v0.1.0 (/home/dev/workspace/core)" );
+    QVERIFY( filter.takeItems().isEmpty() );
+    const QVector<CargoMessage> hidden = filter.takeMessages();
+    QCOMPARE( hidden.size(), 3 );
+    QCOMPARE( hidden.at( 0 ).text, QStringLiteral("Hello from the program") );
+    QCOMPARE( hidden.at( 1 ).reason, CargoMessage::CompilerMessage );
+    QCOMPARE( hidden.at( 2 ).reason, CargoMessage::UnitStarted );
+}
+
+void TestCargoMessage::testPackageName_data()
+{
+    QTest::addColumn<QString>( "packageId" );
+    QTest::addColumn<QString>( "name" );
+
+    QTest::newRow( "old" ) << QStringLiteral("serde 1.0.197 (registry+https://github.com/rust-lang/crates.io-index)")
+                           << QStringLiteral("serde");
+    QTest::newRow( "registry" ) << QStringLiteral("registry+https://github.com/rust-lang/crates.io-index#serde@1.0.197")
+                                << QStringLiteral("serde");
+    QTest::newRow( "path" ) << QStringLiteral("path+file:///home/dev/workspace/core#0.1.0") << QStringLiteral("core");
+    QTest::newRow( "renamed path" ) << QStringLiteral("path+file:///home/dev/workspace/crates/core#kernel@0.1.0")
+                                    << QStringLiteral("kernel");
+}
+
+void TestCargoMessage::testPackageName()
+{
+    QFETCH( QString, packageId );
+    QFETCH( QString, name );
+
+    QCOMPARE( CargoMessageParser::packageName( packageId ), name );
+}
@@ -0,0 +1,47 @@
+/*
+ * This file is part of the Cargo plugin for KDevelop.
+ *
+ * Copyright 2017 Miha Čančula <miha@noughmad.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEST_CARGOMESSAGE_H
+#define TEST_CARGOMESSAGE_H
+
+#include <QObject>
+
+/**
+ * Decoding of recorded cargo JSON messages, and the output items made from them.
+ */
+class TestCargoMessage : public QObject
+{
+Q_OBJECT
+private slots:
+    void testPrimarySpan();
+    void testMacroExpansion_data();
+    void testMacroExpansion();
+    void testItemLocations();
+    void testWithoutSpans();
+    void testArtifact();
+    void testBuildScript();
+    void testProgramOutput();
+    void testPackageName_data();
+    void testPackageName();
+};
+
+#endif